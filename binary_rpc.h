@@ -0,0 +1,685 @@
+#ifndef BINARY_RPC_H
+#define BINARY_RPC_H
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <memory>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <cstdint>
+#include "httplib.h"
+
+// 节点间二进制RPC：长度前缀帧 + 请求ID，一条连接上可以同时有多个请求在途。
+// 帧格式（小端）：[u32 正文长度][u32 请求ID][u8 操作码/状态码][正文]
+namespace binrpc {
+
+enum Op : uint8_t {
+    OP_GET = 1,      // 正文: key                          响应: 值
+    OP_SET = 2,      // 正文: i64 ttl_ms, u32 n, n*(key, 值)  响应: OK 或 PARTIAL + 被拒绝的key列表
+    OP_DELETE = 3,   // 正文: key                          响应: OK（已删除）或 NOT_FOUND
+    OP_MGET = 4,     // 正文: u32 n, n*key                 响应: u32 m, m*(key, 值)，只含存在的key
+    OP_EXPIRE = 5,   // 正文: i64 ttl_ms, key               响应: OK（已设置）或 NOT_FOUND
+    OP_MIGRATE = 6   // 正文、响应同 OP_SET；已存在或迁移期间被删除过的key不写入
+};
+
+// 操作码最高位置位时，正文前多一个 u32：调用方剩余的时间预算（毫秒）。
+// 服务端从收到起已超出预算的请求不再执行，直接返回 STATUS_EXPIRED
+constexpr uint8_t FLAG_DEADLINE = 0x80;
+
+enum Status : uint8_t {
+    STATUS_OK = 0,
+    STATUS_NOT_FOUND = 1,
+    STATUS_PARTIAL = 2,
+    STATUS_ERROR = 3,
+    STATUS_EXPIRED = 4,
+    // 不在线路上出现，只用于客户端回调（ok 为 false）：连接没能建立，请求没有发给对端
+    STATUS_UNREACHABLE = 5
+};
+
+constexpr size_t HEADER_SIZE = 9;
+constexpr uint32_t MAX_BODY_SIZE = 64 * 1024 * 1024;
+
+inline void put_u32(std::string& out, uint32_t value) {
+    char bytes[4];
+    for (int i = 0; i < 4; ++i) bytes[i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+    out.append(bytes, 4);
+}
+
+inline void put_i64(std::string& out, int64_t value) {
+    uint64_t v = static_cast<uint64_t>(value);
+    char bytes[8];
+    for (int i = 0; i < 8; ++i) bytes[i] = static_cast<char>((v >> (8 * i)) & 0xFF);
+    out.append(bytes, 8);
+}
+
+// 带长度前缀的字节串
+inline void put_bytes(std::string& out, std::string_view bytes) {
+    put_u32(out, static_cast<uint32_t>(bytes.size()));
+    out.append(bytes.data(), bytes.size());
+}
+
+inline uint32_t load_u32(const char* p) {
+    const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+    return static_cast<uint32_t>(u[0]) | (static_cast<uint32_t>(u[1]) << 8) |
+           (static_cast<uint32_t>(u[2]) << 16) | (static_cast<uint32_t>(u[3]) << 24);
+}
+
+inline void put_header(std::string& out, uint32_t body_size, uint32_t id, uint8_t code) {
+    put_u32(out, body_size);
+    put_u32(out, id);
+    out.push_back(static_cast<char>(code));
+}
+
+// 顺序读取正文，越界后 ok() 为 false，之后的读取都返回空值
+class Reader {
+public:
+    Reader(const char* data, size_t size) : p(data), end(data + size) {}
+
+    bool ok() const { return valid; }
+    bool done() const { return p == end; }
+
+    uint32_t u32() {
+        if (!require(4)) return 0;
+        uint32_t value = load_u32(p);
+        p += 4;
+        return value;
+    }
+
+    int64_t i64() {
+        if (!require(8)) return 0;
+        uint64_t value = static_cast<uint64_t>(load_u32(p)) | (static_cast<uint64_t>(load_u32(p + 4)) << 32);
+        p += 8;
+        return static_cast<int64_t>(value);
+    }
+
+    std::string_view bytes() {
+        uint32_t size = u32();
+        if (!require(size)) return std::string_view();
+        std::string_view value(p, size);
+        p += size;
+        return value;
+    }
+
+private:
+    const char* p;
+    const char* end;
+    bool valid = true;
+
+    bool require(size_t size) {
+        if (!valid || static_cast<size_t>(end - p) < size) {
+            valid = false;
+            return false;
+        }
+        return true;
+    }
+};
+
+// 服务端：单个epoll事件循环，处理函数直接在IO线程上执行（只做本地存储操作，耗时很短），
+// 需要等待的请求（如等待写入落盘）稍后回复，不阻塞IO线程。响应不保证按请求顺序，客户端按请求ID匹配
+class Server {
+public:
+    // 稍后回复：可在任意线程调用一次，连接已关闭时丢弃
+    using Reply = std::function<void(uint8_t status, std::string response)>;
+    using Defer = std::function<Reply()>;
+    // body 为请求正文，处理函数填写 status 和响应正文；不能立即回复时调用 defer() 取得回复函数后返回
+    using Handler = std::function<void(uint8_t op, std::string_view body, uint8_t& status, std::string& response,
+                                       const Defer& defer)>;
+
+    explicit Server(Handler handler) : handler(std::move(handler)) {}
+
+    bool listen(const std::string& host, int port) {
+        server_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (server_fd < 0) {
+            std::cerr << "RPC socket creation failed" << std::endl;
+            return false;
+        }
+        int opt = 1;
+        setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+        struct sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        if (inet_pton(AF_INET, host.c_str(), &address.sin_addr) <= 0) {
+            address.sin_addr.s_addr = INADDR_ANY;
+        }
+        address.sin_port = htons(port);
+        if (bind(server_fd, (struct sockaddr*)&address, sizeof(address)) < 0 || ::listen(server_fd, SOMAXCONN) < 0) {
+            std::cerr << "RPC bind failed on port " << port << std::endl;
+            close(server_fd);
+            return false;
+        }
+
+        on_accept = [this](uint32_t) { accept_connections(); };
+        loop.add(server_fd, EPOLLIN | EPOLLET, &on_accept);
+        loop.run();
+
+        for (auto& item : connections) {
+            close(item.first);
+        }
+        connections.clear();
+        close(server_fd);
+        return true;
+    }
+
+    void stop() {
+        loop.stop();
+    }
+
+private:
+    struct Connection {
+        int fd = -1;
+        std::string in;
+        std::string out;
+        size_t out_offset = 0;
+        bool closed = false;
+        httplib::detail::EventLoop::EventHandler on_event;
+    };
+
+    Handler handler;
+    httplib::detail::EventLoop loop;
+    httplib::detail::EventLoop::EventHandler on_accept;
+    std::unordered_map<int, std::shared_ptr<Connection>> connections;
+    int server_fd = -1;
+
+    void accept_connections() {
+        while (true) {
+            int fd = accept4(server_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) {
+                if (errno == EINTR) continue;
+                return;
+            }
+            int opt = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+            auto conn = std::make_shared<Connection>();
+            conn->fd = fd;
+            Connection* raw = conn.get();
+            conn->on_event = [this, raw](uint32_t events) { handle_event(raw, events); };
+            connections[fd] = conn;
+            if (!loop.add(fd, EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET, &conn->on_event)) {
+                close_connection(raw);
+            }
+        }
+    }
+
+    void handle_event(Connection* conn, uint32_t events) {
+        if (conn->closed) return;
+        if (events & EPOLLERR) {
+            close_connection(conn);
+            return;
+        }
+        if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) {
+            char buffer[16384];
+            bool peer_closed = false;
+            while (true) {
+                ssize_t n = recv(conn->fd, buffer, sizeof(buffer), 0);
+                if (n > 0) {
+                    conn->in.append(buffer, n);
+                    continue;
+                }
+                if (n == 0) {
+                    peer_closed = true;
+                    break;
+                }
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                close_connection(conn);
+                return;
+            }
+            if (!process_frames(conn, std::chrono::steady_clock::now()) || peer_closed) {
+                flush(conn);
+                close_connection(conn);
+                return;
+            }
+        }
+        flush(conn);
+    }
+
+    // 处理缓冲区中所有完整的帧，格式错误时返回 false。arrival 为这批数据的接收时刻
+    bool process_frames(Connection* conn, std::chrono::steady_clock::time_point arrival) {
+        size_t offset = 0;
+        std::string response;
+        struct Frame {
+            Connection* conn;
+            uint32_t id;
+            bool deferred;
+        } frame{conn, 0, false};
+        Defer defer = [this, &frame]() {
+            frame.deferred = true;
+            return make_reply(frame.conn, frame.id);
+        };
+        while (conn->in.size() - offset >= HEADER_SIZE) {
+            const char* header = conn->in.data() + offset;
+            uint32_t body_size = load_u32(header);
+            if (body_size > MAX_BODY_SIZE) return false;
+            if (conn->in.size() - offset < HEADER_SIZE + body_size) break;
+
+            uint32_t id = load_u32(header + 4);
+            uint8_t op = static_cast<uint8_t>(header[8]);
+            std::string_view body(header + HEADER_SIZE, body_size);
+            uint8_t status = STATUS_ERROR;
+            response.clear();
+            frame.id = id;
+            frame.deferred = false;
+            if (op & FLAG_DEADLINE) {
+                if (body.size() < 4) return false;
+                auto budget = std::chrono::milliseconds(load_u32(body.data()));
+                body.remove_prefix(4);
+                op &= static_cast<uint8_t>(~FLAG_DEADLINE);
+                if (std::chrono::steady_clock::now() - arrival >= budget) {
+                    status = STATUS_EXPIRED;
+                } else {
+                    handler(op, body, status, response, defer);
+                }
+            } else {
+                handler(op, body, status, response, defer);
+            }
+
+            if (!frame.deferred) {
+                put_header(conn->out, static_cast<uint32_t>(response.size()), id, status);
+                conn->out.append(response);
+            }
+            offset += HEADER_SIZE + body_size;
+        }
+        conn->in.erase(0, offset);
+        return true;
+    }
+
+    // 回复投递到事件循环线程写回，只持有连接的弱引用
+    Reply make_reply(Connection* conn, uint32_t id) {
+        std::weak_ptr<Connection> weak = connections[conn->fd];
+        return [this, weak, id](uint8_t status, std::string response) {
+            loop.post([this, weak, id, status, response = std::move(response)]() {
+                auto conn = weak.lock();
+                if (!conn || conn->closed) return;
+                put_header(conn->out, static_cast<uint32_t>(response.size()), id, status);
+                conn->out.append(response);
+                flush(conn.get());
+            });
+        };
+    }
+
+    void flush(Connection* conn) {
+        while (conn->out_offset < conn->out.size()) {
+            ssize_t n = send(conn->fd, conn->out.data() + conn->out_offset,
+                             conn->out.size() - conn->out_offset, MSG_NOSIGNAL);
+            if (n > 0) {
+                conn->out_offset += n;
+                continue;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+            close_connection(conn);
+            return;
+        }
+        conn->out.clear();
+        conn->out_offset = 0;
+    }
+
+    void close_connection(Connection* conn) {
+        if (conn->closed) return;
+        conn->closed = true;
+        loop.remove(conn->fd);
+        close(conn->fd);
+        auto it = connections.find(conn->fd);
+        if (it != connections.end()) {
+            loop.release_later(it->second);
+            connections.erase(it);
+        }
+    }
+};
+
+// 客户端：每个对端一条长连接，多个线程的请求复用同一连接。连接在后台线程中建立，
+// 请求帧放入连接的发送队列，由该线程在 poll 循环中以非阻塞方式写出并按请求ID分发响应，调用线程从不阻塞。
+// 连接失败后在一段时间内直接返回失败，调用方可以据此回退到HTTP
+class Client {
+public:
+    // ok 为 false 表示传输失败：status 为 STATUS_UNREACHABLE 时连接没能建立、请求没有发出；
+    // 为 STATUS_ERROR 时请求可能已发出（连接断开、超时或发送队列已满），对端可能已经执行过
+    using Callback = std::function<void(bool ok, uint8_t status, std::string body)>;
+
+    Client(const std::string& host, int port) : host(host), port(port) {}
+
+    ~Client() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (connection) {
+            connection->shutdown();
+        }
+    }
+
+    Client(const Client&) = delete;
+    Client& operator=(const Client&) = delete;
+
+    void set_connection_timeout(int msec) {
+        connect_timeout_ms = msec;
+    }
+
+    void set_read_timeout(int msec) {
+        read_timeout_ms = msec;
+    }
+
+    // 异步调用：请求帧放入发送队列后立即返回，不占用调用线程。callback 恰好被调用一次：
+    // 收到响应、连接失败或断开、超过读超时后在连接的线程中调用；处于重连退避期或发送队列已满时在当前线程中立即调用。
+    // budget_ms > 0 时随请求发给对端（见 FLAG_DEADLINE），并且超过它就不再等待响应
+    void call_async(uint8_t op, const std::string& body, Callback callback, int budget_ms = 0) {
+        uint32_t id = 0;
+        std::shared_ptr<Connection> conn = get_connection(id);
+        if (conn) {
+            std::string frame;
+            int timeout_ms = read_timeout_ms;
+            if (budget_ms > 0) {
+                frame.reserve(HEADER_SIZE + 4 + body.size());
+                put_header(frame, static_cast<uint32_t>(body.size() + 4), id, static_cast<uint8_t>(op | FLAG_DEADLINE));
+                put_u32(frame, static_cast<uint32_t>(budget_ms));
+                timeout_ms = std::min(timeout_ms, budget_ms);
+            } else {
+                frame.reserve(HEADER_SIZE + body.size());
+                put_header(frame, static_cast<uint32_t>(body.size()), id, op);
+            }
+            frame.append(body);
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+            if (conn->send(id, frame, callback, deadline)) {
+                return;
+            }
+            callback(false, conn->never_connected() ? STATUS_UNREACHABLE : STATUS_ERROR, std::string());
+            return;
+        }
+        callback(false, STATUS_UNREACHABLE, std::string());
+    }
+
+private:
+    // 一条连接及其线程：先解析地址并建立连接，之后在同一个 poll 循环中写出发送队列、读取响应。
+    // 连接断开后由下一次调用重建
+    class Connection {
+    public:
+        Connection(const std::string& host, int port, int connect_timeout_ms)
+            : host(host), port(port), connect_timeout_ms(connect_timeout_ms),
+              wake_fd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {}
+
+        ~Connection() {
+            if (fd >= 0) close(fd);
+            if (wake_fd >= 0) close(wake_fd);
+        }
+
+        void start(std::shared_ptr<Connection> self) {
+            std::thread([self]() { self->run(); }).detach();
+        }
+
+        bool alive() {
+            std::lock_guard<std::mutex> lock(mutex);
+            return !dead;
+        }
+
+        // 连接已结束且从未建立成功
+        bool never_connected() {
+            std::lock_guard<std::mutex> lock(mutex);
+            return dead && !connected;
+        }
+
+        // 注册回调并把请求帧放入发送队列；连接已断开或队列已满时返回 false，回调保持不变。
+        // 队列原本为空且已连接时先直接尝试非阻塞发送，写不完的部分由连接的线程继续发送
+        bool send(uint32_t id, const std::string& frame, Callback& callback,
+                  std::chrono::steady_clock::time_point deadline) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (dead || out.size() - out_offset + frame.size() > MAX_SEND_QUEUE) return false;
+            pending[id] = Pending{std::move(callback), deadline};
+            bool idle = out_offset == out.size();
+            out.append(frame);
+            if (connected && idle) {
+                write_some();
+                if (out_offset < out.size()) wake();
+            }
+            return true;
+        }
+
+        void shutdown() {
+            std::lock_guard<std::mutex> lock(mutex);
+            closing = true;
+            if (fd >= 0) ::shutdown(fd, SHUT_RDWR);
+            wake();
+        }
+
+    private:
+        // 发送队列的上限，对端长时间不读时新的请求直接失败，不在内存中堆积
+        static constexpr size_t MAX_SEND_QUEUE = 64 * 1024 * 1024;
+
+        std::string host;
+        int port;
+        int connect_timeout_ms;
+        int fd = -1;
+        int wake_fd;
+        // mutex 保护以下所有状态
+        std::mutex mutex;
+        bool connected = false;
+        bool closing = false;
+        bool dead = false;
+        std::string out;
+        size_t out_offset = 0;
+        struct Pending {
+            Callback callback;
+            std::chrono::steady_clock::time_point deadline;
+        };
+        std::unordered_map<uint32_t, Pending> pending;
+
+        void wake() {
+            uint64_t one = 1;
+            ssize_t n = write(wake_fd, &one, sizeof(one));
+            (void)n;
+        }
+
+        // 调用方需持有 mutex：尽量写出发送队列，写不动时留给下一次 POLLOUT；出错时关闭连接，由读取端以失败结束
+        void write_some() {
+            while (out_offset < out.size()) {
+                ssize_t n = ::send(fd, out.data() + out_offset, out.size() - out_offset, MSG_NOSIGNAL | MSG_DONTWAIT);
+                if (n > 0) {
+                    out_offset += n;
+                    continue;
+                }
+                if (n < 0 && errno == EINTR) continue;
+                if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+                ::shutdown(fd, SHUT_RDWR);
+                break;
+            }
+            if (out_offset == out.size()) {
+                out.clear();
+                out_offset = 0;
+            } else if (out_offset >= (1 << 20)) {
+                out.erase(0, out_offset);
+                out_offset = 0;
+            }
+        }
+
+        // 超过截止时间仍未收到响应的请求以失败结束，迟到的响应会被丢弃
+        void expire_pending() {
+            auto now = std::chrono::steady_clock::now();
+            std::vector<Callback> expired;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                for (auto it = pending.begin(); it != pending.end();) {
+                    if (it->second.deadline <= now) {
+                        expired.push_back(std::move(it->second.callback));
+                        it = pending.erase(it);
+                    } else {
+                        ++it;
+                    }
+                }
+            }
+            for (auto& callback : expired) {
+                callback(false, STATUS_ERROR, std::string());
+            }
+        }
+
+        void run() {
+            int sock = open_socket();
+            bool ok;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                ok = sock >= 0 && !closing;
+                if (ok) {
+                    fd = sock;
+                    connected = true;
+                    write_some();
+                }
+            }
+            if (!ok && sock >= 0) close(sock);
+            if (ok) io_loop();
+
+            // 连接失败或断开：所有在途和排队的请求以失败结束，连接没建立起来时它们都没有发出
+            uint8_t status = ok ? STATUS_ERROR : STATUS_UNREACHABLE;
+            std::unordered_map<uint32_t, Pending> failed;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                dead = true;
+                failed.swap(pending);
+                out.clear();
+                out_offset = 0;
+            }
+            for (auto& item : failed) {
+                item.second.callback(false, status, std::string());
+            }
+        }
+
+        void io_loop() {
+            std::string buffer;
+            char chunk[16384];
+            auto next_sweep = std::chrono::steady_clock::now();
+            while (true) {
+                // 带超时等待，空闲时也能按时结束超时的请求；发送队列非空时同时等待可写
+                struct pollfd pfds[2];
+                pfds[0].fd = fd;
+                pfds[0].events = POLLIN;
+                pfds[1].fd = wake_fd;
+                pfds[1].events = POLLIN;
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (closing) break;
+                    if (out_offset < out.size()) pfds[0].events |= POLLOUT;
+                }
+                int ready = poll(pfds, 2, SWEEP_INTERVAL_MS);
+                if (ready < 0 && errno != EINTR) break;
+                auto now = std::chrono::steady_clock::now();
+                if (now >= next_sweep) {
+                    expire_pending();
+                    next_sweep = now + std::chrono::milliseconds(SWEEP_INTERVAL_MS);
+                }
+                if (ready <= 0) continue;
+                if (pfds[1].revents & POLLIN) {
+                    uint64_t value;
+                    while (read(wake_fd, &value, sizeof(value)) > 0) {}
+                }
+                if (pfds[0].revents & POLLOUT) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    write_some();
+                }
+                if (!(pfds[0].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+
+                ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+                if (n < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)) continue;
+                if (n <= 0) break;
+                buffer.append(chunk, n);
+
+                size_t offset = 0;
+                while (buffer.size() - offset >= HEADER_SIZE) {
+                    uint32_t body_size = load_u32(buffer.data() + offset);
+                    if (buffer.size() - offset < HEADER_SIZE + body_size) break;
+                    uint32_t id = load_u32(buffer.data() + offset + 4);
+                    uint8_t status = static_cast<uint8_t>(buffer[offset + 8]);
+                    Callback callback;
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        auto it = pending.find(id);
+                        if (it != pending.end()) {
+                            callback = std::move(it->second.callback);
+                            pending.erase(it);
+                        }
+                    }
+                    if (callback) {
+                        callback(true, status, buffer.substr(offset + HEADER_SIZE, body_size));
+                    }
+                    offset += HEADER_SIZE + body_size;
+                }
+                buffer.erase(0, offset);
+            }
+        }
+
+        // 解析地址并以非阻塞方式建立连接，最多等待 connect_timeout_ms；在连接的线程中执行
+        int open_socket() {
+            struct sockaddr_in addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(port);
+            if (inet_pton(AF_INET, host.c_str(), &addr.sin_addr) <= 0) {
+                struct addrinfo hints;
+                memset(&hints, 0, sizeof(hints));
+                hints.ai_family = AF_INET;
+                hints.ai_socktype = SOCK_STREAM;
+                struct addrinfo* info = nullptr;
+                if (getaddrinfo(host.c_str(), nullptr, &hints, &info) != 0 || info == nullptr) {
+                    return -1;
+                }
+                addr.sin_addr = reinterpret_cast<struct sockaddr_in*>(info->ai_addr)->sin_addr;
+                freeaddrinfo(info);
+            }
+
+            int sock = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (sock < 0) {
+                return -1;
+            }
+            if (connect(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+                struct pollfd pfd;
+                pfd.fd = sock;
+                pfd.events = POLLOUT;
+                int error = 0;
+                socklen_t len = sizeof(error);
+                if (errno != EINPROGRESS || poll(&pfd, 1, connect_timeout_ms) <= 0 ||
+                    getsockopt(sock, SOL_SOCKET, SO_ERROR, &error, &len) < 0 || error != 0) {
+                    close(sock);
+                    return -1;
+                }
+            }
+            int opt = 1;
+            setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+            return sock;
+        }
+    };
+
+    static constexpr int RECONNECT_BACKOFF_MS = 1000;
+    // 连接线程检查请求超时的间隔
+    static constexpr int SWEEP_INTERVAL_MS = 50;
+
+    std::string host;
+    int port;
+    int connect_timeout_ms = 1000;
+    int read_timeout_ms = 5000;
+    std::mutex mutex;
+    std::shared_ptr<Connection> connection;
+    std::chrono::steady_clock::time_point retry_after;
+    uint32_t next_id = 0;
+
+    // 返回可用连接并分配请求ID。连接断开时新建一条连接（在其线程中建立，请求先排队），
+    // 上一条连接从未建立成功时退避一段时间，期间直接返回空
+    std::shared_ptr<Connection> get_connection(uint32_t& id) {
+        std::lock_guard<std::mutex> lock(mutex);
+        id = ++next_id;
+        if (connection && connection->alive()) {
+            return connection;
+        }
+        auto now = std::chrono::steady_clock::now();
+        if (connection && connection->never_connected()) {
+            retry_after = now + std::chrono::milliseconds(RECONNECT_BACKOFF_MS);
+        }
+        connection.reset();
+        if (now < retry_after) {
+            return nullptr;
+        }
+        connection = std::make_shared<Connection>(host, port, connect_timeout_ms);
+        connection->start(connection);
+        return connection;
+    }
+};
+
+} // namespace binrpc
+
+#endif // BINARY_RPC_H
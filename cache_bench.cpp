@@ -0,0 +1,350 @@
+// 缓存集群压测工具：多线程闭环/开环负载生成，可在进程内启动若干 CacheNode 以便复现
+#include "cache_node.h"
+#include <random>
+#include <cmath>
+#include <thread>
+#include <iomanip>
+
+namespace {
+
+struct BenchOptions {
+    int launch = 0;                  // 进程内启动的节点数，0 表示压测 --target 指定的已有集群
+    int port_base = 19527;
+    vector<string> targets;
+    bool open_loop = false;
+    double rate = 10000;             // 开环模式下的总请求速率（次/秒）
+    int connections = 16;            // 并发连接数，每个连接一个线程
+    double duration = 10;            // 计入统计的时长（秒）
+    double warmup = 1;               // 预热时长（秒），不计入统计
+    size_t keys = 100000;
+    bool zipfian = false;
+    double zipf_theta = 0.99;
+    size_t value_size = 100;
+    double read_ratio = 0.9;
+    bool preload = true;
+    NodeOptions node_options;        // 其余 --名称=值 参数原样作为进程内节点的运行参数
+};
+
+// Zipfian 分布（Gray 等人的方法，与 YCSB 相同）：排名越小越热门，
+// 排名经过散列再映射到key，热点key分散在不同节点上
+class ZipfianGenerator {
+public:
+    ZipfianGenerator(size_t n, double theta) : n(n), theta(theta) {
+        zetan = zeta(n, theta);
+        double zeta2 = zeta(2, theta);
+        alpha = 1.0 / (1.0 - theta);
+        eta = (1.0 - pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta2 / zetan);
+    }
+
+    size_t next(mt19937_64& rng) const {
+        double u = uniform_real_distribution<double>(0.0, 1.0)(rng);
+        double uz = u * zetan;
+        size_t rank;
+        if (uz < 1.0) {
+            rank = 0;
+        } else if (uz < 1.0 + pow(0.5, theta)) {
+            rank = 1;
+        } else {
+            rank = static_cast<size_t>(n * pow(eta * u - eta + 1.0, alpha));
+        }
+        if (rank >= n) rank = n - 1;
+        return murmur3_32(reinterpret_cast<const char*>(&rank), sizeof(rank)) % n;
+    }
+
+private:
+    size_t n;
+    double theta;
+    double zetan;
+    double alpha;
+    double eta;
+
+    static double zeta(size_t n, double theta) {
+        double sum = 0;
+        for (size_t i = 1; i <= n; ++i) {
+            sum += 1.0 / pow(static_cast<double>(i), theta);
+        }
+        return sum;
+    }
+};
+
+// 每个工作线程各自记录原始延迟（微秒），结束后合并，分位数是精确值
+struct WorkerResult {
+    vector<uint32_t> reads;
+    vector<uint32_t> writes;
+    uint64_t errors = 0;
+    uint64_t missed = 0;   // 开环模式下到结束时仍未发出的请求数（服务端跟不上目标速率）
+};
+
+string keyName(size_t index) {
+    return "bench" + to_string(index);
+}
+
+bool waitHealthy(const string& url, int timeout_ms) {
+    httplib::Client client(url);
+    client.set_connection_timeout(0, 200000);
+    auto deadline = chrono::steady_clock::now() + chrono::milliseconds(timeout_ms);
+    while (chrono::steady_clock::now() < deadline) {
+        auto res = client.Get("/health");
+        if (res && res->status == 200) return true;
+        this_thread::sleep_for(chrono::milliseconds(50));
+    }
+    return false;
+}
+
+// 批量写入全部key，保证读请求能命中
+bool preloadKeys(const BenchOptions& opts, const string& value) {
+    const size_t batch = 200;
+    size_t threads = min<size_t>(opts.targets.size() * 2, 8);
+    atomic<size_t> next{0};
+    atomic<bool> ok{true};
+    vector<thread> workers;
+    for (size_t t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t]() {
+            httplib::Client client(opts.targets[t % opts.targets.size()]);
+            while (ok) {
+                size_t start = next.fetch_add(batch);
+                if (start >= opts.keys) break;
+                string body = "{";
+                for (size_t i = start; i < min(start + batch, opts.keys); ++i) {
+                    if (i > start) body.push_back(',');
+                    body.append("\"").append(keyName(i)).append("\":").append(value);
+                }
+                body.push_back('}');
+                auto res = client.Post("/", body, "application/json");
+                if (!res || res->status != 200) ok = false;
+            }
+        });
+    }
+    for (auto& worker : workers) worker.join();
+    return ok;
+}
+
+void runWorker(const BenchOptions& opts, size_t index, const string& value, const ZipfianGenerator* zipf,
+               chrono::steady_clock::time_point start, WorkerResult& result) {
+    httplib::Client client(opts.targets[index % opts.targets.size()]);
+    mt19937_64 rng(index * 7919 + 1);
+    uniform_int_distribution<size_t> uniform_key(0, opts.keys - 1);
+    uniform_real_distribution<double> coin(0.0, 1.0);
+    auto measure_from = start + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(opts.warmup));
+    auto end = measure_from + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(opts.duration));
+
+    // 开环：每个连接按固定间隔发送，间隔 = 连接数 / 总速率，各连接错开起始时间。
+    // 延迟从计划发送时刻算起，落后时排队的时间也计入，避免协调遗漏
+    chrono::duration<double> interval(opts.connections / opts.rate);
+    auto intended = start + chrono::duration_cast<chrono::steady_clock::duration>(interval * (double(index) / opts.connections));
+
+    while (true) {
+        auto now = chrono::steady_clock::now();
+        if (opts.open_loop) {
+            if (intended >= end) break;
+            if (now >= end) {
+                result.missed += static_cast<uint64_t>(chrono::duration<double>(end - intended) / interval) + 1;
+                break;
+            }
+            if (intended > now) {
+                this_thread::sleep_until(intended);
+            }
+        } else {
+            if (now >= end) break;
+            intended = now;
+        }
+
+        size_t key = zipf ? zipf->next(rng) : uniform_key(rng);
+        bool read = coin(rng) < opts.read_ratio;
+        bool ok;
+        if (read) {
+            auto res = client.Get("/" + keyName(key));
+            ok = res && (res->status == 200 || res->status == 404);
+        } else {
+            auto res = client.Post("/", "{\"" + keyName(key) + "\":" + value + "}", "application/json");
+            ok = res && res->status == 200;
+        }
+        auto finished = chrono::steady_clock::now();
+
+        if (intended >= measure_from) {
+            if (!ok) {
+                result.errors++;
+            } else {
+                auto latency = chrono::duration_cast<chrono::microseconds>(finished - intended).count();
+                (read ? result.reads : result.writes).push_back(static_cast<uint32_t>(min<int64_t>(latency, UINT32_MAX)));
+            }
+        }
+        if (opts.open_loop) {
+            intended += chrono::duration_cast<chrono::steady_clock::duration>(interval);
+        }
+    }
+}
+
+void report(const char* name, vector<uint32_t>& samples, double seconds) {
+    if (samples.empty()) {
+        cout << left << setw(7) << name << "0 ops" << endl;
+        return;
+    }
+    sort(samples.begin(), samples.end());
+    auto pct = [&](double q) {
+        size_t rank = static_cast<size_t>(ceil(q * samples.size()));
+        return samples[rank == 0 ? 0 : rank - 1];
+    };
+    cout << left << setw(7) << name << right
+         << setw(10) << samples.size() << " ops "
+         << setw(11) << fixed << setprecision(1) << samples.size() / seconds << " ops/s"
+         << "  p50 " << setw(7) << pct(0.50)
+         << "  p99 " << setw(7) << pct(0.99)
+         << "  p999 " << setw(7) << pct(0.999)
+         << "  max " << setw(7) << samples.back() << " us" << endl;
+}
+
+bool parseBenchOption(const string& arg, BenchOptions& opts) {
+    size_t eq = arg.find('=');
+    if (arg.compare(0, 2, "--") != 0 || eq == string::npos) {
+        return false;
+    }
+    string name = arg.substr(2, eq - 2);
+    string value = arg.substr(eq + 1);
+    try {
+        if (name == "launch") {
+            opts.launch = stoi(value);
+        } else if (name == "port-base") {
+            opts.port_base = stoi(value);
+        } else if (name == "target") {
+            opts.targets = splitList(value);
+        } else if (name == "mode") {
+            if (value != "open" && value != "closed") return false;
+            opts.open_loop = value == "open";
+        } else if (name == "rate") {
+            opts.rate = stod(value);
+            if (opts.rate <= 0) return false;
+        } else if (name == "connections") {
+            opts.connections = stoi(value);
+            if (opts.connections <= 0) return false;
+        } else if (name == "duration") {
+            opts.duration = stod(value);
+        } else if (name == "warmup") {
+            opts.warmup = stod(value);
+        } else if (name == "keys") {
+            opts.keys = stoul(value);
+            if (opts.keys == 0) return false;
+        } else if (name == "distribution") {
+            if (value != "uniform" && value != "zipfian") return false;
+            opts.zipfian = value == "zipfian";
+        } else if (name == "zipf-theta") {
+            opts.zipf_theta = stod(value);
+            if (opts.zipf_theta <= 0 || opts.zipf_theta >= 1) return false;
+        } else if (name == "value-size") {
+            opts.value_size = parseByteSize(value);
+        } else if (name == "read-ratio") {
+            opts.read_ratio = stod(value);
+            if (opts.read_ratio < 0 || opts.read_ratio > 1) return false;
+        } else if (name == "preload") {
+            if (value != "true" && value != "false") return false;
+            opts.preload = value == "true";
+        } else {
+            return parseOption(arg, opts.node_options);
+        }
+    } catch (const exception& e) {
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    BenchOptions opts;
+    for (int i = 1; i < argc; i++) {
+        if (!parseBenchOption(argv[i], opts)) {
+            cerr << "无效参数: " << argv[i] << endl;
+            cerr << "用法: " << argv[0] << " (--launch=N [--port-base=N] [节点参数...] | --target=URL,...)"
+                 << " [--mode=closed|open] [--rate=N] [--connections=N] [--duration=秒] [--warmup=秒]"
+                 << " [--keys=N] [--distribution=uniform|zipfian] [--zipf-theta=0.99] [--value-size=字节数]"
+                 << " [--read-ratio=0.9] [--preload=true|false]" << endl;
+            return 1;
+        }
+    }
+
+    // 进程内启动的节点用本机地址互相访问
+    vector<unique_ptr<CacheNode>> nodes;
+    vector<thread> node_threads;
+    if (opts.launch > 0) {
+        vector<string> urls;
+        for (int i = 0; i < opts.launch; ++i) {
+            urls.push_back("http://127.0.0.1:" + to_string(opts.port_base + i));
+        }
+        for (int i = 0; i < opts.launch; ++i) {
+            NodeOptions node_options = opts.node_options;
+            node_options.self_url = urls[i];
+            int port = opts.port_base + i;
+            nodes.emplace_back(new CacheNode("node" + to_string(port), port, urls, node_options));
+        }
+        for (auto& node : nodes) {
+            CacheNode* raw = node.get();
+            node_threads.emplace_back([raw]() { raw->start(); });
+        }
+        opts.targets = urls;
+    }
+    if (opts.targets.empty()) {
+        cerr << "需要 --launch=N 或 --target=URL,..." << endl;
+        return 1;
+    }
+    for (const auto& url : opts.targets) {
+        if (!waitHealthy(url, 5000)) {
+            cerr << url << " 不可用" << endl;
+            return 1;
+        }
+    }
+
+    // 值为指定长度的JSON字符串
+    string value = "\"" + string(opts.value_size > 2 ? opts.value_size - 2 : 0, 'x') + "\"";
+    if (opts.preload) {
+        auto started = chrono::steady_clock::now();
+        if (!preloadKeys(opts, value)) {
+            cerr << "预写入失败" << endl;
+        }
+        cout << "preload " << opts.keys << " keys in "
+             << chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - started).count() << " ms" << endl;
+    }
+
+    unique_ptr<ZipfianGenerator> zipf;
+    if (opts.zipfian) {
+        zipf.reset(new ZipfianGenerator(opts.keys, opts.zipf_theta));
+    }
+
+    vector<WorkerResult> results(opts.connections);
+    vector<thread> workers;
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < opts.connections; ++i) {
+        workers.emplace_back(runWorker, cref(opts), i, cref(value), zipf.get(), start, ref(results[i]));
+    }
+    for (auto& worker : workers) worker.join();
+
+    WorkerResult total;
+    for (auto& result : results) {
+        total.reads.insert(total.reads.end(), result.reads.begin(), result.reads.end());
+        total.writes.insert(total.writes.end(), result.writes.begin(), result.writes.end());
+        total.errors += result.errors;
+        total.missed += result.missed;
+    }
+    vector<uint32_t> all(total.reads);
+    all.insert(all.end(), total.writes.begin(), total.writes.end());
+
+    cout << (opts.open_loop ? "open-loop " : "closed-loop ") << opts.connections << " connections, "
+         << opts.targets.size() << " nodes, " << opts.keys << " keys ("
+         << (opts.zipfian ? "zipfian" : "uniform") << "), " << opts.value_size << " B values, read ratio "
+         << opts.read_ratio;
+    if (opts.open_loop) cout << ", target " << opts.rate << " ops/s";
+    cout << endl;
+    report("read", total.reads, opts.duration);
+    report("write", total.writes, opts.duration);
+    report("total", all, opts.duration);
+    cout << "errors " << total.errors;
+    if (opts.open_loop) cout << ", missed " << total.missed;
+    cout << endl;
+
+    for (auto& node : nodes) {
+        node->stop();
+    }
+    for (auto& t : node_threads) {
+        t.join();
+    }
+    return total.errors == 0 ? 0 : 2;
+}
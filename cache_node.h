@@ -0,0 +1,2842 @@
+#ifndef CACHE_NODE_H
+#define CACHE_NODE_H
+
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <shared_mutex>
+#include <mutex>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <future>
+#include <unordered_set>
+#include <algorithm>
+#include <cstring>
+#include <condition_variable>
+#include <charconv>
+#include <cmath>
+#include <cerrno>
+#include <limits>
+#include "httplib.h"
+#include "cache_store.h"
+#include "binary_rpc.h"
+#include "resp_server.h"
+#include "persistence.h"
+#include "metrics.h"
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+using namespace std;
+
+// 配置常量
+namespace Config {
+    constexpr int VIRTUAL_NODES = 150;
+    constexpr int RPC_TIMEOUT_SECONDS = 5;
+    constexpr int RPC_CONNECT_TIMEOUT_MS = 1000;
+    constexpr int RPC_MAX_IDLE_CONNECTIONS = 64;
+    constexpr int PORT_BASE = 9526;
+    constexpr int WORKER_THREADS = 16;
+    constexpr int IO_THREADS = 1;
+    constexpr int LISTEN_BACKLOG = 1024;
+    constexpr int KEEP_ALIVE_TIMEOUT_SECONDS = 60;
+    constexpr int STORE_SHARDS = 64;
+    // 二进制RPC端口 = HTTP端口 + 偏移，所有节点需使用相同的偏移
+    constexpr int RPC_PORT_OFFSET = 10000;
+    // 写请求中指定过期时间（秒，可带小数）的请求头
+    constexpr const char* TTL_HEADER = "X-TTL";
+    // 过期时间上限（秒），超过时按非法请求处理，避免换算成毫秒和截止时间时溢出
+    constexpr double MAX_TTL_SECONDS = 10.0 * 365 * 24 * 3600;
+    constexpr const char* VALUE_TOO_LARGE = "Value too large";
+    // 过载保护：客户端剩余时间预算（毫秒）的请求头，转发给其他节点时带上剩余的部分；
+    // 排队等待工作线程的请求数上限、连接数上限，以及发往每个对端的在途RPC上限
+    constexpr const char* TIMEOUT_HEADER = "X-Timeout-Ms";
+    constexpr const char* DEADLINE_EXCEEDED = "Deadline exceeded";
+    constexpr const char* PEER_OVERLOADED = "Peer overloaded";
+    // 本地的写入日志写入失败，写入没有持久化
+    constexpr const char* JOURNAL_FAILED = "Write-ahead log failed";
+    constexpr size_t MAX_QUEUED_REQUESTS = 1024;
+    constexpr size_t MAX_CONNECTIONS = 10000;
+    constexpr size_t PEER_CONCURRENCY = 256;
+    // 成员变更后的数据迁移：每秒最多迁移的key数、每批key数，
+    // 以及迁移完成后继续保留旧视图（读回退）的时间
+    constexpr int MIGRATION_RATE = 10000;
+    constexpr size_t MIGRATION_BATCH = 128;
+    constexpr int MIGRATION_GRACE_SECONDS = 30;
+    constexpr int MIGRATION_RETRY_MS = 1000;
+    // 近端缓存：非副本节点上缓存热点key的值，条目存活时间即允许的最大陈旧时间
+    constexpr int NEAR_CACHE_TTL_MS = 1000;
+    constexpr uint32_t HOT_KEY_THRESHOLD = 4;
+    constexpr size_t NEAR_CACHE_SHARDS = 16;
+    // 持久化：组提交间隔和定期快照间隔
+    constexpr int FSYNC_INTERVAL_MS = 10;
+    constexpr int SNAPSHOT_INTERVAL_SECONDS = 300;
+    // 批量导入：每批记录数和最多同时在写的批数（超过时暂停接收）；批量导出每次发送的数据块大小和每次从存储分段中取出的key数
+    constexpr size_t IMPORT_BATCH = 1000;
+    constexpr size_t IMPORT_MAX_IN_FLIGHT = 8;
+    constexpr size_t EXPORT_CHUNK_SIZE = 64 * 1024;
+    constexpr size_t EXPORT_SCAN_BATCH = 1024;
+}
+
+// MurmurHash3 (x86_32)：结果只取决于输入字节，不同编译器/标准库构建的节点对key归属的判断一致
+inline uint32_t murmur3_32(const char* data, size_t len, uint32_t seed = 0) {
+    const uint32_t c1 = 0xcc9e2d51;
+    const uint32_t c2 = 0x1b873593;
+    uint32_t h = seed;
+    size_t blocks = len / 4;
+    for (size_t i = 0; i < blocks; i++) {
+        uint32_t k;
+        memcpy(&k, data + i * 4, 4);
+        k *= c1;
+        k = (k << 15) | (k >> 17);
+        k *= c2;
+        h ^= k;
+        h = (h << 13) | (h >> 19);
+        h = h * 5 + 0xe6546b64;
+    }
+    const unsigned char* tail = reinterpret_cast<const unsigned char*>(data + blocks * 4);
+    uint32_t k = 0;
+    switch (len & 3) {
+        case 3: k ^= static_cast<uint32_t>(tail[2]) << 16; [[fallthrough]];
+        case 2: k ^= static_cast<uint32_t>(tail[1]) << 8; [[fallthrough]];
+        case 1:
+            k ^= tail[0];
+            k *= c1;
+            k = (k << 15) | (k >> 17);
+            k *= c2;
+            h ^= k;
+    }
+    h ^= static_cast<uint32_t>(len);
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    return h;
+}
+
+inline uint32_t murmur3_32(const string& key, uint32_t seed = 0) {
+    return murmur3_32(key.data(), key.size(), seed);
+}
+
+// 一致性哈希：虚拟节点的哈希点存放在有序数组中，对应的节点以下标保存，
+// 查找是对连续内存的无分支二分搜索。也可以切换为 rendezvous（最高随机权重）哈希
+class ConsistentHash {
+public:
+    enum class Mode { Ring, Rendezvous };
+
+    explicit ConsistentHash(Mode mode = Mode::Ring) : mode(mode) {}
+
+    void addNode(const string& node) {
+        nodes.push_back(node);
+        node_seeds.push_back(murmur3_32(node));
+        rebuild();
+    }
+
+    // 返回key所属节点的下标，环为空时返回 -1
+    int getNodeIndex(const string& key) const {
+        if (nodes.empty()) return -1;
+        uint32_t hash_value = murmur3_32(key);
+        if (mode == Mode::Rendezvous) {
+            // 每个节点以自身哈希为种子对key打分，分数最高者拥有该key
+            int best = 0;
+            uint32_t best_score = 0;
+            for (size_t i = 0; i < nodes.size(); i++) {
+                uint32_t score = mix(hash_value ^ node_seeds[i]);
+                if (i == 0 || score > best_score) {
+                    best = static_cast<int>(i);
+                    best_score = score;
+                }
+            }
+            return best;
+        }
+        return owners[lowerBound(hash_value)];
+    }
+
+    const string& getNode(const string& key) const {
+        static const string empty;
+        int index = getNodeIndex(key);
+        return index < 0 ? empty : nodes[index];
+    }
+
+    // key的前 count 个不同节点（副本集），第一个与 getNode 相同。
+    // 环模式下沿顺时针方向取后续的不同节点，rendezvous 模式下取分数最高的几个
+    vector<int> getNodeIndexes(const string& key, size_t count) const {
+        vector<int> result;
+        count = min(count, nodes.size());
+        if (count == 0) return result;
+        uint32_t hash_value = murmur3_32(key);
+        if (mode == Mode::Rendezvous) {
+            vector<pair<uint32_t, int>> scores;
+            scores.reserve(nodes.size());
+            for (size_t i = 0; i < nodes.size(); i++) {
+                scores.emplace_back(mix(hash_value ^ node_seeds[i]), static_cast<int>(i));
+            }
+            partial_sort(scores.begin(), scores.begin() + count, scores.end(),
+                         [](const pair<uint32_t, int>& a, const pair<uint32_t, int>& b) {
+                             return a.first > b.first || (a.first == b.first && a.second < b.second);
+                         });
+            for (size_t i = 0; i < count; i++) {
+                result.push_back(scores[i].second);
+            }
+            return result;
+        }
+        size_t start = lowerBound(hash_value);
+        for (size_t i = 0; i < points.size() && result.size() < count; i++) {
+            int owner = owners[(start + i) % points.size()];
+            if (find(result.begin(), result.end(), owner) == result.end()) {
+                result.push_back(owner);
+            }
+        }
+        return result;
+    }
+
+    const string& nodeAt(int index) const {
+        return nodes[index];
+    }
+
+    const vector<string>& getAllNodes() const {
+        return nodes;
+    }
+
+private:
+    Mode mode;
+    int virtual_nodes = Config::VIRTUAL_NODES;
+    vector<string> nodes;
+    vector<uint32_t> node_seeds;
+    vector<uint32_t> points;   // 升序排列的虚拟节点哈希
+    vector<uint16_t> owners;   // owners[i] 为 points[i] 所属节点的下标
+
+    // 第一个不小于 hash_value 的点，超过最后一个点时回绕到 0
+    size_t lowerBound(uint32_t hash_value) const {
+        const uint32_t* base = points.data();
+        size_t n = points.size();
+        while (n > 1) {
+            size_t half = n / 2;
+            base = base[half - 1] < hash_value ? base + half : base;
+            n -= half;
+        }
+        size_t index = static_cast<size_t>(base - points.data()) + (*base < hash_value);
+        return index == points.size() ? 0 : index;
+    }
+
+    static uint32_t mix(uint32_t h) {
+        h ^= h >> 16;
+        h *= 0x85ebca6b;
+        h ^= h >> 13;
+        h *= 0xc2b2ae35;
+        h ^= h >> 16;
+        return h;
+    }
+
+    void rebuild() {
+        vector<pair<uint32_t, uint16_t>> ring;
+        ring.reserve(nodes.size() * virtual_nodes);
+        for (size_t n = 0; n < nodes.size(); n++) {
+            for (int i = 0; i < virtual_nodes; i++) {
+                ring.emplace_back(murmur3_32(nodes[n] + "#" + to_string(i)), static_cast<uint16_t>(n));
+            }
+        }
+        sort(ring.begin(), ring.end());
+        points.clear();
+        owners.clear();
+        for (const auto& point : ring) {
+            // 哈希冲突时保留下标较小的节点，保证所有节点构建出相同的环
+            if (!points.empty() && points.back() == point.first) continue;
+            points.push_back(point.first);
+            owners.push_back(point.second);
+        }
+    }
+};
+
+// 节点运行参数，可通过命令行 --名称=值 覆盖默认配置
+struct NodeOptions {
+    int worker_threads = Config::WORKER_THREADS;
+    int io_threads = Config::IO_THREADS;
+    size_t cores = 0;        // 每核模式的核数（每核一个绑定CPU的事件循环和一部分存储分段），0 表示不启用
+    int listen_backlog = Config::LISTEN_BACKLOG;
+    int keep_alive_timeout = Config::KEEP_ALIVE_TIMEOUT_SECONDS;
+    size_t max_queued_requests = Config::MAX_QUEUED_REQUESTS;  // 0 表示不限制，下同
+    size_t max_connections = Config::MAX_CONNECTIONS;
+    size_t peer_concurrency = Config::PEER_CONCURRENCY;
+    int store_shards = Config::STORE_SHARDS;
+    size_t max_memory = 0;  // 本地存储内存上限（字节），0 表示不限制
+    int rpc_port_offset = Config::RPC_PORT_OFFSET;  // 0 表示禁用二进制RPC，节点间只走HTTP
+    int resp_port = 0;       // Redis协议（RESP2）监听端口，0 表示不启用
+    ConsistentHash::Mode hash_mode = ConsistentHash::Mode::Ring;  // 所有节点需使用相同的模式
+    string self_url;         // 本节点对外地址，为空时按端口推导 http://cache-server-N:端口
+    vector<string> nodes;    // 初始成员列表，为空时使用默认的三个节点
+    string join_url;         // 启动后向该节点申请加入集群
+    int migration_rate = Config::MIGRATION_RATE;
+    size_t replicas = 1;     // 每个key保存在环上连续的几个不同节点上
+    bool quorum_writes = true;  // true: 多数副本写成功才返回；false: 主副本写成功即返回，其余副本后台异步写
+    size_t near_cache_bytes = 0;  // 近端缓存容量（字节），0 表示禁用
+    int near_cache_ttl_ms = Config::NEAR_CACHE_TTL_MS;
+    uint32_t hot_key_threshold = Config::HOT_KEY_THRESHOLD;  // 近期访问次数达到该值的远端key进入近端缓存
+    string data_dir;         // 持久化目录，为空表示只在内存中保存
+    int fsync_interval_ms = Config::FSYNC_INTERVAL_MS;
+    bool sync_writes = false;  // 写入是否等待日志落盘后才返回
+    int snapshot_interval = Config::SNAPSHOT_INTERVAL_SECONDS;
+};
+
+// 集群成员视图：整体替换而不原地修改，版本号大的视图生效
+struct Membership {
+    uint64_t version;
+    vector<string> nodes;
+    ConsistentHash ring;
+
+    Membership(uint64_t version, const vector<string>& nodes, ConsistentHash::Mode mode)
+        : version(version), nodes(nodes), ring(mode) {
+        for (const auto& node : nodes) {
+            ring.addNode(node);
+        }
+    }
+};
+
+class CacheNode {
+private:
+    ShardedStore cache;
+    string node_id;
+    int port;
+    string current_node_url;
+    NodeOptions options;
+    // 当前成员视图和迁移期间的旧视图，用 atomic_load/atomic_store 读写；
+    // 请求处理时取一次快照，整个请求内使用同一个视图
+    shared_ptr<const Membership> membership;
+    shared_ptr<const Membership> previous_membership;
+    mutex membership_mutex;  // 串行化成员变更
+    // 后台迁移线程的唤醒条件
+    mutex migration_mutex;
+    condition_variable migration_cv;
+    bool migration_pending = false;
+    // 本节点发起的成员变更：待广播的视图和还没有收到它的节点，由后台迁移线程发送（受 migration_mutex 保护）
+    string broadcast_view;
+    unordered_set<string> broadcast_targets;
+    // 对端节点：HTTP客户端（内部维护长连接池）、二进制RPC客户端（单条多路复用连接，
+    // 不可用时回退到HTTP），以及正在进行的读请求数（用于在副本间分摊读请求）
+    // 对端调用的耗时（微秒）和失败次数，按操作类型（binrpc::Op - 1）分开统计
+    static constexpr size_t RPC_OPS = 6;
+    struct RpcStats {
+        metrics::Histogram latency;
+        metrics::Counter errors;
+        metrics::Counter shed;  // 超出并发上限或时间预算已用完而没有发出的调用
+    };
+    struct Peer {
+        unique_ptr<httplib::Client> http;
+        unique_ptr<binrpc::Client> binary;
+        atomic<int> outstanding{0};
+        atomic<size_t> in_flight{0};  // 所有在途调用，用于并发上限
+        atomic<size_t> fallbacks{0};  // 正在 http_pool 中执行的HTTP回退调用
+        RpcStats rpc[RPC_OPS];
+    };
+    using GetCallback = function<void(bool found, string value)>;
+    // 客户端请求的截止时刻（见 Config::TIMEOUT_HEADER），转发出去的调用都不会超过它
+    using Deadline = chrono::steady_clock::time_point;
+    static constexpr Deadline NO_DEADLINE = Deadline::max();
+
+    // 成员变化后按需创建，创建后不再删除
+    shared_mutex peers_mutex;
+    unordered_map<string, unique_ptr<Peer>> peers;
+    // 对端响应的后续处理在这里执行，不占用HTTP工作线程，也不阻塞二进制RPC的读线程
+    shared_ptr<httplib::detail::ThreadPool> rpc_pool;
+    // 回退到HTTP的对端调用是阻塞的，单独在这里执行，慢的对端不会拖住 rpc_pool 中其他key的后续处理
+    shared_ptr<httplib::detail::ThreadPool> http_pool;
+    // 近端缓存：本节点不是副本的热点key在这里保留一份，过期时间限制了陈旧程度；
+    // 经本节点写入或删除的key会立即失效。访问频率由 Count-Min Sketch 估计
+    unique_ptr<ShardedStore> near_cache;
+    CountMinSketch access_sketch;
+    metrics::Counter near_cache_hits;
+    metrics::Counter near_cache_misses;
+    // 合并并发的远程读：同一key正在从某个节点读取时，后来的读取等待同一个RPC的结果，不再重复发出。
+    // 经本节点写入或删除的key会从表中移除，之后的读取重新发出RPC，避免读到写入之前的值。
+    // 只合并到截止时间不早于自己的读取上，否则前一个读取超时会让后来者误以为key不存在
+    struct ReadFlight {
+        string node;
+        Deadline deadline;
+        vector<GetCallback> waiters;
+    };
+    struct ReadFlightShard {
+        mutex lock;
+        unordered_map<string, shared_ptr<ReadFlight>> flights;
+    };
+    static constexpr size_t READ_FLIGHT_SHARDS = 16;
+    ReadFlightShard read_flights[READ_FLIGHT_SHARDS];
+    metrics::Counter read_flights_started;  // 实际发出的远程读
+    metrics::Counter read_flights_joined;   // 合并到进行中的远程读上的读取
+    // 本地存储的命中/未命中次数
+    metrics::Counter local_hits;
+    metrics::Counter local_misses;
+    // 按路由统计的请求耗时（微秒）和各类状态码的响应数，以路由表中模式字符串的地址为键，
+    // 未匹配任何路由的请求归入键 nullptr
+    struct RouteStats {
+        string method;
+        string route;
+        metrics::Histogram latency;
+        metrics::Counter responses[5];  // 1xx ~ 5xx
+    };
+    shared_mutex route_stats_mutex;
+    unordered_map<const char*, unique_ptr<RouteStats>> route_stats;
+    // 运行中的HTTP服务器，用于读取连接数
+    atomic<httplib::Server*> http_server{nullptr};
+    // 日志 + 快照持久化，未配置数据目录时为空
+    unique_ptr<Persistence> persistence;
+
+public:
+    CacheNode(const string& id, int p, const vector<string>& nodes, const NodeOptions& opts = NodeOptions())
+        : cache(opts.store_shards, opts.max_memory), node_id(id), port(p), options(opts) {
+        current_node_url = options.self_url.empty()
+            ? "http://cache-server-" + to_string(port - Config::PORT_BASE) + ":" + to_string(port)
+            : options.self_url;
+        // 初始视图版本为 1；申请加入的节点以版本 0 起步，加入后被集群下发的视图替换
+        uint64_t version = options.join_url.empty() ? 1 : 0;
+        membership = make_shared<const Membership>(version, nodes, options.hash_mode);
+        rpc_pool = make_shared<httplib::detail::ThreadPool>(options.worker_threads);
+        http_pool = make_shared<httplib::detail::ThreadPool>(options.worker_threads);
+        if (options.near_cache_bytes > 0) {
+            near_cache.reset(new ShardedStore(Config::NEAR_CACHE_SHARDS, options.near_cache_bytes));
+        }
+        if (!options.data_dir.empty()) {
+            Persistence::Options persistence_options;
+            persistence_options.dir = options.data_dir;
+            persistence_options.fsync_interval_ms = options.fsync_interval_ms;
+            persistence_options.sync_writes = options.sync_writes;
+            persistence_options.snapshot_interval_sec = options.snapshot_interval;
+            persistence.reset(new Persistence(persistence_options, cache));
+            auto started = chrono::steady_clock::now();
+            size_t recovered = persistence->recover();
+            auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - started).count();
+            cout << "从 " << options.data_dir << " 恢复 " << recovered << " 个key，用时 " << elapsed << " ms" << endl;
+        }
+    }
+
+    // 本地存储操作，值为序列化后的JSON（写入前已校验）。
+    // ttl_ms 为 0 表示永不过期；值超过内存上限时返回 false
+    // 开启持久化时由存储在分段锁内追加日志，回复写入方之前用 afterDurable 等待落盘
+    bool setLocal(const string& key, string_view value, int64_t ttl_ms = 0) {
+        return cache.set(key, value, ttl_ms);
+    }
+
+    bool getLocal(const string& key, string& value) {
+        if (cache.get(key, value)) {
+            local_hits.add();
+            return true;
+        }
+        local_misses.add();
+        return false;
+    }
+
+    bool deleteLocal(const string& key) {
+        return cache.erase(key);
+    }
+
+    // 迁移来的key：本节点已有（视图变更后的新写入）或迁移期间删除过时不写入，值过大时返回 false
+    bool migrateLocal(const string& key, string_view value, int64_t ttl_ms) {
+        return cache.setIfAbsent(key, value, ttl_ms);
+    }
+
+    // 日志中没有单独的过期记录，存储按当前值和新的过期时间重新记一次写入
+    bool expireLocal(const string& key, int64_t ttl_ms) {
+        return cache.expire(key, ttl_ms);
+    }
+
+    // 开启 sync_writes 时，等此前的本地写入都落盘后再执行 done（在组提交线程中），否则直接执行。
+    // 日志写入失败过时 done 的参数为 false，写入方应报告失败。不阻塞调用线程，IO线程上回复写入也用它
+    void afterDurable(function<void(bool ok)> done) {
+        if (!persistence) {
+            done(true);
+            return;
+        }
+        persistence->whenDurable(move(done));
+    }
+
+    // 本地写入接口落盘后再回复，日志写入失败时改为返回 500
+    void replyAfterDurable(httplib::Response& res, httplib::Server::Done done) {
+        afterDurable([this, &res, done = move(done)](bool ok) {
+            if (!ok) {
+                setErrorResponse(res, 500, Config::JOURNAL_FAILED);
+            }
+            done();
+        });
+    }
+
+    shared_ptr<const Membership> currentMembership() const {
+        return atomic_load(&membership);
+    }
+
+    // 迁移期间key在旧视图中的所属节点；不在迁移中或所属节点未变时返回空串
+    string previousOwner(const string& key, const string& target_node) const {
+        auto previous = atomic_load(&previous_membership);
+        if (!previous) {
+            return "";
+        }
+        const string& owner = previous->ring.getNode(key);
+        return owner == target_node ? "" : owner;
+    }
+
+    // 获取当前节点地址
+    const string& getCurrentNode() const {
+        return current_node_url;
+    }
+
+    // HTTP响应辅助函数
+    static void setJsonResponse(httplib::Response& res, int status, const string& body) {
+        res.status = status;
+        res.set_header("Content-Type", "application/json; charset=utf-8");
+        res.body = body;
+    }
+
+    void setErrorResponse(httplib::Response& res, int status, const string& error) {
+        setJsonResponse(res, status, "{\"error\": \"" + error + "\"}");
+    }
+
+    void setSuccessResponse(httplib::Response& res, const string& body = "OK") {
+        setJsonResponse(res, 200, body);
+    }
+
+    // 读取请求头中的过期时间，转换为毫秒；没有该请求头时返回 0
+    static int64_t parseTtl(const httplib::Request& req) {
+        auto it = req.headers.find(Config::TTL_HEADER);
+        if (it == req.headers.end()) {
+            return 0;
+        }
+        // 整个值必须是一个有限的正数且不超过上限，拒绝 inf、nan、1e300、30abc 等
+        const string& text = it->second;
+        char* end = nullptr;
+        errno = 0;
+        double seconds = strtod(text.c_str(), &end);
+        if (text.empty() || end != text.c_str() + text.size() || errno == ERANGE ||
+            !isfinite(seconds) || !(seconds > 0) || seconds > Config::MAX_TTL_SECONDS) {
+            throw invalid_argument("invalid " + string(Config::TTL_HEADER));
+        }
+        return max<int64_t>(1, static_cast<int64_t>(seconds * 1000));
+    }
+
+    static string formatTtl(int64_t ttl_ms) {
+        char buffer[32];
+        snprintf(buffer, sizeof(buffer), "%.3f", ttl_ms / 1000.0);
+        return buffer;
+    }
+
+    // RPC客户端工厂方法
+    unique_ptr<httplib::Client> createRpcClient(const string& target_node) {
+        unique_ptr<httplib::Client> client(new httplib::Client(target_node));
+        client->set_connection_timeout(0, Config::RPC_CONNECT_TIMEOUT_MS * 1000);
+        client->set_read_timeout(Config::RPC_TIMEOUT_SECONDS, 0);
+        client->set_max_idle_connections(Config::RPC_MAX_IDLE_CONNECTIONS);
+        return client;
+    }
+
+    // 获取对端，第一次访问新成员时创建
+    Peer& getPeer(const string& target_node) {
+        {
+            shared_lock<shared_mutex> lock(peers_mutex);
+            auto it = peers.find(target_node);
+            if (it != peers.end()) {
+                return *it->second;
+            }
+        }
+        unique_lock<shared_mutex> lock(peers_mutex);
+        auto& peer = peers[target_node];
+        if (!peer) {
+            peer.reset(new Peer());
+            peer->http = createRpcClient(target_node);
+            if (options.rpc_port_offset > 0) {
+                peer->binary = createBinaryClient(target_node);
+            }
+        }
+        return *peer;
+    }
+
+    httplib::Client& getRpcClient(const string& target_node) {
+        return *getPeer(target_node).http;
+    }
+
+    // 从 http://host:port 中取出主机名，连接该节点的二进制RPC端口
+    unique_ptr<binrpc::Client> createBinaryClient(const string& target_node) {
+        size_t host_start = target_node.find("://");
+        host_start = host_start == string::npos ? 0 : host_start + 3;
+        size_t colon = target_node.rfind(':');
+        string host = target_node.substr(host_start, colon - host_start);
+        int http_port = stoi(target_node.substr(colon + 1));
+        unique_ptr<binrpc::Client> client(new binrpc::Client(host, http_port + options.rpc_port_offset));
+        client->set_connection_timeout(Config::RPC_CONNECT_TIMEOUT_MS);
+        client->set_read_timeout(Config::RPC_TIMEOUT_SECONDS * 1000);
+        return client;
+    }
+
+    // 通过二进制协议异步调用对端，收到响应后在 rpc_pool 中执行 on_reply。后续处理都不在二进制RPC的
+    // 读线程中执行，不会阻塞同一连接上其他请求的响应。
+    // 只有未启用二进制协议或连接没能建立（请求没有发出）时才在 http_pool 中执行 fallback（回退到HTTP）；
+    // 请求发出后超时或连接断开时对端可能已经执行过，不再重试，以 STATUS_ERROR 调用 on_reply
+    void binaryCallAsync(const string& target_node, binrpc::Op op, const string& body,
+                         function<void(uint8_t, string)> on_reply, function<void()> fallback, int budget_ms = 0) {
+        Peer& peer = getPeer(target_node);
+        if (!peer.binary) {
+            http_pool->enqueue(move(fallback));
+            return;
+        }
+        // 连接的读线程可能比本节点活得久，只持有线程池的引用；线程池停止后不再执行任何后续处理
+        auto pool = rpc_pool;
+        auto http = http_pool;
+        peer.binary->call_async(op, body, [pool, http, on_reply = move(on_reply), fallback = move(fallback)](
+                                              bool ok, uint8_t status, string response) {
+            if (ok) {
+                pool->enqueue([on_reply, status, response = move(response)]() mutable {
+                    on_reply(status, move(response));
+                });
+            } else if (status == binrpc::STATUS_UNREACHABLE) {
+                http->enqueue(fallback);
+            } else {
+                pool->enqueue([on_reply]() {
+                    on_reply(binrpc::STATUS_ERROR, string());
+                });
+            }
+        }, budget_ms);
+    }
+
+    // key的副本所在节点，第一个为主副本
+    vector<string> replicaNodes(const Membership& view, const string& key) const {
+        vector<string> result;
+        for (int index : view.ring.getNodeIndexes(key, options.replicas)) {
+            result.push_back(view.ring.nodeAt(index));
+        }
+        return result;
+    }
+
+    // 读请求的副本顺序：本节点是副本时优先本地读取，其余按正在进行的请求数从少到多
+    vector<string> readOrder(const Membership& view, const string& key) {
+        vector<string> replicas = replicaNodes(view, key);
+        vector<pair<int, string>> ranked;
+        for (auto& node : replicas) {
+            int load = node == getCurrentNode() ? -1 : getPeer(node).outstanding.load(memory_order_relaxed);
+            ranked.emplace_back(load, move(node));
+        }
+        stable_sort(ranked.begin(), ranked.end(),
+                    [](const pair<int, string>& a, const pair<int, string>& b) { return a.first < b.first; });
+        replicas.clear();
+        for (auto& item : ranked) {
+            replicas.push_back(move(item.second));
+        }
+        return replicas;
+    }
+
+    // 写入成功时，开启 sync_writes 的节点等日志落盘后再回复对端；日志写入失败过时回复 STATUS_ERROR
+    void replyWhenDurable(uint8_t& status, string& response, const binrpc::Server::Defer& defer) {
+        if (!persistence || status == binrpc::STATUS_NOT_FOUND || status == binrpc::STATUS_ERROR) {
+            return;
+        }
+        if (!options.sync_writes) {
+            if (!persistence->healthy()) {
+                status = binrpc::STATUS_ERROR;
+                response.clear();
+            }
+            return;
+        }
+        afterDurable([reply = defer(), status, response = move(response)](bool ok) mutable {
+            if (ok) {
+                reply(status, move(response));
+            } else {
+                reply(binrpc::STATUS_ERROR, string());
+            }
+        });
+    }
+
+    // 处理对端发来的二进制RPC请求，在RPC的IO线程上直接执行
+    void handleBinaryRequest(uint8_t op, string_view body, uint8_t& status, string& response,
+                             const binrpc::Server::Defer& defer) {
+        binrpc::Reader reader(body.data(), body.size());
+        string value;
+        switch (op) {
+            case binrpc::OP_GET:
+                status = getLocal(string(body), response) ? binrpc::STATUS_OK : binrpc::STATUS_NOT_FOUND;
+                return;
+            case binrpc::OP_DELETE:
+                status = deleteLocal(string(body)) ? binrpc::STATUS_OK : binrpc::STATUS_NOT_FOUND;
+                replyWhenDurable(status, response, defer);
+                return;
+            case binrpc::OP_SET:
+            case binrpc::OP_MIGRATE: {
+                // 值在入口节点已经校验并序列化，这里直接写入
+                bool migrate = op == binrpc::OP_MIGRATE;
+                int64_t ttl_ms = reader.i64();
+                uint32_t count = reader.u32();
+                uint32_t rejected = 0;
+                string failed;
+                for (uint32_t i = 0; i < count && reader.ok(); i++) {
+                    string key(reader.bytes());
+                    string_view data = reader.bytes();
+                    if (!reader.ok()) break;
+                    if (!(migrate ? migrateLocal(key, data, ttl_ms) : setLocal(key, data, ttl_ms))) {
+                        binrpc::put_bytes(failed, key);
+                        rejected++;
+                    }
+                }
+                if (!reader.ok()) {
+                    status = binrpc::STATUS_ERROR;
+                } else if (rejected > 0) {
+                    status = binrpc::STATUS_PARTIAL;
+                    binrpc::put_u32(response, rejected);
+                    response.append(failed);
+                } else {
+                    status = binrpc::STATUS_OK;
+                }
+                if (rejected < count) {
+                    replyWhenDurable(status, response, defer);
+                }
+                return;
+            }
+            case binrpc::OP_EXPIRE: {
+                int64_t ttl_ms = reader.i64();
+                if (!reader.ok()) {
+                    status = binrpc::STATUS_ERROR;
+                    return;
+                }
+                string key(body.substr(8));
+                status = expireLocal(key, ttl_ms) ? binrpc::STATUS_OK : binrpc::STATUS_NOT_FOUND;
+                replyWhenDurable(status, response, defer);
+                return;
+            }
+            case binrpc::OP_MGET: {
+                uint32_t count = reader.u32();
+                uint32_t found = 0;
+                string items;
+                for (uint32_t i = 0; i < count && reader.ok(); i++) {
+                    string key(reader.bytes());
+                    if (reader.ok() && getLocal(key, value)) {
+                        binrpc::put_bytes(items, key);
+                        binrpc::put_bytes(items, value);
+                        found++;
+                    }
+                }
+                status = reader.ok() ? binrpc::STATUS_OK : binrpc::STATUS_ERROR;
+                binrpc::put_u32(response, found);
+                response.append(items);
+                return;
+            }
+            default:
+                status = binrpc::STATUS_ERROR;
+                return;
+        }
+    }
+
+    // RESP前端的值按JSON字符串存储，HTTP接口读到的是同一个字符串；值不是合法UTF-8时抛出异常
+    static string toStoredValue(const string& value) {
+        return json(value).dump();
+    }
+
+    // 存储的是JSON字符串时返回其内容，其他JSON值（经HTTP写入的数字、对象等）原样返回
+    static string fromStoredValue(const string& stored) {
+        if (stored.size() < 2 || stored.front() != '"') {
+            return stored;
+        }
+        if (stored.find('\\') == string::npos) {
+            return stored.substr(1, stored.size() - 2);
+        }
+        try {
+            return json::parse(stored).get<string>();
+        } catch (const exception& e) {
+            return stored;
+        }
+    }
+
+    static bool parseRespInteger(const string& text, int64_t& value) {
+        auto result = from_chars(text.data(), text.data() + text.size(), value);
+        return result.ec == errc() && result.ptr == text.data() + text.size();
+    }
+
+    // 处理RESP前端的一条命令，与HTTP接口共用路由、转发和存储。在RESP的IO线程上调用，
+    // 只涉及本地数据时直接回复，需要转发时在RPC回调中回复
+    void handleRespCommand(vector<string>& args, resp::Server::Reply reply) {
+        string name = args[0];
+        transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return tolower(c); });
+        string out;
+        auto arity_error = [&]() {
+            resp::put_error(out, "wrong number of arguments for '" + name + "' command");
+            reply(move(out));
+        };
+
+        if (name == "get") {
+            if (args.size() != 2) return arity_error();
+            lookupKey(args[1], [reply](bool found, string value) {
+                string out;
+                if (found) {
+                    resp::put_bulk(out, fromStoredValue(value));
+                } else {
+                    resp::put_null(out);
+                }
+                reply(move(out));
+            });
+        } else if (name == "set" || name == "mset") {
+            bool single = name == "set";
+            if (single ? args.size() < 3 : args.size() < 3 || args.size() % 2 == 0) return arity_error();
+            int64_t ttl_ms = 0;
+            // SET key value [EX 秒 | PX 毫秒]
+            for (size_t i = 3; single && i < args.size(); i += 2) {
+                string option = args[i];
+                transform(option.begin(), option.end(), option.begin(), [](unsigned char c) { return tolower(c); });
+                int64_t amount;
+                if ((option != "ex" && option != "px") || i + 1 == args.size() || ttl_ms != 0) {
+                    resp::put_error(out, "syntax error");
+                    return reply(move(out));
+                }
+                if (!parseRespInteger(args[i + 1], amount)) {
+                    resp::put_error(out, "value is not an integer or out of range");
+                    return reply(move(out));
+                }
+                if (amount <= 0 || (option == "ex" && amount > INT64_MAX / 1000)) {
+                    resp::put_error(out, "invalid expire time in 'set' command");
+                    return reply(move(out));
+                }
+                ttl_ms = option == "ex" ? amount * 1000 : amount;
+            }
+            // MSET 中重复的key以最后一次为准
+            KeyValues items;
+            unordered_map<string, size_t> positions;
+            try {
+                for (size_t i = 1; i + 1 < args.size() && (!single || i == 1); i += 2) {
+                    string value = toStoredValue(args[i + 1]);
+                    auto it = positions.find(args[i]);
+                    if (it != positions.end()) {
+                        items[it->second].second = move(value);
+                    } else {
+                        positions[args[i]] = items.size();
+                        items.emplace_back(args[i], move(value));
+                    }
+                }
+            } catch (const exception& e) {
+                resp::put_error(out, "value must be valid UTF-8 (values are shared with the JSON API)");
+                return reply(move(out));
+            }
+            writeKeys(items, ttl_ms, [reply](KeyValues failed) {
+                string out;
+                if (failed.empty()) {
+                    resp::put_simple(out, "OK");
+                } else {
+                    resp::put_error(out, failed.front().first + ": " + failed.front().second);
+                }
+                reply(move(out));
+            });
+        } else if (name == "del") {
+            if (args.size() < 2) return arity_error();
+            auto deleted = make_shared<atomic<int64_t>>(0);
+            auto remaining = make_shared<atomic<size_t>>(args.size() - 1);
+            for (size_t i = 1; i < args.size(); ++i) {
+                deleteKey(args[i], [reply, deleted, remaining](bool existed) {
+                    if (existed) {
+                        deleted->fetch_add(1);
+                    }
+                    if (remaining->fetch_sub(1) == 1) {
+                        string out;
+                        resp::put_integer(out, deleted->load());
+                        reply(move(out));
+                    }
+                });
+            }
+        } else if (name == "mget") {
+            if (args.size() < 2) return arity_error();
+            // 各key并发查找（同一节点上的读取会被合并），全部返回后按顺序回复
+            struct MultiGet {
+                vector<pair<bool, string>> values;
+                atomic<size_t> remaining;
+            };
+            auto state = make_shared<MultiGet>();
+            state->values.resize(args.size() - 1);
+            state->remaining = args.size() - 1;
+            for (size_t i = 1; i < args.size(); ++i) {
+                lookupKey(args[i], [reply, state, i](bool found, string value) {
+                    state->values[i - 1] = {found, move(value)};
+                    if (state->remaining.fetch_sub(1) != 1) return;
+                    string out;
+                    resp::put_array(out, state->values.size());
+                    for (const auto& item : state->values) {
+                        if (item.first) {
+                            resp::put_bulk(out, fromStoredValue(item.second));
+                        } else {
+                            resp::put_null(out);
+                        }
+                    }
+                    reply(move(out));
+                });
+            }
+        } else if (name == "expire") {
+            if (args.size() != 3) return arity_error();
+            int64_t seconds;
+            if (!parseRespInteger(args[2], seconds) || seconds > INT64_MAX / 1000) {
+                resp::put_error(out, "value is not an integer or out of range");
+                return reply(move(out));
+            }
+            auto done = [reply](bool found) {
+                string out;
+                resp::put_integer(out, found ? 1 : 0);
+                reply(move(out));
+            };
+            // 与Redis一致，非正数的过期时间直接删除key
+            if (seconds <= 0) {
+                deleteKey(args[1], done);
+            } else {
+                expireKey(args[1], seconds * 1000, done);
+            }
+        } else if (name == "ping") {
+            if (args.size() > 2) return arity_error();
+            if (args.size() == 2) {
+                resp::put_bulk(out, args[1]);
+            } else {
+                resp::put_simple(out, "PONG");
+            }
+            reply(move(out));
+        } else {
+            resp::put_error(out, "unknown command '" + args[0] + "'");
+            reply(move(out));
+        }
+    }
+
+    // 把已序列化的值拼成 {"key":value}，不需要重新构建JSON树
+    static string wrapKeyValue(const string& key, const string& value) {
+        string escaped_key = json(key).dump();
+        string body;
+        body.reserve(escaped_key.size() + value.size() + 3);
+        body.append("{").append(escaped_key).append(":").append(value).append("}");
+        return body;
+    }
+
+    // key -> 序列化后的值
+    using KeyValues = vector<pair<string, string>>;
+
+    // 把 "key":value 追加到JSON对象的成员列表中
+    static void appendMember(string& members, const string& key, const string& value) {
+        if (!members.empty()) members.push_back(',');
+        members.append(json(key).dump()).append(":").append(value);
+    }
+
+    // 一次对端调用：记录耗时和失败次数（对端不可达或返回错误），读请求同时计入对端的在途请求数。
+    // finish 只生效一次，没有调用就销毁的计为失败。
+    // 发往同一对端的在途调用超过 limit（0 表示不限制）或到了调用方的截止时刻时，shed() 返回 true，
+    // 调用方应直接以失败结束，不再发出请求。回退到HTTP的调用仍占着在途名额，另外同时最多 fallback_limit 个
+    struct RpcCall {
+        Peer& peer;
+        RpcStats& stats;
+        bool track_outstanding;
+        bool admitted;
+        Deadline deadline;
+        size_t fallback_limit;
+        bool in_fallback = false;
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        atomic<bool> finished{false};
+
+        RpcCall(Peer& peer, binrpc::Op op, bool track_outstanding = false, size_t limit = 0,
+                Deadline deadline = NO_DEADLINE, size_t fallback_limit = 0)
+            : peer(peer), stats(peer.rpc[op - 1]), track_outstanding(track_outstanding), deadline(deadline),
+              fallback_limit(fallback_limit) {
+            size_t in_flight = peer.in_flight.fetch_add(1, memory_order_relaxed);
+            admitted = limit == 0 || in_flight < limit;
+            if (track_outstanding) {
+                peer.outstanding.fetch_add(1, memory_order_relaxed);
+            }
+        }
+
+        ~RpcCall() {
+            finish(false);
+        }
+
+        void finish(bool ok) {
+            if (finished.exchange(true)) return;
+            stats.latency.record(static_cast<uint64_t>(
+                chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count()));
+            if (!ok) {
+                stats.errors.add();
+            }
+            release();
+        }
+
+        // 在发出请求（包括回退到HTTP）之前检查，返回 true 时调用已结束，只计入 shed
+        bool shed() {
+            if (admitted && chrono::steady_clock::now() < deadline) return false;
+            if (!finished.exchange(true)) {
+                stats.shed.add();
+                release();
+            }
+            return true;
+        }
+
+        // 回退到HTTP之前代替 shed() 检查：阻塞的HTTP调用一直占用 http_pool 的线程直到对端响应，
+        // 同一对端的回退调用超过 fallback_limit（0 表示不限制）时按对端过载处理，慢的对端占不满 http_pool
+        bool shedFallback() {
+            if (finished.load()) return true;
+            size_t running = peer.fallbacks.fetch_add(1, memory_order_relaxed);
+            in_fallback = true;
+            if (fallback_limit > 0 && running >= fallback_limit) {
+                admitted = false;
+            }
+            return shed();
+        }
+
+        // shed() 之后向调用方报告的原因
+        const char* shedReason() const {
+            return admitted ? Config::DEADLINE_EXCEEDED : Config::PEER_OVERLOADED;
+        }
+
+        // 剩余的时间预算（毫秒，至少为1），没有截止时刻时为 0。也用作回退的HTTP调用的超时
+        int budgetMs() const {
+            if (deadline == NO_DEADLINE) return 0;
+            auto remaining = chrono::duration_cast<chrono::milliseconds>(deadline - chrono::steady_clock::now()).count();
+            return static_cast<int>(max<int64_t>(1, min<int64_t>(remaining, INT32_MAX)));
+        }
+
+        // 转发给对端HTTP接口时带上剩余预算
+        void addBudgetHeader(httplib::Headers& headers) const {
+            int budget = budgetMs();
+            if (budget > 0) {
+                headers[Config::TIMEOUT_HEADER] = to_string(budget);
+            }
+        }
+
+    private:
+        void release() {
+            peer.in_flight.fetch_sub(1, memory_order_relaxed);
+            if (in_fallback) {
+                peer.fallbacks.fetch_sub(1, memory_order_relaxed);
+            }
+            if (track_outstanding) {
+                peer.outstanding.fetch_sub(1, memory_order_relaxed);
+            }
+        }
+    };
+
+    // 发往该对端的在途调用已达上限
+    bool peerSaturated(const string& target_node) {
+        return options.peer_concurrency > 0 &&
+               getPeer(target_node).in_flight.load(memory_order_relaxed) >= options.peer_concurrency;
+    }
+
+    shared_ptr<RpcCall> startCall(const string& target_node, binrpc::Op op, Deadline deadline,
+                                  bool track_outstanding = false) {
+        // 每个对端的HTTP回退最多占用 http_pool 一半的线程
+        size_t fallback_limit = max<size_t>(1, static_cast<size_t>(options.worker_threads) / 2);
+        if (options.peer_concurrency > 0) fallback_limit = min(fallback_limit, options.peer_concurrency);
+        return make_shared<RpcCall>(getPeer(target_node), op, track_outstanding, options.peer_concurrency, deadline,
+                                    fallback_limit);
+    }
+
+    using SetCallback = function<void(KeyValues failed)>;
+    using DeleteCallback = function<void(int deleted)>;
+
+    // 内部RPC调用都是异步的，对端返回的就是存储的序列化值，原样透传。
+    // 回调在 rpc_pool 中执行；二进制协议未启用或连接不上时在 http_pool 中回退到HTTP
+    // 超出并发上限或时间预算时不发出请求，按没有读到处理（回调在当前线程中执行）
+    void rpcGetAsync(const string& target_node, const string& key, GetCallback callback, Deadline deadline = NO_DEADLINE) {
+        auto call = startCall(target_node, binrpc::OP_GET, deadline, true);
+        if (call->shed()) {
+            callback(false, string());
+            return;
+        }
+        binaryCallAsync(target_node, binrpc::OP_GET, key,
+            [call, callback](uint8_t status, string response) {
+                call->finish(status == binrpc::STATUS_OK || status == binrpc::STATUS_NOT_FOUND);
+                callback(status == binrpc::STATUS_OK, move(response));
+            },
+            [this, call, target_node, key, callback]() {
+                if (call->shedFallback()) {
+                    callback(false, string());
+                    return;
+                }
+                httplib::Headers headers;
+                call->addBudgetHeader(headers);
+                auto res = getRpcClient(target_node).Get("/internal/get/" + key, headers, call->budgetMs());
+                call->finish(res && (res->status == 200 || res->status == 404));
+                if (res && res->status == 200) {
+                    callback(true, move(res->body));
+                } else {
+                    callback(false, string());
+                }
+            },
+            call->budgetMs());
+    }
+
+    // 一次RPC批量写入多个key，回调参数为写入失败的key及原因（对端不可达时为全部key）。
+    // op 为 OP_MIGRATE 时对端只写入它还没有的key
+    void rpcSetBatchAsync(const string& target_node, KeyValues items, int64_t ttl_ms, SetCallback callback,
+                          Deadline deadline = NO_DEADLINE, binrpc::Op op = binrpc::OP_SET) {
+        auto call = startCall(target_node, op, deadline);
+        if (call->shed()) {
+            for (auto& item : items) {
+                item.second = call->shedReason();
+            }
+            callback(move(items));
+            return;
+        }
+        string request;
+        binrpc::put_i64(request, ttl_ms);
+        binrpc::put_u32(request, static_cast<uint32_t>(items.size()));
+        for (const auto& item : items) {
+            binrpc::put_bytes(request, item.first);
+            binrpc::put_bytes(request, item.second);
+        }
+        auto shared_items = make_shared<const KeyValues>(move(items));
+        auto http = [this, call, target_node, shared_items, ttl_ms, callback, op]() {
+            if (call->shedFallback()) {
+                KeyValues failed;
+                for (const auto& item : *shared_items) {
+                    failed.emplace_back(item.first, call->shedReason());
+                }
+                callback(move(failed));
+                return;
+            }
+            callback(httpSetBatch(*call, target_node, *shared_items, ttl_ms,
+                                  op == binrpc::OP_MIGRATE ? "/internal/migrate" : "/internal/set"));
+        };
+        binaryCallAsync(target_node, op, request,
+            [call, callback, target_node, shared_items](uint8_t status, string response) {
+                KeyValues failed;
+                if (status == binrpc::STATUS_PARTIAL) {
+                    // 对端只拒绝了其中部分key
+                    binrpc::Reader reader(response.data(), response.size());
+                    uint32_t count = reader.u32();
+                    for (uint32_t i = 0; i < count && reader.ok(); i++) {
+                        failed.emplace_back(string(reader.bytes()), Config::VALUE_TOO_LARGE);
+                    }
+                    call->finish(true);
+                    callback(move(failed));
+                } else if (status == binrpc::STATUS_OK) {
+                    call->finish(true);
+                    callback(move(failed));
+                } else {
+                    // 对端出错、超时或连接断开：写入结果未知，不再重试，整批按失败报告
+                    call->finish(false);
+                    string reason = status == binrpc::STATUS_EXPIRED || chrono::steady_clock::now() >= call->deadline
+                                    ? Config::DEADLINE_EXCEEDED : "Write to " + target_node + " failed";
+                    for (const auto& item : *shared_items) {
+                        failed.emplace_back(item.first, reason);
+                    }
+                    callback(move(failed));
+                }
+            },
+            http, call->budgetMs());
+    }
+
+    // 迁移用的同步版本（OP_MIGRATE），供后台迁移线程使用（不能在 rpc_pool 中调用）
+    KeyValues rpcMigrateBatch(const string& target_node, const KeyValues& items, int64_t ttl_ms = 0) {
+        promise<KeyValues> result;
+        rpcSetBatchAsync(target_node, items, ttl_ms, [&result](KeyValues failed) {
+            result.set_value(move(failed));
+        }, NO_DEADLINE, binrpc::OP_MIGRATE);
+        return result.get_future().get();
+    }
+
+    KeyValues httpSetBatch(RpcCall& call, const string& target_node, const KeyValues& items, int64_t ttl_ms,
+                           const string& path) {
+        KeyValues failed;
+        auto& client = getRpcClient(target_node);
+        httplib::Headers headers;
+        if (ttl_ms > 0) {
+            headers[Config::TTL_HEADER] = formatTtl(ttl_ms);
+        }
+        call.addBudgetHeader(headers);
+        string members;
+        for (const auto& item : items) {
+            appendMember(members, item.first, item.second);
+        }
+        auto res = client.Post(path, headers, "{" + members + "}", "application/json", call.budgetMs());
+
+        if (res && res->status == 200) {
+            call.finish(true);
+            return failed;
+        }
+        if (res && res->status == 413) {
+            // 对端只拒绝了其中部分key
+            call.finish(true);
+            try {
+                json error = json::parse(res->body);
+                for (const auto& key : error.at("failed")) {
+                    failed.emplace_back(key.get<string>(), Config::VALUE_TOO_LARGE);
+                }
+                return failed;
+            } catch (const exception& e) {
+                failed.clear();
+            }
+        }
+        for (const auto& item : items) {
+            failed.emplace_back(item.first, "Write to " + target_node + " failed");
+        }
+        return failed;
+    }
+
+    void rpcDeleteAsync(const string& target_node, const string& key, DeleteCallback callback,
+                        Deadline deadline = NO_DEADLINE) {
+        auto call = startCall(target_node, binrpc::OP_DELETE, deadline);
+        if (call->shed()) {
+            callback(0);
+            return;
+        }
+        binaryCallAsync(target_node, binrpc::OP_DELETE, key,
+            [call, callback](uint8_t status, string) {
+                call->finish(status == binrpc::STATUS_OK || status == binrpc::STATUS_NOT_FOUND);
+                callback(status == binrpc::STATUS_OK ? 1 : 0);
+            },
+            [this, call, target_node, key, callback]() {
+                if (call->shedFallback()) {
+                    callback(0);
+                    return;
+                }
+                httplib::Headers headers;
+                call->addBudgetHeader(headers);
+                auto res = getRpcClient(target_node).Delete("/internal/delete/" + key, headers, call->budgetMs());
+                int deleted = 0;
+                if (res && res->status == 200) {
+                    call->finish(true);
+                    try {
+                        deleted = stoi(res->body);
+                    } catch (const exception& e) {
+                        // 响应解析失败，返回0
+                    }
+                }
+                callback(deleted);
+            },
+            call->budgetMs());
+    }
+
+    void rpcExpireAsync(const string& target_node, const string& key, int64_t ttl_ms, function<void(bool)> callback,
+                        Deadline deadline = NO_DEADLINE) {
+        auto call = startCall(target_node, binrpc::OP_EXPIRE, deadline);
+        if (call->shed()) {
+            callback(false);
+            return;
+        }
+        string request;
+        binrpc::put_i64(request, ttl_ms);
+        request.append(key);
+        binaryCallAsync(target_node, binrpc::OP_EXPIRE, request,
+            [call, callback](uint8_t status, string) {
+                call->finish(status != binrpc::STATUS_ERROR && status != binrpc::STATUS_EXPIRED);
+                callback(status == binrpc::STATUS_OK);
+            },
+            [this, call, target_node, key, ttl_ms, callback]() {
+                if (call->shedFallback()) {
+                    callback(false);
+                    return;
+                }
+                httplib::Headers headers;
+                if (ttl_ms > 0) {
+                    headers[Config::TTL_HEADER] = formatTtl(ttl_ms);
+                }
+                call->addBudgetHeader(headers);
+                auto res = getRpcClient(target_node).Post("/internal/expire/" + key, headers, "", "application/json",
+                                                         call->budgetMs());
+                call->finish(res && res->status == 200);
+                callback(res && res->status == 200 && res->body == "1");
+            },
+            call->budgetMs());
+    }
+
+    // 经本节点写入或删除的key从近端缓存中移除，正在进行的远程读也不再接受新的等待者
+    void invalidateCachedReads(const string& key) {
+        if (near_cache) {
+            near_cache->erase(key);
+        }
+        ReadFlightShard& shard = readFlightShard(key);
+        lock_guard<mutex> guard(shard.lock);
+        shard.flights.erase(key);
+    }
+
+    ReadFlightShard& readFlightShard(const string& key) {
+        return read_flights[hash<string>()(key) % READ_FLIGHT_SHARDS];
+    }
+
+    // 本地或通过RPC读取指定节点上的key；本地读取时回调在当前线程中直接执行
+    void readFromAsync(const string& node, const string& key, GetCallback callback, Deadline deadline = NO_DEADLINE) {
+        if (node == getCurrentNode()) {
+            string value;
+            bool found = getLocal(key, value);
+            callback(found, move(value));
+            return;
+        }
+
+        ReadFlightShard& shard = readFlightShard(key);
+        auto flight = make_shared<ReadFlight>();
+        {
+            lock_guard<mutex> guard(shard.lock);
+            auto it = shard.flights.find(key);
+            bool same_node = it != shard.flights.end() && it->second->node == node;
+            if (same_node && it->second->deadline >= deadline) {
+                it->second->waiters.push_back(move(callback));
+                read_flights_joined.add();
+                return;
+            }
+            flight->node = node;
+            flight->deadline = deadline;
+            flight->waiters.push_back(move(callback));
+            // 同一节点上截止时间更早的读取由新的读取取代，之后的读取合并到新的上面；
+            // 同一key正在从其他节点（迁移前的所属节点）读取时不合并，也不替换它
+            if (it == shard.flights.end()) {
+                shard.flights.emplace(key, flight);
+            } else if (same_node) {
+                it->second = flight;
+            }
+        }
+        read_flights_started.add();
+
+        rpcGetAsync(node, key, [this, key, flight](bool found, string value) {
+            vector<GetCallback> waiters;
+            {
+                ReadFlightShard& shard = readFlightShard(key);
+                lock_guard<mutex> guard(shard.lock);
+                auto it = shard.flights.find(key);
+                if (it != shard.flights.end() && it->second == flight) {
+                    shard.flights.erase(it);
+                }
+                waiters.swap(flight->waiters);
+            }
+            for (size_t i = 0; i + 1 < waiters.size(); ++i) {
+                waiters[i](found, value);
+            }
+            waiters.back()(found, move(value));
+        }, deadline);
+    }
+
+    void expireOnAsync(const string& node, const string& key, int64_t ttl_ms, function<void(bool)> callback,
+                       Deadline deadline = NO_DEADLINE) {
+        if (node == getCurrentNode()) {
+            if (!expireLocal(key, ttl_ms)) {
+                callback(false);
+                return;
+            }
+            afterDurable(move(callback));
+            return;
+        }
+        rpcExpireAsync(node, key, ttl_ms, move(callback), deadline);
+    }
+
+    void deleteFromAsync(const string& node, const string& key, DeleteCallback callback, Deadline deadline = NO_DEADLINE) {
+        if (node == getCurrentNode()) {
+            if (!deleteLocal(key)) {
+                callback(0);
+                return;
+            }
+            afterDurable([callback = move(callback)](bool ok) { callback(ok ? 1 : 0); });
+            return;
+        }
+        rpcDeleteAsync(node, key, move(callback), deadline);
+    }
+
+    static json membershipJson(uint64_t version, const vector<string>& nodes) {
+        json body;
+        body["version"] = version;
+        body["nodes"] = nodes;
+        return body;
+    }
+
+    static json membershipJson(const Membership& view) {
+        return membershipJson(view.version, view.nodes);
+    }
+
+    // 应用新的成员视图（版本号更大才生效），旧视图保留给迁移期间的读回退，并唤醒后台迁移。
+    // 迁移期间本地删除的key留下墓碑，其他节点迁移来的旧值不会让它们复活。
+    // 调用方需持有 membership_mutex
+    bool applyMembershipLocked(uint64_t version, const vector<string>& nodes) {
+        auto current = currentMembership();
+        if (version <= current->version) {
+            return false;
+        }
+        cache.recordDeletes(true);
+        atomic_store(&previous_membership, current);
+        atomic_store(&membership, make_shared<const Membership>(version, nodes, options.hash_mode));
+        {
+            lock_guard<mutex> lock(migration_mutex);
+            migration_pending = true;
+            // 迁移线程可能在上面两次之间按旧视图结束了宽限期并关闭了记录
+            cache.recordDeletes(true);
+        }
+        migration_cv.notify_all();
+        cout << "集群成员变更: 版本 " << version << "，共 " << nodes.size() << " 个节点" << endl;
+        return true;
+    }
+
+    bool applyMembership(uint64_t version, const vector<string>& nodes) {
+        lock_guard<mutex> lock(membership_mutex);
+        return applyMembershipLocked(version, nodes);
+    }
+
+    // 在当前视图上加入或移除一个节点：本地生效后立即返回新视图，由后台迁移线程把它广播给新旧视图中的所有节点。
+    // 变更由收到请求的节点发起，并发的变更请求应发往同一个节点
+    json changeMembership(const string& node, bool join) {
+        lock_guard<mutex> lock(membership_mutex);
+        auto current = currentMembership();
+        vector<string> nodes = current->nodes;
+        auto it = find(nodes.begin(), nodes.end(), node);
+        if (join == (it != nodes.end())) {
+            return membershipJson(*current);
+        }
+        if (join) {
+            nodes.push_back(node);
+        } else {
+            nodes.erase(it);
+        }
+        json body = membershipJson(current->version + 1, nodes);
+        {
+            // 先登记广播再让新视图生效，迁移线程被唤醒后一定先广播再迁移；否则其他节点还在用旧视图时
+            // 就开始迁移，它们随后写到旧所属节点的新值不会再被迁走。更新的视图覆盖尚未发出的旧视图
+            lock_guard<mutex> broadcast_lock(migration_mutex);
+            broadcast_view = body.dump();
+            broadcast_targets.insert(current->nodes.begin(), current->nodes.end());
+            broadcast_targets.insert(node);
+            broadcast_targets.erase(getCurrentNode());
+        }
+        applyMembershipLocked(current->version + 1, nodes);
+        return body;
+    }
+
+    // 在迁移线程中把本节点发起的视图发给各节点，返回是否都已送达；没送达的留到下次重试，
+    // 期间又有新的变更时只需发送新的视图
+    bool broadcastMembership() {
+        string payload;
+        unordered_set<string> targets;
+        {
+            lock_guard<mutex> lock(migration_mutex);
+            if (broadcast_targets.empty()) return true;
+            payload = broadcast_view;
+            targets.swap(broadcast_targets);
+        }
+        unordered_set<string> failed;
+        for (const auto& target : targets) {
+            auto res = getRpcClient(target).Post("/internal/membership", payload, "application/json");
+            if (!res || res->status != 200) {
+                cerr << "向 " << target << " 同步成员视图失败" << endl;
+                failed.insert(target);
+            }
+        }
+        // 已移出视图的节点送不到就算了，它不会再收到读写
+        auto view = currentMembership();
+        lock_guard<mutex> lock(migration_mutex);
+        for (const auto& target : failed) {
+            if (find(view->nodes.begin(), view->nodes.end(), target) != view->nodes.end()) {
+                broadcast_targets.insert(target);
+            }
+        }
+        return broadcast_targets.empty();
+    }
+
+    // 启动后向种子节点申请加入集群，种子节点可能还没启动，失败时重试
+    void joinCluster(const atomic<bool>& running) {
+        httplib::Client seed(options.join_url);
+        seed.set_connection_timeout(0, Config::RPC_CONNECT_TIMEOUT_MS * 1000);
+        json request;
+        request["node"] = getCurrentNode();
+        while (running) {
+            auto res = seed.Post("/cluster/join", request.dump(), "application/json");
+            if (res && res->status == 200) {
+                try {
+                    json body = json::parse(res->body);
+                    applyMembership(body.at("version").get<uint64_t>(), body.at("nodes").get<vector<string>>());
+                    cout << "已加入集群: " << options.join_url << endl;
+                    return;
+                } catch (const exception& e) {
+                    cerr << "加入集群的响应无效: " << e.what() << endl;
+                }
+            }
+            this_thread::sleep_for(chrono::milliseconds(Config::MIGRATION_RETRY_MS));
+        }
+    }
+
+    // 把一批key写到新的副本节点，写入失败（对端不可达）的key记入 failed；对端拒绝（值过大）的key不再重试。
+    // 对端已有的key（视图变更后写入的更新的值）和迁移期间在对端删除过的key不会被覆盖
+    bool migrateBatch(const string& target_node, const KeyValues& items, int64_t ttl_ms, unordered_set<string>& failed) {
+        bool ok = true;
+        for (const auto& item : rpcMigrateBatch(target_node, items, ttl_ms)) {
+            if (item.second != Config::VALUE_TOO_LARGE) {
+                failed.insert(item.first);
+                ok = false;
+            }
+        }
+        return ok;
+    }
+
+    // 遍历本地存储，把key复制到新加入其副本集的节点，不再属于本节点的key在复制成功后删除。
+    // 按分段取key快照，不长时间持锁；按 migration_rate 限速。
+    // 视图再次变化时返回 false，由调用方按新视图重新开始；complete 表示是否所有key都已处理
+    bool migrateKeys(const shared_ptr<const Membership>& view, const atomic<bool>& running, bool& complete) {
+        auto previous = atomic_load(&previous_membership);
+        auto started = chrono::steady_clock::now();
+        size_t moved = 0;
+        complete = true;
+        auto throttle = [&](size_t count) {
+            moved += count;
+            if (options.migration_rate <= 0) return;
+            auto due = started + chrono::microseconds(moved * 1000000 / options.migration_rate);
+            this_thread::sleep_until(due);
+        };
+
+        for (size_t shard = 0; shard < cache.shardCount(); shard++) {
+            map<string, KeyValues> batches;
+            unordered_set<string> failed;
+            vector<string> leaving;
+            for (const auto& key : cache.keys(shard)) {
+                vector<string> replicas = replicaNodes(*view, key);
+                if (replicas.empty()) continue;
+                bool keep = find(replicas.begin(), replicas.end(), getCurrentNode()) != replicas.end();
+                // 本节点原本就是副本时，旧副本集中的其他节点也已经有这个key，只需复制给新增的副本
+                vector<string> old_replicas;
+                if (previous) {
+                    old_replicas = replicaNodes(*previous, key);
+                    if (find(old_replicas.begin(), old_replicas.end(), getCurrentNode()) == old_replicas.end()) {
+                        old_replicas.clear();
+                    }
+                }
+                vector<string> targets;
+                for (const auto& node : replicas) {
+                    if (node != getCurrentNode() && find(old_replicas.begin(), old_replicas.end(), node) == old_replicas.end()) {
+                        targets.push_back(node);
+                    }
+                }
+                if (!keep) {
+                    leaving.push_back(key);
+                }
+                if (targets.empty()) continue;
+
+                string value;
+                int64_t ttl_ms;
+                if (!cache.get(key, value, ttl_ms)) continue;
+                for (const auto& node : targets) {
+                    if (ttl_ms > 0) {
+                        // 带过期时间的key逐个迁移，保留剩余存活时间
+                        complete = migrateBatch(node, {{key, value}}, ttl_ms, failed) && complete;
+                        throttle(1);
+                        continue;
+                    }
+                    KeyValues& batch = batches[node];
+                    batch.emplace_back(key, value);
+                    if (batch.size() >= Config::MIGRATION_BATCH) {
+                        complete = migrateBatch(node, batch, 0, failed) && complete;
+                        throttle(batch.size());
+                        batch.clear();
+                    }
+                }
+                if (!running || currentMembership() != view) {
+                    return false;
+                }
+            }
+            for (const auto& batch : batches) {
+                if (batch.second.empty()) continue;
+                complete = migrateBatch(batch.first, batch.second, 0, failed) && complete;
+                throttle(batch.second.size());
+            }
+            // 所有新副本都写成功后才删除本地副本；这不是客户端的删除，不留墓碑
+            for (const auto& key : leaving) {
+                if (!failed.count(key)) {
+                    cache.erase(key, false);
+                }
+            }
+        }
+        if (moved > 0) {
+            cout << "数据迁移完成: 复制 " << moved << " 个key" << endl;
+        }
+        return true;
+    }
+
+    // 后台迁移线程：成员变化后迁出不再属于本节点的key。
+    // 迁移完成后旧视图再保留一段时间，让其他节点上仍在迁移的key可以从旧的所属节点读到
+    void migrationLoop(const atomic<bool>& running) {
+        unique_lock<mutex> lock(migration_mutex);
+        while (running) {
+            migration_cv.wait(lock, [&]() { return migration_pending || !running; });
+            if (!running) break;
+            migration_pending = false;
+            lock.unlock();
+
+            // 先广播新视图，其他节点才会把这些key的读写发给新的副本
+            bool delivered = broadcastMembership();
+            auto view = currentMembership();
+            bool complete = false;
+            bool finished = migrateKeys(view, running, complete);
+
+            lock.lock();
+            if (!finished) continue;
+            if (!complete || !delivered) {
+                // 部分对端不可达，稍后重试
+                migration_cv.wait_for(lock, chrono::milliseconds(Config::MIGRATION_RETRY_MS),
+                                      [&]() { return migration_pending || !running; });
+                migration_pending = true;
+                continue;
+            }
+            bool changed = migration_cv.wait_for(lock, chrono::seconds(Config::MIGRATION_GRACE_SECONDS),
+                                                 [&]() { return migration_pending || !running; });
+            if (!changed && currentMembership() == view) {
+                atomic_store(&previous_membership, shared_ptr<const Membership>());
+                cache.recordDeletes(false);
+            }
+        }
+    }
+
+    // 一次写入的汇总：每个key写成功的副本数、失败原因，以及尚未返回的对端数
+    struct WriteState {
+        mutex lock;
+        vector<pair<string, size_t>> required;  // key -> 需要的成功副本数
+        unordered_map<string, size_t> acks;
+        unordered_map<string, string> reasons;
+        atomic<size_t> remaining{0};
+        SetCallback callback;
+    };
+
+    // 多数副本写成功（异步写模式下为主副本）才算成功，否则按写入顺序逐个key报告失败原因
+    static void finishWrite(WriteState& write) {
+        KeyValues failed;
+        {
+            lock_guard<mutex> guard(write.lock);
+            for (const auto& item : write.required) {
+                if (write.acks[item.first] < item.second) {
+                    failed.emplace_back(item.first, write.reasons[item.first]);
+                }
+            }
+        }
+        write.callback(move(failed));
+    }
+
+    // 一次读取：按顺序尝试的节点（副本在前，最后可能是迁移前的所属节点）
+    struct ReadLookup {
+        string key;
+        vector<string> nodes;
+        size_t replicas = 0;   // nodes 中副本的个数
+        bool remote = false;   // 本节点不是副本，读到的值可以放进近端缓存
+        Deadline deadline = NO_DEADLINE;
+        bool skipped = false;  // 有节点因并发已满被跳过
+        GetCallback callback;
+        function<void()> on_unavailable;
+    };
+
+    // 从第 index 个节点读取，没有时继续下一个
+    // 并发已满的对端直接跳过，改读下一个副本；最后都没读到时不能断定key不存在，交给 on_unavailable
+    void readNext(shared_ptr<ReadLookup> lookup, size_t index) {
+        if (index == lookup->nodes.size()) {
+            if (lookup->skipped && lookup->on_unavailable) {
+                lookup->on_unavailable();
+            } else {
+                lookup->callback(false, string());
+            }
+            return;
+        }
+        const string& node = lookup->nodes[index];
+        if (node != getCurrentNode() && peerSaturated(node)) {
+            lookup->skipped = true;
+            readNext(lookup, index + 1);
+            return;
+        }
+        readFromAsync(lookup->nodes[index], lookup->key, [this, lookup, index](bool found, string value) {
+            if (!found) {
+                readNext(lookup, index + 1);
+                return;
+            }
+            if (index < lookup->replicas && lookup->remote &&
+                access_sketch.increment(lookup->key) >= options.hot_key_threshold) {
+                near_cache->set(lookup->key, value, options.near_cache_ttl_ms);
+            }
+            lookup->callback(true, move(value));
+        }, lookup->deadline);
+    }
+
+    // 删除和修改过期时间要作用于key的所有副本；迁移期间旧的所属节点上也要执行，否则迁移会把旧数据写回
+    vector<string> keyHolders(const Membership& view, const string& key) const {
+        vector<string> nodes = replicaNodes(view, key);
+        string previous_node = previousOwner(key, view.ring.getNode(key));
+        if (!previous_node.empty()) {
+            nodes.push_back(previous_node);
+        }
+        return nodes;
+    }
+
+    // 在每个节点上执行 op，全部返回后回调，参数为是否有任一节点返回 true
+    void forEachHolder(const vector<string>& nodes, function<void(const string&, function<void(bool)>)> op,
+                       function<void(bool)> callback) {
+        struct State {
+            atomic<bool> any{false};
+            atomic<size_t> remaining;
+            function<void(bool)> callback;
+        };
+        auto state = make_shared<State>();
+        state->remaining = nodes.size();
+        state->callback = move(callback);
+        for (const auto& node : nodes) {
+            op(node, [state](bool result) {
+                if (result) {
+                    state->any = true;
+                }
+                if (state->remaining.fetch_sub(1) == 1) {
+                    state->callback(state->any.load());
+                }
+            });
+        }
+    }
+
+    // 以下是HTTP接口和RESP前端共用的key操作，回调可能在当前线程中直接执行（只涉及本地数据时），
+    // 也可能稍后在 rpc_pool 或 http_pool 中执行
+
+    // 每核模式下每个核独占一部分存储分段：在key所属的核上执行 task，其他核上收到的请求经无锁队列转交过去。
+    // 未启用时直接执行
+    void onKeyCore(const string& key, function<void()> task) {
+        httplib::Server* server = http_server.load();
+        if (options.cores == 0 || server == nullptr) {
+            task();
+            return;
+        }
+        size_t core = cache.partitionOf(key, options.cores);
+        if (server->current_core() == static_cast<int>(core)) {
+            task();
+        } else {
+            server->run_on(core, move(task));
+        }
+    }
+
+    // 依次读近端缓存、各副本（本地副本优先，其余按负载排序）、迁移前的所属节点
+    // on_unavailable 不为空时，因对端并发已满而没有读到的情况调用它，而不是报告key不存在
+    void lookupKey(const string& key, GetCallback callback, Deadline deadline = NO_DEADLINE,
+                   function<void()> on_unavailable = nullptr) {
+        auto view = currentMembership();
+        auto lookup = make_shared<ReadLookup>();
+        lookup->key = key;
+        lookup->deadline = deadline;
+        lookup->on_unavailable = move(on_unavailable);
+        lookup->callback = move(callback);
+        lookup->nodes = readOrder(*view, key);
+        if (lookup->nodes.empty()) {
+            // 还没有成员视图（如 --join 后尚未收到视图）时无处可读，不能断定key不存在
+            if (lookup->on_unavailable) {
+                lookup->on_unavailable();
+            } else {
+                lookup->callback(false, string());
+            }
+            return;
+        }
+        lookup->replicas = lookup->nodes.size();
+        lookup->remote = near_cache && lookup->nodes.front() != getCurrentNode();
+        if (lookup->remote) {
+            string value;
+            if (near_cache->get(key, value)) {
+                near_cache_hits.add();
+                lookup->callback(true, move(value));
+                return;
+            }
+            near_cache_misses.add();
+        }
+        // 迁移期间数据可能还在旧的所属节点上，副本都没有时再读旧的所属节点
+        string previous_node = previousOwner(key, view->ring.getNode(key));
+        if (!previous_node.empty()) {
+            lookup->nodes.push_back(previous_node);
+        }
+        readNext(lookup, 0);
+    }
+
+    // 写入多个key（值已序列化）的所有副本。按目标节点分组：本地的key直接写入，每个对端节点一次批量RPC，
+    // 各对端并发发出，最后一个返回的负责回调。异步写模式下非主副本在后台写入，不等待结果
+    void writeKeys(const KeyValues& items, int64_t ttl_ms, SetCallback callback, Deadline deadline = NO_DEADLINE) {
+        auto view = currentMembership();
+        auto write = make_shared<WriteState>();
+        write->callback = move(callback);
+        KeyValues local_items;
+        map<string, KeyValues> remote_groups;
+        map<string, KeyValues> background_groups;
+        for (const auto& item : items) {
+            const string& key = item.first;
+            invalidateCachedReads(key);
+            vector<string> replicas = replicaNodes(*view, key);
+            write->required.emplace_back(key, options.quorum_writes ? replicas.size() / 2 + 1 : 1);
+            for (size_t i = 0; i < replicas.size(); i++) {
+                if (replicas[i] == getCurrentNode()) {
+                    local_items.push_back(item);
+                } else if (!options.quorum_writes && i > 0) {
+                    background_groups[replicas[i]].push_back(item);
+                } else {
+                    remote_groups[replicas[i]].push_back(item);
+                }
+            }
+        }
+
+        for (auto& group : background_groups) {
+            rpcSetBatchAsync(group.first, move(group.second), ttl_ms, [](KeyValues) {});
+        }
+
+        vector<string> local_written;
+        for (const auto& item : local_items) {
+            if (setLocal(item.first, item.second, ttl_ms)) {
+                local_written.push_back(item.first);
+            } else {
+                write->reasons[item.first] = Config::VALUE_TOO_LARGE;
+            }
+        }
+        // 本地写入等落盘后才计入成功的副本，并算作一组返回
+        auto local_durable = [write, local_written](bool ok) {
+            lock_guard<mutex> guard(write->lock);
+            for (const auto& key : local_written) {
+                if (ok) {
+                    write->acks[key]++;
+                } else {
+                    write->reasons[key] = Config::JOURNAL_FAILED;
+                }
+            }
+        };
+        if (remote_groups.empty()) {
+            if (!local_written.empty()) {
+                afterDurable([write, local_durable](bool ok) {
+                    local_durable(ok);
+                    finishWrite(*write);
+                });
+            } else {
+                finishWrite(*write);
+            }
+            return;
+        }
+
+        write->remaining = remote_groups.size() + (local_written.empty() ? 0 : 1);
+        if (!local_written.empty()) {
+            afterDurable([write, local_durable](bool ok) {
+                local_durable(ok);
+                if (write->remaining.fetch_sub(1) == 1) {
+                    finishWrite(*write);
+                }
+            });
+        }
+        for (auto& group : remote_groups) {
+            vector<string> keys;
+            for (const auto& item : group.second) {
+                keys.push_back(item.first);
+            }
+            rpcSetBatchAsync(group.first, move(group.second), ttl_ms,
+                [write, keys = move(keys)](KeyValues failed) {
+                    {
+                        lock_guard<mutex> guard(write->lock);
+                        unordered_set<string> group_failed;
+                        for (auto& item : failed) {
+                            group_failed.insert(item.first);
+                            write->reasons[item.first] = move(item.second);
+                        }
+                        for (const auto& key : keys) {
+                            if (!group_failed.count(key)) {
+                                write->acks[key]++;
+                            }
+                        }
+                    }
+                    if (write->remaining.fetch_sub(1) == 1) {
+                        finishWrite(*write);
+                    }
+                },
+                deadline);
+        }
+    }
+
+    // 每核模式下按所属的核拆分后分别写入，全部返回后合并失败的key；未启用时等同于 writeKeys
+    void writePartitioned(KeyValues items, int64_t ttl_ms, SetCallback callback, Deadline deadline = NO_DEADLINE) {
+        if (options.cores == 0 || items.empty()) {
+            writeKeys(items, ttl_ms, move(callback), deadline);
+            return;
+        }
+        map<size_t, KeyValues> groups;
+        for (auto& item : items) {
+            groups[cache.partitionOf(item.first, options.cores)].push_back(move(item));
+        }
+        struct State {
+            mutex lock;
+            KeyValues failed;
+            atomic<size_t> remaining;
+            SetCallback callback;
+        };
+        auto state = make_shared<State>();
+        state->remaining = groups.size();
+        state->callback = move(callback);
+        for (auto& group : groups) {
+            auto shared_items = make_shared<KeyValues>(move(group.second));
+            onKeyCore(shared_items->front().first, [this, shared_items, ttl_ms, state, deadline]() {
+                writeKeys(*shared_items, ttl_ms, [state](KeyValues failed) {
+                    {
+                        lock_guard<mutex> guard(state->lock);
+                        for (auto& item : failed) {
+                            state->failed.push_back(move(item));
+                        }
+                    }
+                    if (state->remaining.fetch_sub(1) == 1) {
+                        state->callback(move(state->failed));
+                    }
+                }, deadline);
+            });
+        }
+    }
+
+    // 回调参数为key删除前是否存在
+    void deleteKey(const string& key, function<void(bool)> callback, Deadline deadline = NO_DEADLINE) {
+        invalidateCachedReads(key);
+        forEachHolder(keyHolders(*currentMembership(), key),
+            [this, key, deadline](const string& node, function<void(bool)> done) {
+                deleteFromAsync(node, key, [done](int deleted) { done(deleted > 0); }, deadline);
+            },
+            move(callback));
+    }
+
+    // 修改已存在的key的过期时间（ttl_ms 为 0 表示取消过期），回调参数为key是否存在
+    void expireKey(const string& key, int64_t ttl_ms, function<void(bool)> callback, Deadline deadline = NO_DEADLINE) {
+        invalidateCachedReads(key);
+        forEachHolder(keyHolders(*currentMembership(), key),
+            [this, key, ttl_ms, deadline](const string& node, function<void(bool)> done) {
+                expireOnAsync(node, key, ttl_ms, move(done), deadline);
+            },
+            move(callback));
+    }
+
+    // 流式导入：正文为NDJSON，每行 {"key":..,"value":..,"ttl_ms":..}（ttl_ms 可省略，缺省用 X-TTL 头）。
+    // 边收边解析，同一过期时间的记录攒够一批后经 writePartitioned 按所属节点分组写入；
+    // 在写的批次过多时暂停接收，由TCP流控让客户端放慢
+    class ImportReader : public httplib::BodyReader {
+    public:
+        ImportReader(CacheNode& node, int64_t default_ttl_ms, function<void()> resume)
+            : node(node), default_ttl_ms(default_ttl_ms), state(make_shared<State>()) {
+            state->resume = move(resume);
+        }
+
+        bool write(string_view data) override {
+            size_t start = 0;
+            while (start < data.size()) {
+                size_t newline = data.find('\n', start);
+                if (newline == string_view::npos) {
+                    partial.append(data.substr(start));
+                    break;
+                }
+                if (partial.empty()) {
+                    addLine(data.substr(start, newline - start));
+                } else {
+                    partial.append(data.substr(start, newline - start));
+                    addLine(partial);
+                    partial.clear();
+                }
+                start = newline + 1;
+            }
+            lock_guard<mutex> guard(state->lock);
+            state->paused = state->in_flight >= Config::IMPORT_MAX_IN_FLIGHT;
+            return !state->paused;
+        }
+
+        void finish(httplib::Response& res, function<void()> done) override {
+            if (!partial.empty()) {
+                addLine(partial);
+                partial.clear();
+            }
+            for (auto& batch : batches) {
+                if (!batch.second.empty()) {
+                    flushBatch(batch.first, move(batch.second));
+                }
+            }
+            {
+                lock_guard<mutex> guard(state->lock);
+                state->invalid = invalid;
+                state->res = &res;
+                state->done = move(done);
+                if (state->in_flight > 0) return;
+            }
+            respond(*state);
+        }
+
+    private:
+        struct State {
+            mutex lock;
+            size_t in_flight = 0;
+            bool paused = false;
+            size_t imported = 0;
+            size_t failed = 0;
+            size_t invalid = 0;
+            function<void()> resume;
+            httplib::Response* res = nullptr;  // 正文收完后设置，最后一批写完时回复
+            function<void()> done;
+        };
+
+        CacheNode& node;
+        int64_t default_ttl_ms;
+        shared_ptr<State> state;
+        string partial;  // 跨数据块的不完整行
+        map<int64_t, KeyValues> batches;  // 过期时间 -> 待写入的记录
+        size_t invalid = 0;
+
+        void addLine(string_view line) {
+            if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+            if (line.find_first_not_of(" \t") == string_view::npos) return;
+            try {
+                json record = json::parse(line);
+                const string& key = record.at("key").get_ref<const string&>();
+                int64_t ttl_ms = default_ttl_ms;
+                auto ttl = record.find("ttl_ms");
+                if (ttl != record.end() && !ttl->is_null()) {
+                    ttl_ms = ttl->get<int64_t>();
+                    if (ttl_ms <= 0) throw invalid_argument("invalid ttl_ms");
+                }
+                if (key.empty()) throw invalid_argument("empty key");
+                KeyValues& batch = batches[ttl_ms];
+                batch.emplace_back(key, record.at("value").dump());
+                if (batch.size() >= Config::IMPORT_BATCH) {
+                    flushBatch(ttl_ms, move(batch));
+                    batch = KeyValues();
+                }
+            } catch (const exception&) {
+                invalid++;
+            }
+        }
+
+        void flushBatch(int64_t ttl_ms, KeyValues items) {
+            size_t count = items.size();
+            {
+                lock_guard<mutex> guard(state->lock);
+                state->in_flight++;
+            }
+            // 回调可能在当前线程中直接执行，调用时不能持有锁
+            node.writePartitioned(move(items), ttl_ms, [state = state, count](KeyValues failed) {
+                function<void()> resume;
+                bool last = false;
+                {
+                    lock_guard<mutex> guard(state->lock);
+                    state->in_flight--;
+                    state->imported += count - failed.size();
+                    state->failed += failed.size();
+                    if (state->paused && state->in_flight < Config::IMPORT_MAX_IN_FLIGHT) {
+                        state->paused = false;
+                        resume = state->resume;
+                    }
+                    last = state->in_flight == 0 && state->res != nullptr;
+                }
+                if (last) {
+                    respond(*state);
+                } else if (resume) {
+                    resume();
+                }
+            });
+        }
+
+        // 有写入失败的记录时返回 500，只有格式错误的行时返回 400
+        static void respond(State& state) {
+            json body;
+            body["imported"] = state.imported;
+            body["failed"] = state.failed;
+            body["invalid"] = state.invalid;
+            int status = state.failed > 0 ? 500 : state.invalid > 0 ? 400 : 200;
+            setJsonResponse(*state.res, status, body.dump());
+            state.resume = nullptr;
+            state.done();
+        }
+    };
+
+    // 流式导出本节点作为主副本的key，格式与导入相同。逐个存储分段取key快照，
+    // 只在复制快照时持有该分段的锁；发送缓冲区清空后才读取下一块，客户端读得慢时不会在内存中堆积
+    function<bool(string&)> exportProvider() {
+        struct Cursor {
+            shared_ptr<const Membership> view;
+            size_t shard = 0;
+            size_t position = 0;   // 在当前分段中的遍历位置
+            vector<string> keys;
+            size_t next = 0;
+        };
+        auto cursor = make_shared<Cursor>();
+        cursor->view = currentMembership();
+        return [this, cursor](string& chunk) {
+            string value;
+            int64_t ttl_ms;
+            char number[24];
+            while (chunk.size() < Config::EXPORT_CHUNK_SIZE) {
+                if (cursor->next == cursor->keys.size()) {
+                    if (cursor->shard == cache.shardCount()) {
+                        return false;
+                    }
+                    // 每次只取一小批key，IO线程上不会整段复制，也不会长时间持有分段锁
+                    cursor->keys.clear();
+                    cursor->next = 0;
+                    cursor->position = cache.scan(cursor->shard, cursor->position, Config::EXPORT_SCAN_BATCH, cursor->keys);
+                    if (cursor->position == 0) {
+                        cursor->shard++;
+                    }
+                    continue;
+                }
+                const string& key = cursor->keys[cursor->next++];
+                if (cursor->view->ring.getNode(key) != getCurrentNode() || !cache.get(key, value, ttl_ms)) {
+                    continue;
+                }
+                chunk.append("{\"key\":").append(json(key).dump()).append(",\"value\":").append(value);
+                if (ttl_ms > 0) {
+                    chunk.append(",\"ttl_ms\":").append(number, to_chars(number, number + sizeof(number), ttl_ms).ptr);
+                }
+                chunk.append("}\n");
+            }
+            return true;
+        };
+    }
+
+    // 请求所匹配路由的统计项，第一次出现时创建
+    RouteStats& routeStats(const httplib::Request& req) {
+        const char* id = req.route.empty() ? nullptr : req.route.data();
+        {
+            shared_lock<shared_mutex> lock(route_stats_mutex);
+            auto it = route_stats.find(id);
+            if (it != route_stats.end()) {
+                return *it->second;
+            }
+        }
+        unique_lock<shared_mutex> lock(route_stats_mutex);
+        auto& stats = route_stats[id];
+        if (!stats) {
+            stats.reset(new RouteStats());
+            // 未匹配的请求不带方法标签，避免任意方法名产生大量时间序列
+            stats->method = id ? req.method : "";
+            stats->route = id ? string(req.route) : "unmatched";
+        }
+        return *stats;
+    }
+
+    void recordRequest(const httplib::Request& req, const httplib::Response& res, chrono::nanoseconds elapsed) {
+        RouteStats& stats = routeStats(req);
+        stats.latency.record(static_cast<uint64_t>(chrono::duration_cast<chrono::microseconds>(elapsed).count()));
+        int status_class = res.status / 100 - 1;
+        if (status_class >= 0 && status_class < 5) {
+            stats.responses[status_class].add();
+        }
+    }
+
+    // Prometheus 文本格式的指标
+    string renderMetrics() {
+        static const char* const RPC_OP_NAMES[RPC_OPS] = {"get", "set", "delete", "mget", "expire", "migrate"};
+        static const char* const STATUS_CLASSES[5] = {"1xx", "2xx", "3xx", "4xx", "5xx"};
+        metrics::Writer out;
+
+        vector<const RouteStats*> routes;
+        {
+            shared_lock<shared_mutex> lock(route_stats_mutex);
+            for (const auto& item : route_stats) {
+                routes.push_back(item.second.get());
+            }
+        }
+        out.family("sdcs_http_request_duration_seconds", "HTTP request handling latency by route.", "histogram");
+        for (const auto* route : routes) {
+            out.histogram("sdcs_http_request_duration_seconds", {{"method", route->method}, {"route", route->route}},
+                          route->latency.snapshot(), 1e-6);
+        }
+        out.family("sdcs_http_responses_total", "HTTP responses by route and status class.", "counter");
+        for (const auto* route : routes) {
+            for (int i = 0; i < 5; ++i) {
+                uint64_t count = route->responses[i].value();
+                if (count == 0) continue;
+                out.sample("sdcs_http_responses_total",
+                           {{"method", route->method}, {"route", route->route}, {"code", STATUS_CLASSES[i]}}, count);
+            }
+        }
+        httplib::Server* server = http_server.load();
+        out.family("sdcs_http_active_connections", "Open client connections.", "gauge");
+        out.sample("sdcs_http_active_connections", {}, server ? server->connection_count() : 0);
+        out.family("sdcs_http_rejected_total", "Requests rejected by admission control (queue or connection limit) or for an expired deadline.", "counter");
+        out.sample("sdcs_http_rejected_total", {}, server ? server->rejected_count() : 0);
+
+        vector<pair<string, Peer*>> peer_list;
+        {
+            shared_lock<shared_mutex> lock(peers_mutex);
+            for (auto& item : peers) {
+                peer_list.emplace_back(item.first, item.second.get());
+            }
+        }
+        out.family("sdcs_rpc_duration_seconds", "Internal RPC latency by target node and operation.", "histogram");
+        for (const auto& peer : peer_list) {
+            for (size_t op = 0; op < RPC_OPS; ++op) {
+                auto snapshot = peer.second->rpc[op].latency.snapshot();
+                if (snapshot.count == 0) continue;
+                out.histogram("sdcs_rpc_duration_seconds", {{"peer", peer.first}, {"op", RPC_OP_NAMES[op]}},
+                              snapshot, 1e-6);
+            }
+        }
+        out.family("sdcs_rpc_errors_total", "Failed internal RPCs by target node and operation.", "counter");
+        for (const auto& peer : peer_list) {
+            for (size_t op = 0; op < RPC_OPS; ++op) {
+                out.sample("sdcs_rpc_errors_total", {{"peer", peer.first}, {"op", RPC_OP_NAMES[op]}},
+                           peer.second->rpc[op].errors.value());
+            }
+        }
+        out.family("sdcs_rpc_shed_total", "Internal RPCs not sent because the peer concurrency limit or the caller's deadline was reached.", "counter");
+        for (const auto& peer : peer_list) {
+            for (size_t op = 0; op < RPC_OPS; ++op) {
+                out.sample("sdcs_rpc_shed_total", {{"peer", peer.first}, {"op", RPC_OP_NAMES[op]}},
+                           peer.second->rpc[op].shed.value());
+            }
+        }
+        out.family("sdcs_coalesced_reads_total", "Forwarded reads by whether they issued an RPC or joined one in flight.", "counter");
+        out.sample("sdcs_coalesced_reads_total", {{"result", "issued"}}, read_flights_started.value());
+        out.sample("sdcs_coalesced_reads_total", {{"result", "joined"}}, read_flights_joined.value());
+        out.family("sdcs_rpc_outstanding", "In-flight reads per target node.", "gauge");
+        for (const auto& peer : peer_list) {
+            out.sample("sdcs_rpc_outstanding", {{"peer", peer.first}}, peer.second->outstanding.load(memory_order_relaxed));
+        }
+
+        auto stats = cache.stats();
+        out.family("sdcs_cache_lookups_total", "Local store lookups by result.", "counter");
+        out.sample("sdcs_cache_lookups_total", {{"result", "hit"}}, local_hits.value());
+        out.sample("sdcs_cache_lookups_total", {{"result", "miss"}}, local_misses.value());
+        out.family("sdcs_store_keys", "Keys in the local store.", "gauge");
+        out.sample("sdcs_store_keys", {}, stats.keys);
+        out.family("sdcs_store_resident_bytes", "Bytes charged against the memory limit.", "gauge");
+        out.sample("sdcs_store_resident_bytes", {}, stats.resident_bytes);
+        out.family("sdcs_store_max_bytes", "Memory limit of the local store, 0 if unlimited.", "gauge");
+        out.sample("sdcs_store_max_bytes", {}, stats.max_bytes);
+        out.family("sdcs_store_evictions_total", "Entries evicted by the memory limit.", "counter");
+        out.sample("sdcs_store_evictions_total", {}, stats.evictions);
+        out.family("sdcs_store_expirations_total", "Entries removed by TTL expiry.", "counter");
+        out.sample("sdcs_store_expirations_total", {}, stats.expirations);
+        out.family("sdcs_store_lock_wait_seconds", "Time spent waiting for a contended shard lock.", "histogram");
+        out.histogram("sdcs_store_lock_wait_seconds", {{"store", "local"}}, cache.lockWait(), 1e-9);
+        if (near_cache) {
+            out.histogram("sdcs_store_lock_wait_seconds", {{"store", "near"}}, near_cache->lockWait(), 1e-9);
+            out.family("sdcs_near_cache_lookups_total", "Near-cache lookups by result.", "counter");
+            out.sample("sdcs_near_cache_lookups_total", {{"result", "hit"}}, near_cache_hits.value());
+            out.sample("sdcs_near_cache_lookups_total", {{"result", "miss"}}, near_cache_misses.value());
+            out.family("sdcs_near_cache_keys", "Keys in the near-cache.", "gauge");
+            out.sample("sdcs_near_cache_keys", {}, near_cache->stats().keys);
+        }
+
+        out.family("sdcs_membership_version", "Version of the current membership view.", "gauge");
+        out.sample("sdcs_membership_version", {}, currentMembership()->version);
+        if (persistence) {
+            auto persistence_stats = persistence->stats();
+            out.family("sdcs_wal_bytes", "Bytes in the current write-ahead log.", "gauge");
+            out.sample("sdcs_wal_bytes", {}, persistence_stats.wal_bytes);
+            out.family("sdcs_snapshots_total", "Snapshots written since start.", "counter");
+            out.sample("sdcs_snapshots_total", {}, persistence_stats.snapshots);
+        }
+        return out.str();
+    }
+
+    // 让正在运行的 start() 返回（线程安全），在同一进程内启动多个节点时使用。
+    // 需在服务器开始监听之后调用
+    void stop() {
+        httplib::Server* server = http_server.load();
+        if (server) {
+            server->stop();
+        }
+    }
+
+    // 启动HTTP服务器
+    void start() {
+        httplib::Server server;
+        server.set_thread_pool_size(options.worker_threads);
+        server.set_io_thread_count(options.cores > 0 ? options.cores : options.io_threads);
+        server.set_shard_per_core(options.cores > 0);
+        server.set_listen_backlog(options.listen_backlog);
+        server.set_keep_alive_timeout(options.keep_alive_timeout);
+        server.set_max_queued_requests(options.max_queued_requests);
+        server.set_max_connections(options.max_connections);
+        server.set_timeout_header(Config::TIMEOUT_HEADER);
+
+        // 设置CORS头（启动时渲染一次，每个响应原样附加）
+        server.set_default_headers({
+            {"Access-Control-Allow-Origin", "*"},
+            {"Access-Control-Allow-Methods", "GET, POST, DELETE, OPTIONS"},
+            {"Access-Control-Allow-Headers", "Content-Type"},
+        });
+
+        // 每个请求按路由记录耗时和状态码
+        server.set_logger([this](const httplib::Request& req, const httplib::Response& res, chrono::nanoseconds elapsed) {
+            recordRequest(req, res, elapsed);
+        });
+
+        // OPTIONS处理
+        server.Options(".*", [](const httplib::Request&, httplib::Response&) {
+            return;
+        });
+
+        // 健康检查接口 - 必须放在通用路由之前
+        server.Get("/health", [this](const httplib::Request&, httplib::Response& res) {
+            res.status = 200;
+            res.set_header("Content-Type", "application/json; charset=utf-8");
+            res.body = "{\"status\":\"ok\",\"node\":\"" + node_id + "\"}";
+        });
+
+        // Prometheus 指标
+        server.Get("/metrics", [this](const httplib::Request&, httplib::Response& res) {
+            res.status = 200;
+            res.set_header("Content-Type", "text/plain; version=0.0.4; charset=utf-8");
+            res.body = renderMetrics();
+        });
+
+        // GET /cluster/nodes - 当前成员视图
+        server.Get("/cluster/nodes", [this](const httplib::Request&, httplib::Response& res) {
+            json body = membershipJson(*currentMembership());
+            body["self"] = getCurrentNode();
+            body["migrating"] = atomic_load(&previous_membership) != nullptr;
+            setJsonResponse(res, 200, body.dump());
+        });
+
+        // POST /cluster/join、/cluster/leave - 加入或移除节点，请求体 {"node":"http://host:port"}
+        auto membershipHandler = [this](bool join) {
+            return [this, join](const httplib::Request& req, httplib::Response& res) {
+                try {
+                    string node = json::parse(req.body).at("node").get<string>();
+                    if (node.empty()) {
+                        setErrorResponse(res, 400, "Empty node");
+                        return;
+                    }
+                    setJsonResponse(res, 200, changeMembership(node, join).dump());
+                } catch (const exception& e) {
+                    setErrorResponse(res, 400, "Bad request: " + string(e.what()));
+                }
+            };
+        };
+        server.Post("/cluster/join", membershipHandler(true));
+        server.Post("/cluster/leave", membershipHandler(false));
+
+        // POST / - 写入/更新缓存
+        // 每个key写入它的所有副本，多数副本写成功（异步写模式下为主副本）才算成功
+        server.PostAsync("/", [this](const httplib::Request& req, httplib::Response& res, httplib::Server::Done done) {
+            KeyValues items;
+            int64_t ttl_ms;
+            try {
+                if (req.body.empty()) {
+                    setErrorResponse(res, 400, "Empty request body");
+                    done();
+                    return;
+                }
+                json body = json::parse(req.body);
+                ttl_ms = parseTtl(req);
+                for (auto& item : body.items()) {
+                    // 只在写入时序列化一次，之后读取直接返回这些字节
+                    items.emplace_back(item.key(), item.value().dump());
+                }
+            } catch (const exception& e) {
+                setErrorResponse(res, 400, "Bad request: " + string(e.what()));
+                done();
+                return;
+            }
+
+            writePartitioned(move(items), ttl_ms, [this, &res, done](KeyValues failed) {
+                if (failed.empty()) {
+                    setSuccessResponse(res);
+                } else {
+                    // 逐个key报告失败原因。只有值过大时返回 413；其余失败都因对端过载（503）
+                    // 或都因时间预算用完（504）时返回对应状态码，否则返回 500
+                    json reasons = json::object();
+                    int status = 413;
+                    for (const auto& item : failed) {
+                        reasons[item.first] = item.second;
+                        if (item.second == Config::VALUE_TOO_LARGE) continue;
+                        int item_status = item.second == Config::PEER_OVERLOADED ? 503
+                                        : item.second == Config::DEADLINE_EXCEEDED ? 504 : 500;
+                        status = status == 413 || status == item_status ? item_status : 500;
+                    }
+                    json error;
+                    error["error"] = status == 413 ? Config::VALUE_TOO_LARGE : "Internal server error";
+                    error["failed"] = reasons;
+                    setJsonResponse(res, status, error.dump());
+                }
+                done();
+            }, req.deadline);
+        });
+
+        // POST /_import - 流式批量导入（NDJSON），返回导入、写入失败和格式错误的记录数
+        server.PostStream("/_import", [this](const httplib::Request& req, httplib::Response& res,
+                                             function<void()> resume) -> shared_ptr<httplib::BodyReader> {
+            try {
+                return make_shared<ImportReader>(*this, parseTtl(req), move(resume));
+            } catch (const exception& e) {
+                setErrorResponse(res, 400, "Bad request: " + string(e.what()));
+                return nullptr;
+            }
+        });
+
+        // GET /_export - 流式导出本节点作为主副本的key（NDJSON），依次导出每个节点即为整个集群的数据
+        server.GetAsync("/_export", [this](const httplib::Request&, httplib::Response& res, httplib::Server::Done done) {
+            res.status = 200;
+            res.set_header("Content-Type", "application/x-ndjson");
+            res.set_content_provider(exportProvider());
+            done();
+        });
+
+        // GET /_mget?keys=k1,k2,... - 批量读取，各key与单个读取一样查找（近端缓存、副本、迁移前的所属节点），
+        // 并发进行、同一节点上的读取会被合并。都读完时返回存在的key；有key因对端过载或时间预算用完
+        // 而没能读取时，与批量写入一样逐个key报告原因
+        server.GetAsync("/_mget", [this](const httplib::Request& req, httplib::Response& res,
+                                         httplib::Server::Done done) {
+            vector<string> keys;
+            unordered_set<string> seen;
+            auto range = req.params.equal_range("keys");
+            for (auto it = range.first; it != range.second; ++it) {
+                size_t start = 0;
+                while (start <= it->second.size()) {
+                    size_t comma = it->second.find(',', start);
+                    if (comma == string::npos) comma = it->second.size();
+                    string key = it->second.substr(start, comma - start);
+                    start = comma + 1;
+                    if (key.empty() || !seen.insert(key).second) continue;
+                    keys.push_back(move(key));
+                }
+            }
+            if (keys.empty()) {
+                setErrorResponse(res, 400, "Missing keys parameter");
+                done();
+                return;
+            }
+
+            // 每个key的结果：found 为 true 时 value 是值，否则 value 是没能读取的原因（为空表示不存在）
+            struct MultiGet {
+                vector<string> keys;
+                vector<pair<bool, string>> results;
+                atomic<size_t> remaining;
+                httplib::Response* res;
+                httplib::Server::Done done;
+            };
+            auto state = make_shared<MultiGet>();
+            state->results.resize(keys.size());
+            state->remaining = keys.size();
+            state->res = &res;
+            state->done = move(done);
+            state->keys = move(keys);
+            Deadline deadline = req.deadline;
+            auto finish = [state]() {
+                if (state->remaining.fetch_sub(1) != 1) return;
+                string members;
+                json reasons = json::object();
+                int status = 0;
+                for (size_t i = 0; i < state->keys.size(); i++) {
+                    const auto& result = state->results[i];
+                    if (result.first) {
+                        appendMember(members, state->keys[i], result.second);
+                    } else if (!result.second.empty()) {
+                        reasons[state->keys[i]] = result.second;
+                        int item_status = result.second == Config::PEER_OVERLOADED ? 503 : 504;
+                        status = status == 0 || status == item_status ? item_status : 500;
+                    }
+                }
+                if (status == 0) {
+                    setJsonResponse(*state->res, 200, "{" + members + "}");
+                } else {
+                    if (status == 503) state->res->set_header("Retry-After", "1");
+                    json error;
+                    error["error"] = status == 503 ? Config::PEER_OVERLOADED
+                                   : status == 504 ? Config::DEADLINE_EXCEEDED : "Internal server error";
+                    error["failed"] = reasons;
+                    setJsonResponse(*state->res, status, error.dump());
+                }
+                state->done();
+            };
+            // 与单个读取一样在key所属的核上查找，各key的结果写入各自的位置
+            for (size_t i = 0; i < state->keys.size(); i++) {
+                onKeyCore(state->keys[i], [this, state, finish, i, deadline]() {
+                    lookupKey(state->keys[i], [state, finish, i, deadline](bool found, string value) {
+                        if (found) {
+                            state->results[i] = {true, move(value)};
+                        } else if (chrono::steady_clock::now() >= deadline) {
+                            state->results[i].second = Config::DEADLINE_EXCEEDED;
+                        }
+                        finish();
+                    }, deadline, [state, finish, i]() {
+                        state->results[i].second = Config::PEER_OVERLOADED;
+                        finish();
+                    });
+                });
+            }
+        });
+
+        // GET /{key} - 读取缓存
+        server.GetAsync(R"(/([^/]+))", [this](const httplib::Request& req, httplib::Response& res,
+                                              httplib::Server::Done done) {
+            if (req.matches.empty()) {
+                setErrorResponse(res, 400, "Invalid request");
+                done();
+                return;
+            }
+            string key = req.matches[0];
+            Deadline deadline = req.deadline;
+            onKeyCore(key, [this, key, &res, done, deadline]() {
+                lookupKey(key, [this, key, &res, done, deadline](bool found, string value) {
+                    if (found) {
+                        setJsonResponse(res, 200, wrapKeyValue(key, value));
+                    } else if (chrono::steady_clock::now() >= deadline) {
+                        // 没读到可能只是因为时间预算用完、没有再去读其他副本
+                        setErrorResponse(res, 504, Config::DEADLINE_EXCEEDED);
+                    } else {
+                        res.status = 404;
+                    }
+                    done();
+                }, deadline, [this, &res, done]() {
+                    res.set_header("Retry-After", "1");
+                    setErrorResponse(res, 503, Config::PEER_OVERLOADED);
+                    done();
+                });
+            });
+        });
+
+        // DELETE /{key} - 删除缓存
+        server.DeleteAsync(R"(/([^/]+))", [this](const httplib::Request& req, httplib::Response& res,
+                                                 httplib::Server::Done done) {
+            if (req.matches.empty()) {
+                setErrorResponse(res, 400, "Invalid request");
+                done();
+                return;
+            }
+            string key = req.matches[0];
+            Deadline deadline = req.deadline;
+            onKeyCore(key, [this, key, &res, done, deadline]() {
+                deleteKey(key, [this, &res, done, deadline](bool deleted) {
+                    if (!deleted && chrono::steady_clock::now() >= deadline) {
+                        setErrorResponse(res, 504, Config::DEADLINE_EXCEEDED);
+                    } else {
+                        setJsonResponse(res, 200, deleted ? "1" : "0");
+                    }
+                    done();
+                }, deadline);
+            });
+        });
+
+        // 内部RPC接口
+        server.Get(R"(/internal/get/([^/]+))", [this](const httplib::Request& req, httplib::Response& res) {
+            if (req.matches.empty()) {
+                setErrorResponse(res, 400, "Invalid request");
+                return;
+            }
+            string key = req.matches[0];
+            string value;
+            
+            if (!getLocal(key, value)) {
+                res.status = 404;
+            } else {
+                setJsonResponse(res, 200, value);
+            }
+        });
+
+        // 修改本地key的过期时间，TTL头缺省表示取消过期；返回1（已设置）或0（不存在）
+        // 本地写入接口都是异步处理：开启 sync_writes 时等日志落盘后再回复
+        server.PostAsync(R"(/internal/expire/([^/]+))", [this](const httplib::Request& req, httplib::Response& res,
+                                                               httplib::Server::Done done) {
+            if (req.matches.empty()) {
+                setErrorResponse(res, 400, "Invalid request");
+                done();
+                return;
+            }
+            try {
+                bool found = expireLocal(req.matches[0], parseTtl(req));
+                setJsonResponse(res, 200, found ? "1" : "0");
+                if (found) {
+                    replyAfterDurable(res, done);
+                    return;
+                }
+            } catch (const exception& e) {
+                setErrorResponse(res, 400, "Bad request: " + string(e.what()));
+            }
+            done();
+        });
+
+        // POST /internal/set、/internal/migrate - 写入本地key；迁移时不覆盖已有的和迁移期间删除过的key
+        auto internalSetHandler = [this](bool migrate) {
+            return [this, migrate](const httplib::Request& req, httplib::Response& res, httplib::Server::Done done) {
+                try {
+                    json body = json::parse(req.body);
+                    int64_t ttl_ms = parseTtl(req);
+                    json failed = json::array();
+                    for (auto& item : body.items()) {
+                        string value = item.value().dump();
+                        if (!(migrate ? migrateLocal(item.key(), value, ttl_ms) : setLocal(item.key(), value, ttl_ms))) {
+                            failed.push_back(item.key());
+                        }
+                    }
+                    if (failed.empty()) {
+                        setSuccessResponse(res);
+                    } else {
+                        json error;
+                        error["error"] = Config::VALUE_TOO_LARGE;
+                        error["failed"] = failed;
+                        setJsonResponse(res, 413, error.dump());
+                    }
+                    if (failed.size() < body.size()) {
+                        replyAfterDurable(res, done);
+                        return;
+                    }
+                } catch (const exception& e) {
+                    setErrorResponse(res, 400, "Bad request: " + string(e.what()));
+                }
+                done();
+            };
+        };
+        server.PostAsync("/internal/set", internalSetHandler(false));
+        server.PostAsync("/internal/migrate", internalSetHandler(true));
+
+        // 批量读取本地key，请求体为key数组，返回存在的key组成的对象
+        server.Post("/internal/mget", [this](const httplib::Request& req, httplib::Response& res) {
+            try {
+                json keys = json::parse(req.body);
+                string members;
+                string value;
+                for (const auto& key : keys) {
+                    const string& name = key.get_ref<const string&>();
+                    if (getLocal(name, value)) {
+                        appendMember(members, name, value);
+                    }
+                }
+                setJsonResponse(res, 200, "{" + members + "}");
+            } catch (const exception& e) {
+                setErrorResponse(res, 400, "Bad request: " + string(e.what()));
+            }
+        });
+
+        // 本地存储统计：key数量、内存占用和淘汰次数
+        server.Get("/internal/stats", [this](const httplib::Request&, httplib::Response& res) {
+            auto stats = cache.stats();
+            json body;
+            body["node"] = node_id;
+            body["keys"] = stats.keys;
+            body["resident_bytes"] = stats.resident_bytes;
+            body["max_bytes"] = stats.max_bytes;
+            body["evictions"] = stats.evictions;
+            body["expirations"] = stats.expirations;
+            if (persistence) {
+                auto persistence_stats = persistence->stats();
+                json disk;
+                disk["wal_bytes"] = persistence_stats.wal_bytes;
+                disk["snapshots"] = persistence_stats.snapshots;
+                disk["last_snapshot_keys"] = persistence_stats.last_snapshot_keys;
+                disk["recovered_keys"] = persistence_stats.recovered_keys;
+                body["persistence"] = disk;
+            }
+            if (near_cache) {
+                auto near_stats = near_cache->stats();
+                uint64_t hits = near_cache_hits.value();
+                uint64_t misses = near_cache_misses.value();
+                json near;
+                near["keys"] = near_stats.keys;
+                near["resident_bytes"] = near_stats.resident_bytes;
+                near["hits"] = hits;
+                near["misses"] = misses;
+                near["hit_rate"] = hits + misses == 0 ? 0.0 : static_cast<double>(hits) / (hits + misses);
+                body["near_cache"] = near;
+            }
+            json coalescing;
+            coalescing["issued"] = read_flights_started.value();
+            coalescing["joined"] = read_flights_joined.value();
+            body["coalesced_reads"] = coalescing;
+            setJsonResponse(res, 200, body.dump());
+        });
+
+        // 发起成员变更的节点下发的新视图
+        server.Post("/internal/membership", [this](const httplib::Request& req, httplib::Response& res) {
+            try {
+                json body = json::parse(req.body);
+                applyMembership(body.at("version").get<uint64_t>(), body.at("nodes").get<vector<string>>());
+                setSuccessResponse(res);
+            } catch (const exception& e) {
+                setErrorResponse(res, 400, "Bad request: " + string(e.what()));
+            }
+        });
+
+        server.DeleteAsync(R"(/internal/delete/([^/]+))", [this](const httplib::Request& req, httplib::Response& res,
+                                                                 httplib::Server::Done done) {
+            if (req.matches.empty()) {
+                setErrorResponse(res, 400, "Invalid request");
+                done();
+                return;
+            }
+            bool deleted = deleteLocal(req.matches[0]);
+            setJsonResponse(res, 200, deleted ? "1" : "0");
+            if (deleted) {
+                replyAfterDurable(res, done);
+            } else {
+                done();
+            }
+        });
+
+
+        // 后台推进时间轮，回收过期的key
+        atomic<bool> running(true);
+        thread expirer([this, &running]() {
+            while (running) {
+                this_thread::sleep_for(chrono::milliseconds(ShardedStore::EXPIRE_TICK_MS));
+                cache.expire();
+                if (near_cache) {
+                    near_cache->expire();
+                }
+            }
+        });
+
+        if (persistence) {
+            persistence->start();
+        }
+
+        // 成员变化后的后台数据迁移
+        thread migrator([this, &running]() { migrationLoop(running); });
+        thread joiner;
+        if (!options.join_url.empty()) {
+            joiner = thread([this, &running]() { joinCluster(running); });
+        }
+
+        // 节点间二进制RPC服务，独立端口和事件循环
+        binrpc::Server rpc_server([this](uint8_t op, string_view body, uint8_t& status, string& response,
+                                         const binrpc::Server::Defer& defer) {
+            handleBinaryRequest(op, body, status, response, defer);
+        });
+        thread rpc_thread;
+        if (options.rpc_port_offset > 0) {
+            rpc_thread = thread([this, &rpc_server]() {
+                rpc_server.listen("0.0.0.0", port + options.rpc_port_offset);
+            });
+        }
+        resp::Server resp_server([this](vector<string>& args, resp::Server::Reply reply) {
+            handleRespCommand(args, move(reply));
+        });
+        thread resp_thread;
+        if (options.resp_port > 0) {
+            resp_thread = thread([this, &resp_server]() {
+                resp_server.listen("0.0.0.0", options.resp_port);
+            });
+        }
+
+        cout << "缓存节点 " << node_id << " 启动在端口 " << port << endl;
+        http_server.store(&server);
+        server.listen("0.0.0.0", port);
+        http_server.store(nullptr);
+        if (resp_thread.joinable()) {
+            resp_server.stop();
+            resp_thread.join();
+        }
+        // 等待仍在执行的转发回调结束，它们会访问 server 的连接
+        http_pool->shutdown();
+        rpc_pool->shutdown();
+
+        running = false;
+        expirer.join();
+        {
+            lock_guard<mutex> lock(migration_mutex);
+        }
+        migration_cv.notify_all();
+        migrator.join();
+        if (persistence) {
+            persistence->stop();
+        }
+        if (joiner.joinable()) {
+            joiner.join();
+        }
+        if (rpc_thread.joinable()) {
+            rpc_server.stop();
+            rpc_thread.join();
+        }
+    }
+};
+
+// 解析带单位的字节数，如 512M、2G
+inline size_t parseByteSize(const string& value) {
+    // stoull 会接受负号并回绕成很大的数
+    if (value.empty() || value[0] < '0' || value[0] > '9') throw invalid_argument("invalid size: " + value);
+    size_t pos = 0;
+    unsigned long long number = stoull(value, &pos);
+    string unit = value.substr(pos);
+    if (unit.empty() || unit == "B") return number;
+    if (unit == "K" || unit == "KB") return number << 10;
+    if (unit == "M" || unit == "MB") return number << 20;
+    if (unit == "G" || unit == "GB") return number << 30;
+    throw invalid_argument("unknown unit: " + unit);
+}
+
+// 解析整数参数：整个值必须是 [min_value, max_value] 内的整数，否则抛出异常
+template <typename T>
+inline T parseNumber(const string& value, long long min_value,
+                     long long max_value = numeric_limits<long long>::max()) {
+    if (static_cast<unsigned long long>(numeric_limits<T>::max()) <
+        static_cast<unsigned long long>(numeric_limits<long long>::max())) {
+        max_value = min(max_value, static_cast<long long>(numeric_limits<T>::max()));
+    }
+    size_t pos = 0;
+    long long number = stoll(value, &pos);
+    if (pos != value.size() || number < min_value || number > max_value) {
+        throw out_of_range("value out of range: " + value);
+    }
+    return static_cast<T>(number);
+}
+
+// 按逗号拆分列表，忽略空项
+inline vector<string> splitList(const string& value) {
+    vector<string> items;
+    size_t start = 0;
+    while (start <= value.size()) {
+        size_t comma = value.find(',', start);
+        if (comma == string::npos) comma = value.size();
+        if (comma > start) {
+            items.push_back(value.substr(start, comma - start));
+        }
+        start = comma + 1;
+    }
+    return items;
+}
+
+// 解析 --名称=值 形式的可选参数，数值超出有效范围时返回 false
+inline bool parseOption(const string& arg, NodeOptions& opts) {
+    size_t eq = arg.find('=');
+    if (arg.compare(0, 2, "--") != 0 || eq == string::npos) {
+        return false;
+    }
+    string name = arg.substr(2, eq - 2);
+    string value = arg.substr(eq + 1);
+    try {
+        if (name == "workers") {
+            opts.worker_threads = parseNumber<int>(value, 1);
+        } else if (name == "io-threads") {
+            opts.io_threads = parseNumber<int>(value, 1);
+        } else if (name == "backlog") {
+            opts.listen_backlog = parseNumber<int>(value, 1);
+        } else if (name == "keep-alive-timeout") {
+            opts.keep_alive_timeout = parseNumber<int>(value, 0);
+        } else if (name == "max-queued") {
+            opts.max_queued_requests = parseNumber<size_t>(value, 0);
+        } else if (name == "max-connections") {
+            opts.max_connections = parseNumber<size_t>(value, 0);
+        } else if (name == "peer-concurrency") {
+            opts.peer_concurrency = parseNumber<size_t>(value, 0);
+        } else if (name == "store-shards") {
+            opts.store_shards = parseNumber<int>(value, 1);
+        } else if (name == "max-memory") {
+            opts.max_memory = parseByteSize(value);
+        } else if (name == "rpc-port-offset") {
+            opts.rpc_port_offset = parseNumber<int>(value, 0, 65535);
+        } else if (name == "shard-per-core") {
+            // 每核一个绑定CPU的事件循环，不能多于本机的核数；0 表示不启用
+            unsigned hardware = max(1u, thread::hardware_concurrency());
+            opts.cores = value == "auto" ? hardware : parseNumber<size_t>(value, 0, hardware);
+        } else if (name == "resp-port") {
+            opts.resp_port = parseNumber<int>(value, 0, 65535);
+        } else if (name == "self") {
+            opts.self_url = value;
+        } else if (name == "nodes") {
+            opts.nodes = splitList(value);
+        } else if (name == "join") {
+            opts.join_url = value;
+        } else if (name == "migration-rate") {
+            opts.migration_rate = parseNumber<int>(value, 0);
+        } else if (name == "replicas") {
+            opts.replicas = parseNumber<size_t>(value, 1);
+        } else if (name == "write-mode") {
+            if (value == "quorum") {
+                opts.quorum_writes = true;
+            } else if (value == "async") {
+                opts.quorum_writes = false;
+            } else {
+                return false;
+            }
+        } else if (name == "near-cache") {
+            opts.near_cache_bytes = parseByteSize(value);
+        } else if (name == "near-cache-ttl-ms") {
+            opts.near_cache_ttl_ms = parseNumber<int>(value, 1);
+        } else if (name == "hot-key-threshold") {
+            opts.hot_key_threshold = parseNumber<uint32_t>(value, 0);
+        } else if (name == "data-dir") {
+            opts.data_dir = value;
+        } else if (name == "fsync-interval-ms") {
+            opts.fsync_interval_ms = parseNumber<int>(value, 1);
+        } else if (name == "sync-writes") {
+            if (value != "true" && value != "false") return false;
+            opts.sync_writes = value == "true";
+        } else if (name == "snapshot-interval") {
+            opts.snapshot_interval = parseNumber<int>(value, 1);
+        } else if (name == "hash-mode") {
+            if (value == "ring") {
+                opts.hash_mode = ConsistentHash::Mode::Ring;
+            } else if (value == "rendezvous") {
+                opts.hash_mode = ConsistentHash::Mode::Rendezvous;
+            } else {
+                return false;
+            }
+        } else {
+            return false;
+        }
+    } catch (const exception& e) {
+        return false;
+    }
+    return true;
+}
+
+#endif // CACHE_NODE_H
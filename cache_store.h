@@ -0,0 +1,751 @@
+#ifndef CACHE_STORE_H
+#define CACHE_STORE_H
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <shared_mutex>
+#include <mutex>
+#include <memory>
+#include <functional>
+#include <cstdint>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <string_view>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include "metrics.h"
+
+// 按大小分级的slab分配器：从64KB的页中切出固定大小的块，同级别释放的块串成空闲链表复用，
+// 避免每个值单独向堆申请。超过最大级别的值直接用 malloc。
+// 不是线程安全的，由所属分段的锁保护
+class SlabAllocator {
+public:
+    static constexpr size_t PAGE_SIZE = 64 * 1024;
+    static constexpr uint8_t LARGE = 0xFF;   // 不走slab的大块
+
+    SlabAllocator() {
+        for (auto& head : free_lists) head = nullptr;
+        for (auto& cursor : cursors) cursor = Cursor();
+    }
+
+    ~SlabAllocator() {
+        for (char* page : pages) {
+            free(page);
+        }
+    }
+
+    SlabAllocator(const SlabAllocator&) = delete;
+    SlabAllocator& operator=(const SlabAllocator&) = delete;
+
+    // 块实际占用的字节数，用于内存计数
+    static size_t chunkSize(size_t size) {
+        uint8_t cls = sizeClass(size);
+        return cls == LARGE ? size : classes().sizes[cls];
+    }
+
+    char* allocate(size_t size, uint8_t& cls) {
+        cls = sizeClass(size);
+        if (cls == LARGE) {
+            return static_cast<char*>(malloc(size > 0 ? size : 1));
+        }
+        if (free_lists[cls] != nullptr) {
+            FreeChunk* chunk = free_lists[cls];
+            free_lists[cls] = chunk->next;
+            return reinterpret_cast<char*>(chunk);
+        }
+        size_t chunk_size = classes().sizes[cls];
+        Cursor& cursor = cursors[cls];
+        if (cursor.remaining < chunk_size) {
+            char* page = static_cast<char*>(malloc(PAGE_SIZE));
+            pages.push_back(page);
+            cursor.next = page;
+            cursor.remaining = PAGE_SIZE;
+        }
+        char* chunk = cursor.next;
+        cursor.next += chunk_size;
+        cursor.remaining -= chunk_size;
+        return chunk;
+    }
+
+    void deallocate(char* chunk, uint8_t cls) {
+        if (cls == LARGE) {
+            free(chunk);
+            return;
+        }
+        FreeChunk* node = reinterpret_cast<FreeChunk*>(chunk);
+        node->next = free_lists[cls];
+        free_lists[cls] = node;
+    }
+
+private:
+    static constexpr size_t MAX_CLASSES = 64;
+
+    struct FreeChunk {
+        FreeChunk* next;
+    };
+
+    struct Cursor {
+        char* next = nullptr;
+        size_t remaining = 0;
+    };
+
+    // 级别表：从16字节开始每级增长约1.25倍（8字节对齐），最大不超过页大小的1/4
+    struct ClassTable {
+        size_t sizes[MAX_CLASSES];
+        size_t count = 0;
+
+        ClassTable() {
+            size_t size = 16;
+            while (size <= PAGE_SIZE / 4 && count < MAX_CLASSES) {
+                sizes[count++] = size;
+                size = ((size * 5 / 4) + 7) & ~static_cast<size_t>(7);
+            }
+        }
+    };
+
+    static const ClassTable& classes() {
+        static const ClassTable table;
+        return table;
+    }
+
+    static uint8_t sizeClass(size_t size) {
+        const ClassTable& table = classes();
+        if (size > table.sizes[table.count - 1]) {
+            return LARGE;
+        }
+        const size_t* it = std::lower_bound(table.sizes, table.sizes + table.count, size);
+        return static_cast<uint8_t>(it - table.sizes);
+    }
+
+    FreeChunk* free_lists[MAX_CLASSES];
+    Cursor cursors[MAX_CLASSES];
+    std::vector<char*> pages;
+};
+
+// 写入日志：ShardedStore 在持有分段写锁时调用，同一个key的记录顺序与写入存储的顺序一致。
+// 只记录 set、expire（按当前值和新的过期时间记一次 set）和删除成功的 erase；淘汰和过期回收不记录
+class StoreJournal {
+public:
+    virtual ~StoreJournal() = default;
+    virtual void logSet(const std::string& key, std::string_view value, int64_t ttl_ms) = 0;
+    virtual void logDelete(const std::string& key) = 0;
+};
+
+// 分段加锁的并发存储：key按哈希落到 2^n 个分段之一，每个分段有独立的锁、哈希表和slab分配器，
+// 不同分段上的读写互不阻塞。值以序列化后的字节保存（调用方负责校验格式），读取时原样取出。
+// 内存上限：按 key + value 实际占用的字节数计数，超过上限时用 CLOCK 算法（近似LRU）淘汰，
+// 读操作只在共享锁下设置访问位，不需要任何全局锁。
+// 过期：读时惰性检查，另由每个分段的分层时间轮回收到期条目，不需要扫描整个哈希表
+class ShardedStore {
+public:
+    struct Stats {
+        size_t keys = 0;
+        size_t resident_bytes = 0;
+        size_t max_bytes = 0;       // 0 表示不限制
+        uint64_t evictions = 0;
+        uint64_t expirations = 0;
+    };
+
+    // 时间轮最底层一格的时长
+    static constexpr int64_t EXPIRE_TICK_MS = 100;
+    // expire 每次持锁最多删除的条目数
+    static constexpr size_t EXPIRE_BATCH = 1024;
+
+    explicit ShardedStore(size_t shard_count = 64, size_t max_bytes = 0) : max_bytes(max_bytes) {
+        // 向上取整为2的幂，分段选择只需一次与运算
+        size_t count = 1;
+        while (count < shard_count) count <<= 1;
+        shard_mask = count - 1;
+        shards.reset(new Shard[count]);
+        int64_t tick = nowMs() / EXPIRE_TICK_MS;
+        for (size_t i = 0; i < count; ++i) {
+            shards[i].wheel.current_tick = tick;
+        }
+    }
+
+    // 单调时钟毫秒数，过期时间都以此为基准
+    static int64_t nowMs() {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    ShardedStore(const ShardedStore&) = delete;
+    ShardedStore& operator=(const ShardedStore&) = delete;
+
+    // 设置写入日志，nullptr 表示不记录。恢复数据时不设置，避免把重放的写入再记一遍
+    void setJournal(StoreJournal* value) {
+        journal.store(value, std::memory_order_release);
+    }
+
+    // ttl_ms 为 0 表示永不过期（覆盖写会清除原有的过期时间）。
+    // 单个条目超过内存上限时拒绝写入并返回 false
+    bool set(const std::string& key, std::string_view value, int64_t ttl_ms = 0) {
+        return write(key, value, ttl_ms, false);
+    }
+
+    // 迁移写入：key已存在，或记录删除期间被删除过（见 recordDeletes）时不写入，同样返回 true，
+    // 迁移来的旧值不会覆盖更新的写入，也不会让已删除的key复活。单个条目超过内存上限时返回 false
+    bool setIfAbsent(const std::string& key, std::string_view value, int64_t ttl_ms = 0) {
+        return write(key, value, ttl_ms, true);
+    }
+
+    // 开启后 erase 为每个被删除的key留下墓碑（不论删除前是否存在），供 setIfAbsent 判断；关闭时清空墓碑
+    void recordDeletes(bool on) {
+        recording_deletes.store(on, std::memory_order_relaxed);
+        if (on) return;
+        for (size_t i = 0; i <= shard_mask; ++i) {
+            std::unique_lock<std::shared_mutex> lock(shards[i].mutex, std::defer_lock);
+            acquire(lock);
+            shards[i].tombstones.clear();
+        }
+    }
+
+    bool get(const std::string& key, std::string& value) const {
+        int64_t ttl_ms;
+        return get(key, value, ttl_ms);
+    }
+
+    // 同时返回剩余存活时间（毫秒），0 表示永不过期
+    bool get(const std::string& key, std::string& value, int64_t& ttl_ms) const {
+        const Shard& shard = shardFor(key);
+        std::shared_lock<std::shared_mutex> lock(shard.mutex, std::defer_lock);
+        acquire(lock);
+        auto it = shard.map.find(key);
+        if (it == shard.map.end()) {
+            return false;
+        }
+        const Entry& entry = it->second;
+        if (isExpired(entry)) {
+            // 已过期但尚未被时间轮回收
+            return false;
+        }
+        // 访问位已置位时不再写，避免热点key所在缓存行的无谓失效
+        if (!entry.referenced.load(std::memory_order_relaxed)) {
+            entry.referenced.store(true, std::memory_order_relaxed);
+        }
+        value.assign(entry.data, entry.size);
+        ttl_ms = entry.expire_at == 0 ? 0 : std::max<int64_t>(1, entry.expire_at - nowMs());
+        return true;
+    }
+
+    // 修改已存在的key的过期时间，ttl_ms 为 0 表示取消过期；value 非空时同时返回当前值。
+    // key 不存在或已过期时返回 false
+    bool expire(const std::string& key, int64_t ttl_ms, std::string* value = nullptr) {
+        Shard& shard = shardFor(key);
+        std::unique_lock<std::shared_mutex> lock(shard.mutex, std::defer_lock);
+        acquire(lock);
+        auto it = shard.map.find(key);
+        if (it == shard.map.end() || isExpired(it->second)) {
+            return false;
+        }
+        Node* node = &*it;
+        TimerWheel::unlink(node);
+        node->second.expire_at = ttl_ms > 0 ? nowMs() + ttl_ms : 0;
+        if (ttl_ms > 0) {
+            shard.wheel.schedule(node, expireTick(node->second.expire_at));
+        }
+        if (value != nullptr) {
+            value->assign(node->second.data, node->second.size);
+        }
+        if (StoreJournal* log = journal.load(std::memory_order_acquire)) {
+            log->logSet(key, std::string_view(node->second.data, node->second.size), ttl_ms);
+        }
+        return true;
+    }
+
+    // tombstone 为 false 时即使在记录删除也不留墓碑（如迁出不再属于本节点的key）
+    bool erase(const std::string& key, bool tombstone = true) {
+        Shard& shard = shardFor(key);
+        std::unique_lock<std::shared_mutex> lock(shard.mutex, std::defer_lock);
+        acquire(lock);
+        if (tombstone && recording_deletes.load(std::memory_order_relaxed)) {
+            shard.tombstones.insert(key);
+        }
+        auto it = shard.map.find(key);
+        if (it == shard.map.end()) {
+            return false;
+        }
+        bool expired = isExpired(it->second);
+        removeEntry(shard, it);
+        if (expired) {
+            return false;
+        }
+        if (StoreJournal* log = journal.load(std::memory_order_acquire)) {
+            log->logDelete(key);
+        }
+        return true;
+    }
+
+    size_t size() const {
+        size_t total = 0;
+        for (size_t i = 0; i <= shard_mask; ++i) {
+            std::shared_lock<std::shared_mutex> lock(shards[i].mutex);
+            total += shards[i].map.size();
+        }
+        return total;
+    }
+
+    // 把分段依次分给 partitions 个分区，返回key所在的分区；同一分段的key总在同一分区
+    size_t partitionOf(const std::string& key, size_t partitions) const {
+        return shardIndex(key) % partitions;
+    }
+
+    size_t shardCount() const {
+        return shard_mask + 1;
+    }
+
+    // 一个分段中未过期key的快照，只在复制期间持有该分段的读锁。
+    // 用于后台遍历整个存储（如数据迁移），遍历期间其他分段不受影响
+    std::vector<std::string> keys(size_t shard_index) const {
+        const Shard& shard = shards[shard_index];
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        std::vector<std::string> result;
+        result.reserve(shard.map.size());
+        for (const auto& item : shard.map) {
+            if (!isExpired(item.second)) {
+                result.push_back(item.first);
+            }
+        }
+        return result;
+    }
+
+    // 分批遍历一个分段：从位置 cursor 开始检查最多 limit 个槽位，把其中未过期的key追加到 out，
+    // 返回下一批的起始位置，遍历完时返回 0。按CLOCK环的槽位遍历，槽位不随哈希表扩容变化，
+    // 遍历期间一直存在的key恰好返回一次，期间写入或删除的key可能返回也可能不返回。每批只短暂持有该分段的读锁
+    size_t scan(size_t shard_index, size_t cursor, size_t limit, std::vector<std::string>& out) const {
+        const Shard& shard = shards[shard_index];
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        const auto& slots = shard.ring.slots;
+        for (size_t examined = 0; cursor < slots.size() && examined < limit; ++examined) {
+            const Node* node = slots[cursor++];
+            if (node != nullptr && !isExpired(node->second)) {
+                out.push_back(node->first);
+            }
+        }
+        return cursor < slots.size() ? cursor : 0;
+    }
+
+    Stats stats() const {
+        Stats s;
+        s.keys = size();
+        s.resident_bytes = resident_bytes.load(std::memory_order_relaxed);
+        s.max_bytes = max_bytes;
+        s.evictions = evictions.load(std::memory_order_relaxed);
+        s.expirations = expirations.load(std::memory_order_relaxed);
+        return s;
+    }
+
+    // get/set/erase 等待分段锁的耗时分布（纳秒），只包含没能立即拿到锁的情况
+    metrics::Histogram::Snapshot lockWait() const {
+        return lock_wait.snapshot();
+    }
+
+    // 推进各分段的时间轮并删除到期条目，由后台线程每隔 EXPIRE_TICK_MS 调用一次。
+    // 逐个分段加锁，且每次持锁最多删除 EXPIRE_BATCH 个条目，不会长时间阻塞读写
+    size_t expire() {
+        int64_t now = nowMs();
+        int64_t now_tick = now / EXPIRE_TICK_MS;
+        size_t removed = 0;
+        for (size_t i = 0; i <= shard_mask; ++i) {
+            Shard& shard = shards[i];
+            bool more = true;
+            while (more) {
+                std::unique_lock<std::shared_mutex> lock(shard.mutex);
+                shard.wheel.advance(now_tick);
+                size_t batch = 0;
+                // 到期 tick 向上取整，进入 due 的条目一定已经过期
+                while (shard.wheel.due.head != nullptr && batch < EXPIRE_BATCH) {
+                    removeEntry(shard, shard.map.find(shard.wheel.due.head->first));
+                    ++batch;
+                }
+                more = shard.wheel.due.head != nullptr;
+                removed += batch;
+            }
+        }
+        expirations.fetch_add(removed, std::memory_order_relaxed);
+        return removed;
+    }
+
+private:
+    struct Entry;
+    using Map = std::unordered_map<std::string, Entry>;
+    using Node = Map::value_type;
+
+    // 时间轮槽位上的侵入式双向链表
+    struct TimerList {
+        Node* head = nullptr;
+    };
+
+    struct Entry {
+        char* data = nullptr;       // slab中的序列化值
+        uint32_t size = 0;
+        uint8_t size_class = SlabAllocator::LARGE;
+        size_t charge = 0;          // 该条目计入内存上限的字节数
+        uint32_t slot = 0;          // 在 CLOCK 环中的位置
+        int64_t expire_at = 0;      // 过期时间（nowMs 基准），0 表示永不过期
+        TimerList* timer_list = nullptr;
+        Node* timer_prev = nullptr;
+        Node* timer_next = nullptr;
+        mutable std::atomic<bool> referenced{true};
+    };
+
+    // 分层时间轮：4层 x 64槽，最底层一格 EXPIRE_TICK_MS 毫秒，约覆盖19天，更远的放入 overflow。
+    // 条目按到期 tick 与当前 tick 最高的不同位所在层挂到对应槽上，
+    // 低层转满一圈时把上一层对应槽的条目重新分配到更低层（级联），到达最底层即为到期
+    struct TimerWheel {
+        static constexpr int LEVELS = 4;
+        static constexpr int SLOT_BITS = 6;
+        static constexpr int64_t SLOTS = 1 << SLOT_BITS;
+
+        TimerList slots[LEVELS][SLOTS];
+        TimerList overflow;
+        TimerList due;              // 已到期、等待删除
+        int64_t current_tick = 0;
+
+        static void link(TimerList& list, Node* node) {
+            Entry& entry = node->second;
+            entry.timer_list = &list;
+            entry.timer_prev = nullptr;
+            entry.timer_next = list.head;
+            if (list.head != nullptr) list.head->second.timer_prev = node;
+            list.head = node;
+        }
+
+        static void unlink(Node* node) {
+            Entry& entry = node->second;
+            if (entry.timer_list == nullptr) return;
+            if (entry.timer_prev != nullptr) {
+                entry.timer_prev->second.timer_next = entry.timer_next;
+            } else {
+                entry.timer_list->head = entry.timer_next;
+            }
+            if (entry.timer_next != nullptr) entry.timer_next->second.timer_prev = entry.timer_prev;
+            entry.timer_list = nullptr;
+            entry.timer_prev = nullptr;
+            entry.timer_next = nullptr;
+        }
+
+        void schedule(Node* node, int64_t expire_tick) {
+            if (expire_tick <= current_tick) {
+                link(due, node);
+                return;
+            }
+            uint64_t diff = static_cast<uint64_t>(expire_tick ^ current_tick);
+            for (int level = 0; level < LEVELS; ++level) {
+                if (diff < (1ULL << (SLOT_BITS * (level + 1)))) {
+                    link(slots[level][(expire_tick >> (SLOT_BITS * level)) & (SLOTS - 1)], node);
+                    return;
+                }
+            }
+            link(overflow, node);
+        }
+
+        // 把 list 上的条目全部按到期时间重新挂载
+        void reschedule(TimerList& list) {
+            Node* node = list.head;
+            list.head = nullptr;
+            while (node != nullptr) {
+                Node* next = node->second.timer_next;
+                node->second.timer_list = nullptr;
+                schedule(node, expireTick(node->second.expire_at));
+                node = next;
+            }
+        }
+
+        void advance(int64_t now_tick) {
+            while (current_tick < now_tick) {
+                ++current_tick;
+                for (int level = 1; level < LEVELS; ++level) {
+                    int64_t low_mask = (1LL << (SLOT_BITS * level)) - 1;
+                    if ((current_tick & low_mask) != 0) break;
+                    reschedule(slots[level][(current_tick >> (SLOT_BITS * level)) & (SLOTS - 1)]);
+                    if (level == LEVELS - 1 && (current_tick & ((1LL << (SLOT_BITS * LEVELS)) - 1)) == 0) {
+                        reschedule(overflow);
+                    }
+                }
+                reschedule(slots[0][current_tick & (SLOTS - 1)]);
+            }
+        }
+    };
+
+    // CLOCK 环：哈希表节点地址在rehash时保持不变，可以直接保存指针。
+    // 删除留下的空槽放入空闲列表复用，插入、删除、淘汰都是 O(1) 均摊
+    struct ClockRing {
+        std::vector<Node*> slots;
+        std::vector<uint32_t> free_slots;
+        size_t hand = 0;
+
+        uint32_t acquire(Node* node) {
+            if (!free_slots.empty()) {
+                uint32_t slot = free_slots.back();
+                free_slots.pop_back();
+                slots[slot] = node;
+                return slot;
+            }
+            slots.push_back(node);
+            return static_cast<uint32_t>(slots.size() - 1);
+        }
+
+        void release(uint32_t slot) {
+            slots[slot] = nullptr;
+            free_slots.push_back(slot);
+        }
+
+        // 转动指针：访问位为1的清零后跳过，遇到为0的即为淘汰对象（protect 除外）
+        Node* victim(const Node* protect) {
+            size_t limit = slots.size() * 2 + 1;
+            for (size_t step = 0; step < limit && !slots.empty(); ++step) {
+                if (hand >= slots.size()) hand = 0;
+                Node* node = slots[hand++];
+                if (node == nullptr || node == protect) continue;
+                if (node->second.referenced.load(std::memory_order_relaxed)) {
+                    node->second.referenced.store(false, std::memory_order_relaxed);
+                    continue;
+                }
+                return node;
+            }
+            return nullptr;
+        }
+    };
+
+    // 按缓存行对齐，避免相邻分段的锁互相伪共享
+    struct alignas(64) Shard {
+        mutable std::shared_mutex mutex;
+        Map map;
+        ClockRing ring;
+        TimerWheel wheel;
+        SlabAllocator slab;
+        std::unordered_set<std::string> tombstones;
+
+        ~Shard() {
+            for (auto& item : map) {
+                slab.deallocate(item.second.data, item.second.size_class);
+            }
+        }
+    };
+
+    std::unique_ptr<Shard[]> shards;
+    size_t shard_mask = 0;
+    size_t max_bytes = 0;
+    std::atomic<size_t> resident_bytes{0};
+    mutable metrics::Histogram lock_wait;
+    std::atomic<uint64_t> evictions{0};
+    std::atomic<uint64_t> expirations{0};
+    std::atomic<size_t> reclaim_cursor{0};
+    std::atomic<StoreJournal*> journal{nullptr};
+    std::atomic<bool> recording_deletes{false};
+
+    // 用乘法散列打散后取高位，与分段内哈希表使用的低位错开
+    size_t shardIndex(const std::string& key) const {
+        uint64_t h = std::hash<std::string>{}(key);
+        h *= 0x9E3779B97F4A7C15ULL;
+        return static_cast<size_t>(h >> 32) & shard_mask;
+    }
+
+    Shard& shardFor(const std::string& key) {
+        return shards[shardIndex(key)];
+    }
+
+    const Shard& shardFor(const std::string& key) const {
+        return shards[shardIndex(key)];
+    }
+
+    // 先 try_lock，拿不到时才读时钟并计入等待耗时，无竞争的路径没有额外开销
+    template <typename Lock>
+    void acquire(Lock& lock) const {
+        if (lock.try_lock()) return;
+        auto start = std::chrono::steady_clock::now();
+        lock.lock();
+        lock_wait.record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count()));
+    }
+
+    static size_t heapBytes(const std::string& s) {
+        // 超出SSO缓冲区的字符串才有堆分配
+        return s.capacity() > 15 ? s.capacity() + 1 : 0;
+    }
+
+    // 条目总开销：哈希表节点（next指针 + 缓存的哈希值 + key/Entry）+ 桶指针 + CLOCK槽位 + 值所在的块
+    static size_t entryCharge(const std::string& key, size_t value_size) {
+        return sizeof(Node) + 2 * sizeof(void*) + sizeof(size_t) + sizeof(Node*) +
+               heapBytes(key) + SlabAllocator::chunkSize(value_size);
+    }
+
+    static void storeValue(Shard& shard, Entry& entry, std::string_view value) {
+        if (entry.data == nullptr || SlabAllocator::chunkSize(value.size()) != SlabAllocator::chunkSize(entry.size) ||
+            entry.size_class == SlabAllocator::LARGE) {
+            if (entry.data != nullptr) {
+                shard.slab.deallocate(entry.data, entry.size_class);
+            }
+            entry.data = shard.slab.allocate(value.size(), entry.size_class);
+        }
+        memcpy(entry.data, value.data(), value.size());
+        entry.size = static_cast<uint32_t>(value.size());
+    }
+
+    static bool isExpired(const Entry& entry) {
+        return entry.expire_at != 0 && entry.expire_at <= nowMs();
+    }
+
+    // 向上取整，保证时间轮不会提前回收
+    static int64_t expireTick(int64_t expire_at) {
+        return (expire_at + EXPIRE_TICK_MS - 1) / EXPIRE_TICK_MS;
+    }
+
+    // set 和 setIfAbsent 的实现，if_absent 时在同一次持锁内检查key和墓碑，不会与并发的写入、删除交错
+    bool write(const std::string& key, std::string_view value, int64_t ttl_ms, bool if_absent) {
+        size_t charge = entryCharge(key, value.size());
+        if (max_bytes > 0 && charge > max_bytes) {
+            return false;
+        }
+
+        size_t index = shardIndex(key);
+        Shard& shard = shards[index];
+        std::unique_lock<std::shared_mutex> lock(shard.mutex, std::defer_lock);
+        acquire(lock);
+        auto it = shard.map.find(key);
+        if (if_absent && ((it != shard.map.end() && !isExpired(it->second)) || shard.tombstones.count(key))) {
+            return true;
+        }
+        Node* written;
+        if (it != shard.map.end()) {
+            // 覆盖写：同一级别的块原地复用，只调整计数
+            Entry& entry = it->second;
+            storeValue(shard, entry, value);
+            resident_bytes.fetch_add(charge, std::memory_order_relaxed);
+            resident_bytes.fetch_sub(entry.charge, std::memory_order_relaxed);
+            entry.charge = charge;
+            entry.referenced.store(true, std::memory_order_relaxed);
+            TimerWheel::unlink(&*it);
+            written = &*it;
+        } else {
+            auto result = shard.map.try_emplace(key);
+            Entry& entry = result.first->second;
+            storeValue(shard, entry, value);
+            entry.charge = charge;
+            entry.slot = shard.ring.acquire(&*result.first);
+            resident_bytes.fetch_add(charge, std::memory_order_relaxed);
+            written = &*result.first;
+        }
+        written->second.expire_at = ttl_ms > 0 ? nowMs() + ttl_ms : 0;
+        if (ttl_ms > 0) {
+            shard.wheel.schedule(written, expireTick(written->second.expire_at));
+        }
+        if (StoreJournal* log = journal.load(std::memory_order_acquire)) {
+            log->logSet(key, value, ttl_ms);
+        }
+        reclaim(index, shard, written);
+        return true;
+    }
+
+    void removeEntry(Shard& shard, Map::iterator it) {
+        TimerWheel::unlink(&*it);
+        shard.slab.deallocate(it->second.data, it->second.size_class);
+        resident_bytes.fetch_sub(it->second.charge, std::memory_order_relaxed);
+        shard.ring.release(it->second.slot);
+        shard.map.erase(it);
+    }
+
+    bool evictOne(Shard& shard, const Node* protect = nullptr) {
+        Node* node = shard.ring.victim(protect);
+        if (node == nullptr) {
+            return false;
+        }
+        removeEntry(shard, shard.map.find(node->first));
+        evictions.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // 超过上限时先在当前分段（已持有锁）淘汰，刚写入的条目不参与淘汰，不够再轮流 try_lock 其他分段，
+    // 持锁等待其他分段可能死锁，所以拿不到锁的分段直接跳过
+    void reclaim(size_t index, Shard& shard, const Node* written) {
+        if (max_bytes == 0) return;
+        while (resident_bytes.load(std::memory_order_relaxed) > max_bytes) {
+            if (!evictOne(shard, written)) break;
+        }
+        size_t count = shard_mask + 1;
+        for (size_t attempt = 0; attempt < count && resident_bytes.load(std::memory_order_relaxed) > max_bytes; ++attempt) {
+            size_t other = reclaim_cursor.fetch_add(1, std::memory_order_relaxed) & shard_mask;
+            if (other == index) continue;
+            Shard& victim_shard = shards[other];
+            std::unique_lock<std::shared_mutex> lock(victim_shard.mutex, std::try_to_lock);
+            if (!lock.owns_lock()) continue;
+            while (resident_bytes.load(std::memory_order_relaxed) > max_bytes) {
+                if (!evictOne(victim_shard)) break;
+            }
+        }
+    }
+};
+
+// Count-Min Sketch：用 depth 行、每行 width 个计数器估计每个key的访问次数（只会高估，不会低估）。
+// 累计计数达到 width * 10 次后所有计数器减半，估计值反映的是最近一段时间的访问热度。
+// 计数器为无锁的原子变量，并发更新时允许少量误差
+class CountMinSketch {
+public:
+    explicit CountMinSketch(size_t width = 4096, size_t depth = 4)
+        : width_mask(roundUpPow2(width) - 1), depth(depth),
+          counters((width_mask + 1) * depth), reset_interval((width_mask + 1) * 10) {}
+
+    // 记录一次访问，返回记录后的估计值
+    uint32_t increment(const std::string& key) {
+        uint64_t h = std::hash<std::string>{}(key);
+        uint32_t estimate = UINT32_MAX;
+        for (size_t row = 0; row < depth; ++row) {
+            uint32_t value = counters[index(h, row)].fetch_add(1, std::memory_order_relaxed) + 1;
+            estimate = std::min(estimate, value);
+        }
+        if (additions.fetch_add(1, std::memory_order_relaxed) + 1 >= reset_interval) {
+            age();
+        }
+        return estimate;
+    }
+
+    uint32_t estimate(const std::string& key) const {
+        uint64_t h = std::hash<std::string>{}(key);
+        uint32_t estimate = UINT32_MAX;
+        for (size_t row = 0; row < depth; ++row) {
+            estimate = std::min(estimate, counters[index(h, row)].load(std::memory_order_relaxed));
+        }
+        return estimate;
+    }
+
+private:
+    size_t width_mask;
+    size_t depth;
+    std::vector<std::atomic<uint32_t>> counters;
+    uint64_t reset_interval;
+    std::atomic<uint64_t> additions{0};
+    std::atomic<bool> aging{false};
+
+    static size_t roundUpPow2(size_t n) {
+        size_t p = 1;
+        while (p < n) p <<= 1;
+        return p;
+    }
+
+    // 每行用不同的哈希：h1 + row * h2（双重哈希）
+    size_t index(uint64_t h, size_t row) const {
+        uint64_t mixed = h * 0x9E3779B97F4A7C15ULL;
+        uint32_t h1 = static_cast<uint32_t>(mixed >> 32);
+        uint32_t h2 = static_cast<uint32_t>(mixed) | 1;
+        return row * (width_mask + 1) + ((h1 + row * h2) & width_mask);
+    }
+
+    // 所有计数减半，同一时间只有一个线程执行
+    void age() {
+        bool expected = false;
+        if (!aging.compare_exchange_strong(expected, true)) {
+            return;
+        }
+        for (auto& counter : counters) {
+            counter.store(counter.load(std::memory_order_relaxed) / 2, std::memory_order_relaxed);
+        }
+        additions.store(0, std::memory_order_relaxed);
+        aging.store(false, std::memory_order_release);
+    }
+};
+
+#endif // CACHE_STORE_H
@@ -2,102 +2,1360 @@
 #define HTTPLIB_H
 
 #include <string>
+#include <string_view>
 #include <map>
 #include <vector>
+#include <deque>
+#include <algorithm>
+#include <memory>
 #include <functional>
 #include <regex>
 #include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
 #include <chrono>
 #include <sstream>
 #include <iostream>
 #include <cstring>
+#include <cerrno>
+#include <cstdint>
+#include <charconv>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <poll.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
 #include <netdb.h>
 
 namespace httplib {
 
+using Params = std::multimap<std::string, std::string>;
+
+namespace detail {
+
+// 大小写不敏感的比较，HTTP头部名称不区分大小写
+struct ci_less {
+    bool operator()(const std::string& a, const std::string& b) const {
+        return std::lexicographical_compare(a.begin(), a.end(), b.begin(), b.end(),
+            [](unsigned char x, unsigned char y) { return tolower(x) < tolower(y); });
+    }
+};
+
+inline int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// 百分号解码，查询参数中的 '+' 表示空格
+inline std::string decode_url(const char* begin, const char* end, bool plus_as_space) {
+    std::string result;
+    result.reserve(end - begin);
+    for (const char* p = begin; p < end; ++p) {
+        if (*p == '%' && end - p >= 3 && hex_value(p[1]) >= 0 && hex_value(p[2]) >= 0) {
+            result.push_back(static_cast<char>(hex_value(p[1]) * 16 + hex_value(p[2])));
+            p += 2;
+        } else if (*p == '+' && plus_as_space) {
+            result.push_back(' ');
+        } else {
+            result.push_back(*p);
+        }
+    }
+    return result;
+}
+
+// 解析 a=1&b=2 形式的查询字符串
+inline void parse_query_text(const char* begin, const char* end, Params& params) {
+    const char* p = begin;
+    while (p < end) {
+        const char* amp = static_cast<const char*>(memchr(p, '&', end - p));
+        if (amp == nullptr) amp = end;
+        if (amp > p) {
+            const char* eq = static_cast<const char*>(memchr(p, '=', amp - p));
+            if (eq == nullptr) {
+                params.emplace(decode_url(p, amp, true), std::string());
+            } else {
+                params.emplace(decode_url(p, eq, true), decode_url(eq + 1, amp, true));
+            }
+        }
+        p = amp + 1;
+    }
+}
+
+inline bool iequals(const char* a, size_t a_len, const char* b) {
+    size_t b_len = strlen(b);
+    if (a_len != b_len) return false;
+    for (size_t i = 0; i < a_len; ++i) {
+        if (tolower(static_cast<unsigned char>(a[i])) != tolower(static_cast<unsigned char>(b[i]))) return false;
+    }
+    return true;
+}
+
+inline bool set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+// 固定大小的工作线程池，handler在这里执行，IO线程不会被业务逻辑阻塞
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t thread_count) {
+        if (thread_count == 0) thread_count = 1;
+        for (size_t i = 0; i < thread_count; ++i) {
+            workers.emplace_back([this]() { worker_loop(); });
+        }
+    }
+
+    ~ThreadPool() {
+        shutdown();
+    }
+
+    void enqueue(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push_back(std::move(task));
+        }
+        cond.notify_one();
+    }
+
+    // 排队的任务已有 max_queued 个时不加入并返回 false（max_queued 为 0 表示不限制）
+    bool try_enqueue(std::function<void()>& task, size_t max_queued) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (max_queued > 0 && tasks.size() >= max_queued) {
+                return false;
+            }
+            tasks.push_back(std::move(task));
+        }
+        cond.notify_one();
+        return true;
+    }
+
+    void shutdown() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        cond.notify_all();
+        for (auto& worker : workers) {
+            if (worker.joinable()) worker.join();
+        }
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable cond;
+    bool stopping = false;
+
+    void worker_loop() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cond.wait(lock, [this]() { return stopping || !tasks.empty(); });
+                if (stopping && tasks.empty()) return;
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+};
+
+// epoll事件循环：fd事件和其他线程post过来的任务都在同一个线程上执行
+// 单生产者单消费者的有界无锁队列：每一端各缓存一份对方的位置，只在看起来满/空时才读对方的原子变量
+template <typename T>
+class SpscQueue {
+public:
+    explicit SpscQueue(size_t capacity) {
+        size_t size = 1;
+        while (size < capacity) size <<= 1;
+        mask = size - 1;
+        slots.reset(new T[size]);
+    }
+
+    // 队列满时返回 false，value 保持不变
+    bool try_push(T&& value) {
+        size_t tail_pos = tail.load(std::memory_order_relaxed);
+        if (tail_pos - head_cache > mask) {
+            head_cache = head.load(std::memory_order_acquire);
+            if (tail_pos - head_cache > mask) return false;
+        }
+        slots[tail_pos & mask] = std::move(value);
+        tail.store(tail_pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool try_pop(T& value) {
+        size_t head_pos = head.load(std::memory_order_relaxed);
+        if (head_pos == tail_cache) {
+            tail_cache = tail.load(std::memory_order_acquire);
+            if (head_pos == tail_cache) return false;
+        }
+        value = std::move(slots[head_pos & mask]);
+        slots[head_pos & mask] = T();
+        head.store(head_pos + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    std::unique_ptr<T[]> slots;
+    size_t mask = 0;
+    alignas(64) std::atomic<size_t> head{0};  // 消费者写
+    size_t tail_cache = 0;                    // 消费者缓存的 tail
+    alignas(64) std::atomic<size_t> tail{0};  // 生产者写
+    size_t head_cache = 0;                    // 生产者缓存的 head
+};
+
+class EventLoop {
+public:
+    using EventHandler = std::function<void(uint32_t)>;
+
+    EventLoop() {
+        epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        struct epoll_event ev {};
+        ev.events = EPOLLIN;
+        ev.data.ptr = nullptr;  // nullptr 表示唤醒事件
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wakeup_fd, &ev);
+    }
+
+    ~EventLoop() {
+        close(epoll_fd);
+        close(wakeup_fd);
+    }
+
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    // handler 必须存活到 remove 之后（关闭的对象用 release_later 延迟释放）
+    bool add(int fd, uint32_t events, EventHandler* handler) {
+        struct epoll_event ev {};
+        ev.events = events;
+        ev.data.ptr = handler;
+        return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) == 0;
+    }
+
+    void remove(int fd) {
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+    }
+
+    // 线程安全：把任务投递到事件循环线程执行
+    void post(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(pending_mutex);
+            pending.push_back(std::move(task));
+        }
+        wake();
+    }
+
+    // 只能在事件循环线程中调用：当前这批事件处理完后执行，不需要唤醒
+    void defer(std::function<void()> task) {
+        deferred.push_back(std::move(task));
+    }
+
+    // 线程安全：唤醒阻塞在 epoll_wait 中的事件循环
+    void wake() {
+        uint64_t one = 1;
+        ssize_t n = write(wakeup_fd, &one, sizeof(one));
+        (void)n;
+    }
+
+    // 每轮事件处理完后调用，用于取出其他线程经无锁队列投递的任务
+    void set_drain(std::function<void()> callback) {
+        drain = std::move(callback);
+    }
+
+    // 当前这批事件处理完之后再释放，避免同一批里后续事件访问已销毁的对象
+    void release_later(std::shared_ptr<void> obj) {
+        graveyard.push_back(std::move(obj));
+    }
+
+    // 设置周期任务（在事件循环线程执行），用于空闲连接超时等
+    void set_periodic(int interval_ms, std::function<void()> callback) {
+        periodic_interval_ms = interval_ms;
+        periodic = std::move(callback);
+    }
+
+    void run() {
+        running = true;
+        std::vector<struct epoll_event> events(256);
+        auto next_periodic = std::chrono::steady_clock::now() + std::chrono::milliseconds(periodic_interval_ms);
+        while (running) {
+            int timeout = -1;
+            if (periodic) {
+                auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    next_periodic - std::chrono::steady_clock::now()).count();
+                timeout = remaining > 0 ? static_cast<int>(remaining) : 0;
+            }
+            int n = epoll_wait(epoll_fd, events.data(), static_cast<int>(events.size()), timeout);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            for (int i = 0; i < n; ++i) {
+                auto* handler = static_cast<EventHandler*>(events[i].data.ptr);
+                if (handler == nullptr) {
+                    uint64_t value;
+                    while (read(wakeup_fd, &value, sizeof(value)) > 0) {}
+                    continue;
+                }
+                (*handler)(events[i].events);
+            }
+            if (drain) drain();
+            run_pending();
+            run_deferred();
+            if (periodic && std::chrono::steady_clock::now() >= next_periodic) {
+                periodic();
+                next_periodic = std::chrono::steady_clock::now() + std::chrono::milliseconds(periodic_interval_ms);
+            }
+            graveyard.clear();
+        }
+    }
+
+    void stop() {
+        post([this]() { running = false; });
+    }
+
+private:
+    int epoll_fd = -1;
+    int wakeup_fd = -1;
+    bool running = false;
+    int periodic_interval_ms = 1000;
+    std::function<void()> periodic;
+    std::mutex pending_mutex;
+    std::vector<std::function<void()>> pending;
+    std::vector<std::function<void()>> deferred;
+    std::function<void()> drain;
+    std::vector<std::shared_ptr<void>> graveyard;
+
+    // 执行期间新加入的任务也在这一轮执行
+    void run_deferred() {
+        while (!deferred.empty()) {
+            std::vector<std::function<void()>> tasks;
+            tasks.swap(deferred);
+            for (auto& task : tasks) {
+                task();
+            }
+        }
+    }
+
+    void run_pending() {
+        std::vector<std::function<void()>> tasks;
+        {
+            std::lock_guard<std::mutex> lock(pending_mutex);
+            tasks.swap(pending);
+        }
+        for (auto& task : tasks) {
+            task();
+        }
+    }
+};
+
+} // namespace detail
+
+using Headers = std::map<std::string, std::string, detail::ci_less>;
+
 struct Request {
     std::string method;
-    std::string path;
-    std::map<std::string, std::string> headers;
+    std::string path;      // 不含查询字符串
+    std::string version;
+    Headers headers;
+    Params params;         // 解码后的查询参数
     std::string body;
     std::vector<std::string> matches;
+    std::string_view route;  // 匹配到的路由模式，指向路由表，服务器运行期间有效
+    // 客户端时间预算用完的时刻（见 Server::set_timeout_header），没有预算时为最大值
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+
+    bool has_param(const std::string& key) const {
+        return params.find(key) != params.end();
+    }
+
+    std::string get_param_value(const std::string& key) const {
+        auto it = params.find(key);
+        return it != params.end() ? it->second : std::string();
+    }
+};
+
+struct Response {
+    int status = 200;
+    Headers headers;
+    std::string body;
+    // 流式正文（分块传输编码），设置后忽略 body。在IO线程中调用，发送缓冲区清空时取下一块：
+    // 把数据追加到 chunk，返回 false 表示这是最后一块。不能阻塞
+    std::function<bool(std::string& chunk)> content_provider;
+    
+    void set_header(const std::string& key, const std::string& value) {
+        headers[key] = value;
+    }
+
+    void set_content_provider(std::function<bool(std::string& chunk)> provider) {
+        content_provider = std::move(provider);
+    }
+};
+
+// 流式接收请求体（见 Server::PostStream），所有方法都在IO线程中调用，不能阻塞
+class BodyReader {
+public:
+    virtual ~BodyReader() = default;
+    // 收到一段正文，data 只在调用期间有效。返回 false 时暂停接收，直到调用处理函数拿到的 resume
+    virtual bool write(std::string_view data) = 0;
+    // 正文已全部收到：填写响应后调用 done（可以在任意线程中），必须恰好调用一次
+    virtual void finish(Response& res, std::function<void()> done) = 0;
 };
 
-struct Response {
-    int status = 200;
-    std::map<std::string, std::string> headers;
-    std::string body;
-    
-    void set_header(const std::string& key, const std::string& value) {
-        headers[key] = value;
+// 增量式HTTP/1.1请求解析器：请求可以分多次到达，同一缓冲区里也可以有多个（流水线）请求
+class RequestParser {
+public:
+    enum class Result {
+        Incomplete,
+        Complete,
+        BadRequest,
+        PayloadTooLarge
+    };
+
+    static constexpr size_t DEFAULT_MAX_HEADER_SIZE = 64 * 1024;
+
+    explicit RequestParser(size_t max_header_size = DEFAULT_MAX_HEADER_SIZE, size_t max_body_size = 64 * 1024 * 1024)
+        : max_header_size(max_header_size), max_body_size(max_body_size) {}
+
+    void set_max_body_size(size_t size) {
+        max_body_size = size;
+    }
+
+    // 解析 data 开头的一个请求，同一个请求的多次调用需传入同一个 req。
+    // Complete 时 consumed 为该请求占用的字节数，之后的数据属于下一个请求
+    Result parse(const char* data, size_t size, Request& req, size_t& consumed) {
+        Result result = parse_head_only(data, size, req, consumed);
+        consumed = 0;
+        if (result != Result::Complete) {
+            return result;
+        }
+        if (content_length > max_body_size) {
+            reset();
+            return Result::PayloadTooLarge;
+        }
+        if (size - header_size < content_length) {
+            return Result::Incomplete;
+        }
+        req.body.assign(data + header_size, content_length);
+        consumed = header_size + content_length;
+        reset();
+        return Result::Complete;
+    }
+
+    // 只解析头部，不读取正文也不检查正文长度上限（头部已解析过时直接返回）。
+    // Complete 时 consumed 为头部长度，正文长度见 body_length()；之后可以继续调用 parse 读取正文，
+    // 也可以由调用方自行读取正文后调用 reset
+    Result parse_head_only(const char* data, size_t size, Request& req, size_t& consumed) {
+        consumed = 0;
+        if (header_size == 0) {
+            // 从上次扫描的位置继续查找头部结束符，回退3字节以覆盖跨批次的 \r\n\r\n
+            size_t from = scanned > 3 ? scanned - 3 : 0;
+            const void* end = size > from ? memmem(data + from, size - from, "\r\n\r\n", 4) : nullptr;
+            if (end == nullptr) {
+                scanned = size;
+                return size > max_header_size ? Result::BadRequest : Result::Incomplete;
+            }
+            header_size = static_cast<const char*>(end) - data + 4;
+            Result result = parse_head(data, header_size, req);
+            if (result != Result::Complete) {
+                reset();
+                return result;
+            }
+        }
+        consumed = header_size;
+        return Result::Complete;
+    }
+
+    // 最近解析的头部中的 Content-Length
+    size_t body_length() const {
+        return content_length;
+    }
+
+    // 最近一个完整请求是否要求保持连接
+    bool keep_alive() const {
+        return keep_alive_;
+    }
+
+    void reset() {
+        scanned = 0;
+        header_size = 0;
+        content_length = 0;
+    }
+
+private:
+    size_t max_header_size;
+    size_t max_body_size;
+    size_t scanned = 0;         // 已确认不含头部结束符的字节数
+    size_t header_size = 0;     // 头部（含结束空行）长度，0 表示头部尚未收全
+    size_t content_length = 0;
+    bool keep_alive_ = true;
+
+    static void trim(const char*& begin, const char*& end) {
+        while (begin < end && (*begin == ' ' || *begin == '\t')) ++begin;
+        while (end > begin && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r')) --end;
+    }
+
+    Result parse_head(const char* data, size_t size, Request& req) {
+        const char* p = data;
+        const char* end = data + size - 4;
+        const char* line_end = static_cast<const char*>(memchr(p, '\n', size - 2));
+
+        // 请求行: METHOD SP TARGET SP VERSION
+        const char* request_line_end = line_end ? line_end : end;
+        if (request_line_end > p && request_line_end[-1] == '\r') --request_line_end;
+        const char* sp1 = static_cast<const char*>(memchr(p, ' ', request_line_end - p));
+        if (sp1 == nullptr || sp1 == p) return Result::BadRequest;
+        const char* sp2 = static_cast<const char*>(memchr(sp1 + 1, ' ', request_line_end - sp1 - 1));
+        if (sp2 == nullptr || sp2 == sp1 + 1) return Result::BadRequest;
+        req.method.assign(p, sp1);
+        const char* query = static_cast<const char*>(memchr(sp1 + 1, '?', sp2 - sp1 - 1));
+        if (query != nullptr) {
+            req.path.assign(sp1 + 1, query);
+            detail::parse_query_text(query + 1, sp2, req.params);
+        } else {
+            req.path.assign(sp1 + 1, sp2);
+        }
+        req.version.assign(sp2 + 1, request_line_end);
+        if (req.version.compare(0, 7, "HTTP/1.") != 0) return Result::BadRequest;
+
+        bool http10 = req.version == "HTTP/1.0";
+        keep_alive_ = !http10;
+        content_length = 0;
+
+        p = line_end ? line_end + 1 : end;
+        while (p < end) {
+            const char* eol = static_cast<const char*>(memchr(p, '\n', end - p));
+            if (eol == nullptr) eol = end;
+            const char* colon = static_cast<const char*>(memchr(p, ':', eol - p));
+            if (colon != nullptr) {
+                const char* key_begin = p;
+                const char* key_end = colon;
+                const char* value_begin = colon + 1;
+                const char* value_end = eol;
+                trim(key_begin, key_end);
+                trim(value_begin, value_end);
+                size_t key_len = key_end - key_begin;
+
+                if (detail::iequals(key_begin, key_len, "Content-Length")) {
+                    if (value_begin == value_end) return Result::BadRequest;
+                    size_t length = 0;
+                    for (const char* c = value_begin; c < value_end; ++c) {
+                        if (*c < '0' || *c > '9') return Result::BadRequest;
+                        if (length > (SIZE_MAX - (*c - '0')) / 10) return Result::PayloadTooLarge;
+                        length = length * 10 + (*c - '0');
+                    }
+                    content_length = length;
+                } else if (detail::iequals(key_begin, key_len, "Transfer-Encoding")) {
+                    // 不支持分块上传
+                    return Result::BadRequest;
+                } else if (detail::iequals(key_begin, key_len, "Connection")) {
+                    std::string value(value_begin, value_end);
+                    std::transform(value.begin(), value.end(), value.begin(), ::tolower);
+                    if (value.find("close") != std::string::npos) {
+                        keep_alive_ = false;
+                    } else if (value.find("keep-alive") != std::string::npos) {
+                        keep_alive_ = true;
+                    }
+                }
+                req.headers[std::string(key_begin, key_end)] = std::string(value_begin, value_end);
+            }
+            p = eol + 1;
+        }
+        return Result::Complete;
+    }
+};
+
+class Server {
+public:
+    enum class HandlerResponse {
+        Handled,
+        Unhandled
+    };
+
+    using Handler = std::function<void(const Request&, Response&)>;
+    // 异步处理函数：返回时请求可以仍在进行（如等待其他节点的响应），处理完后调用 done 发送响应。
+    // done 可以在任意线程中调用，且必须恰好调用一次；调用之前 req 和 res 一直有效。
+    // 异步处理函数不能阻塞：每核模式下它们直接在IO线程上执行
+    using Done = std::function<void()>;
+    using AsyncHandler = std::function<void(const Request&, Response&, Done)>;
+    using PreRoutingHandler = std::function<HandlerResponse(const Request&, Response&)>;
+    // 流式请求体处理函数：收到头部后在IO线程中调用，返回接收正文的 BodyReader。
+    // BodyReader 暂停接收后调用 resume（可以在任意线程中）继续。返回 nullptr 时直接发送 res 并关闭连接
+    using StreamHandler = std::function<std::shared_ptr<BodyReader>(const Request&, Response&, std::function<void()> resume)>;
+    // 每个请求处理完后在工作线程中调用，参数为请求、响应和处理耗时
+    using Logger = std::function<void(const Request&, const Response&, std::chrono::nanoseconds)>;
+
+private:
+    struct Exchange;
+
+    struct Connection {
+        int fd = -1;
+        std::string in;    // 已读取但尚未处理的数据（可能包含多个流水线请求）
+        size_t in_offset = 0;
+        std::string out;   // 待发送的状态行和头部，各响应复用同一块缓冲区
+        std::string body;  // 待发送的正文，从响应中移入，不再复制
+        size_t out_offset = 0;
+        size_t body_offset = 0;
+        RequestParser parser;
+        Request pending;   // 正在解析中的请求
+        std::function<bool(std::string&)> provider;  // 正在发送的流式正文
+        std::shared_ptr<Exchange> upload;  // 正文正在流式交给 reader 的请求
+        std::shared_ptr<BodyReader> reader;
+        std::function<void()> upload_done;
+        size_t upload_remaining = 0;
+        bool paused = false;             // reader 要求暂停，不再从socket读取，由TCP流控让客户端等待
+        bool input_full = false;         // 缓冲的输入已达上限，暂停读取直到请求处理掉一部分
+        bool busy = false;               // 请求正在工作线程中处理
+        bool close_after_write = false;  // 当前响应发送完后关闭连接
+        bool peer_closed = false;
+        bool closed = false;
+        std::chrono::steady_clock::time_point last_active;
+        detail::EventLoop::EventHandler on_event;
+    };
+
+    // 每个IO线程一个上下文：事件循环 + 它负责的连接
+    struct IoContext {
+        detail::EventLoop loop;
+        std::map<int, std::shared_ptr<Connection>> connections;
+        detail::EventLoop::EventHandler on_accept;
+        size_t index = 0;
+        int listen_fd = -1;  // 每核模式下各自的 SO_REUSEPORT 监听socket，否则为共享的 server_fd
+        // 每核模式：inbox[i] 为第 i 个IO线程投递给本线程的任务
+        std::vector<std::unique_ptr<detail::SpscQueue<std::function<void()>>>> inbox;
+        std::atomic<bool> notified{false};  // 已有投递方写过 eventfd，本线程取任务前清除
+        // 预留的文件描述符：fd 用尽时先释放它，才能把积压的连接取出来关闭
+        int reserve_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+        bool accept_stalled = false;  // 接受连接出错且没能取完，由周期任务重试
+
+        ~IoContext() {
+            if (reserve_fd >= 0) close(reserve_fd);
+        }
+    };
+
+    // 当前线程是哪个服务器的第几个IO线程，跨线程投递时据此选择无锁队列
+    struct CoreTag {
+        const Server* server = nullptr;
+        size_t core = 0;
+    };
+
+    static CoreTag& core_tag() {
+        static thread_local CoreTag tag;
+        return tag;
+    }
+
+    static constexpr size_t INBOX_CAPACITY = 256;
+    static constexpr size_t CHUNKS_PER_FLUSH = 16;
+
+    // 路由表：注册时编译一次。只由字面量段和 ([^/]+) 捕获段组成的模式放进按方法划分的段前缀树，
+    // 查找耗时与路径长度成正比；其他模式预编译为正则作为兜底。
+    // 多个路由都能匹配时仍以先注册者为准，与逐个扫描的语义一致
+    class Router {
+    public:
+        // nonblocking: 处理函数保证不阻塞，每核模式下直接在IO线程上执行
+        void add(const std::string& method, const std::string& pattern, AsyncHandler handler, bool nonblocking = false) {
+            size_t order = handlers.size();
+            handlers.push_back(std::move(handler));
+            patterns.push_back(pattern);
+            nonblocking_flags.push_back(nonblocking);
+
+            std::vector<std::string> segments;
+            if (!split_pattern(pattern, segments)) {
+                regex_routes[method].push_back({order, std::regex(pattern)});
+                return;
+            }
+            Node* node = &tries[method];
+            for (const auto& segment : segments) {
+                std::unique_ptr<Node>& child = segment == CAPTURE ? node->capture : node->children[segment];
+                if (!child) child.reset(new Node());
+                node = child.get();
+            }
+            if (node->order == NONE) {
+                node->order = order;
+            }
+        }
+
+        // 返回匹配的处理函数，捕获的路径段写入 req.matches；没有匹配时返回 nullptr
+        const AsyncHandler* match(Request& req) const {
+            size_t best = NONE;
+            std::vector<std::string_view> best_captures;
+
+            auto trie = tries.find(req.method);
+            if (trie != tries.end() && !req.path.empty() && req.path[0] == '/') {
+                std::vector<std::string_view> segments;
+                std::string_view rest(req.path);
+                rest.remove_prefix(1);
+                while (true) {
+                    size_t slash = rest.find('/');
+                    segments.push_back(rest.substr(0, slash));
+                    if (slash == std::string_view::npos) break;
+                    rest.remove_prefix(slash + 1);
+                }
+                std::vector<std::string_view> captures;
+                search(trie->second, segments, 0, captures, best, best_captures);
+            }
+
+            auto regexes = regex_routes.find(req.method);
+            if (regexes != regex_routes.end()) {
+                for (const auto& route : regexes->second) {
+                    if (route.first >= best) break;
+                    std::smatch matches;
+                    if (std::regex_match(req.path, matches, route.second)) {
+                        for (size_t i = 1; i < matches.size(); ++i) {
+                            req.matches.push_back(matches[i].str());
+                        }
+                        req.route = patterns[route.first];
+                        return &handlers[route.first];
+                    }
+                }
+            }
+
+            if (best == NONE) {
+                return nullptr;
+            }
+            for (const auto& capture : best_captures) {
+                req.matches.emplace_back(capture);
+            }
+            req.route = patterns[best];
+            return &handlers[best];
+        }
+
+        bool nonblocking(const AsyncHandler* handler) const {
+            return nonblocking_flags[handler - handlers.data()];
+        }
+
+    private:
+        static constexpr size_t NONE = static_cast<size_t>(-1);
+        static constexpr const char* CAPTURE = "([^/]+)";
+
+        struct Node {
+            size_t order = NONE;  // 在此结束的路由的注册序号
+            std::map<std::string, std::unique_ptr<Node>, std::less<>> children;
+            std::unique_ptr<Node> capture;
+        };
+
+        std::vector<AsyncHandler> handlers;
+        std::vector<std::string> patterns;  // 与 handlers 一一对应，只在 listen 前注册，匹配时不再变化
+        std::vector<bool> nonblocking_flags;
+        std::map<std::string, Node> tries;
+        std::map<std::string, std::vector<std::pair<size_t, std::regex>>> regex_routes;
+
+        // 能放进前缀树的模式拆成路径段，否则返回 false
+        static bool split_pattern(const std::string& pattern, std::vector<std::string>& segments) {
+            if (pattern.empty() || pattern[0] != '/') {
+                return false;
+            }
+            size_t start = 1;
+            while (true) {
+                size_t slash = pattern.find('/', start);
+                std::string segment = pattern.substr(start, slash == std::string::npos ? std::string::npos : slash - start);
+                if (segment != CAPTURE && segment.find_first_of("()[]{}*+?^$|\\") != std::string::npos) {
+                    return false;
+                }
+                segments.push_back(std::move(segment));
+                if (slash == std::string::npos) break;
+                start = slash + 1;
+            }
+            return true;
+        }
+
+        // 字面量段和捕获段都要尝试，保留注册序号最小的匹配
+        void search(const Node& node, const std::vector<std::string_view>& segments, size_t index,
+                    std::vector<std::string_view>& captures, size_t& best,
+                    std::vector<std::string_view>& best_captures) const {
+            if (index == segments.size()) {
+                if (node.order < best) {
+                    best = node.order;
+                    best_captures = captures;
+                }
+                return;
+            }
+            auto it = node.children.find(segments[index]);
+            if (it != node.children.end()) {
+                search(*it->second, segments, index + 1, captures, best, best_captures);
+            }
+            if (node.capture && !segments[index].empty()) {
+                captures.push_back(segments[index]);
+                search(*node.capture, segments, index + 1, captures, best, best_captures);
+                captures.pop_back();
+            }
+        }
+    };
+
+    Router router;
+    std::map<std::string, StreamHandler, std::less<>> stream_routes;  // POST 路径 -> 处理函数，只支持精确匹配
+    PreRoutingHandler pre_routing_handler;
+    std::string default_headers;  // 预先渲染好的 "Name: value\r\n" 行
+    Logger logger;
+    std::atomic<size_t> active_connections{0};
+    std::atomic<uint64_t> rejected_requests{0};
+    std::string timeout_header;
+
+    size_t thread_pool_size = 16;
+    size_t io_thread_count = 1;
+    bool shard_per_core = false;
+    int listen_backlog = 1024;
+    int keep_alive_timeout_sec = 60;
+    size_t payload_max_length = 64 * 1024 * 1024;
+    size_t max_queued_requests = 0;
+    size_t max_connections = 0;
+    int server_fd = -1;
+    std::unique_ptr<detail::ThreadPool> pool;
+    std::vector<std::unique_ptr<IoContext>> contexts;
+
+    // 一次请求及其响应，异步处理期间由 done 回调持有
+    struct Exchange {
+        Request req;
+        Response res;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    // 预处理 + 执行处理函数（路由已在IO线程中匹配，handler 为空表示没有匹配的路由）。
+    // 在工作线程中执行，每核模式下不阻塞的处理函数在IO线程中执行；响应就绪后（可能在其他线程中）调用 finish
+    void process_request(std::shared_ptr<Exchange> exchange, const AsyncHandler* handler, std::function<void()> finish) {
+        exchange->start = std::chrono::steady_clock::now();
+        Request& req = exchange->req;
+        Response& res = exchange->res;
+
+        Done done = [this, exchange, finish = std::move(finish)]() {
+            if (logger) {
+                logger(exchange->req, exchange->res, std::chrono::steady_clock::now() - exchange->start);
+            }
+            finish();
+        };
+
+        // 排队期间客户端的时间预算已经用完，结果不会再被使用，不再执行
+        if (exchange->start >= req.deadline) {
+            rejected_requests.fetch_add(1, std::memory_order_relaxed);
+            res.status = 504;
+            res.body = "Deadline Exceeded";
+            done();
+            return;
+        }
+
+        // 预处理
+        if (pre_routing_handler) {
+            pre_routing_handler(req, res);
+        }
+
+        if (handler) {
+            (*handler)(req, res, std::move(done));
+        } else {
+            res.status = 404;
+            res.body = "Not Found";
+            done();
+        }
+    }
+
+    void accept_connections(IoContext* ctx) {
+        while (true) {
+            int client_fd = accept4(ctx->listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (client_fd < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    ctx->accept_stalled = false;
+                    return;
+                }
+                // 边沿触发下积压的连接不取完就不会再有通知。fd 用尽（EMFILE/ENFILE）时释放预留的 fd，
+                // 取出一个连接立即关闭，再重新预留，如此把积压的连接都取完
+                if ((errno == EMFILE || errno == ENFILE) && ctx->reserve_fd >= 0) {
+                    close(ctx->reserve_fd);
+                    int shed_fd = accept4(ctx->listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+                    if (shed_fd >= 0) {
+                        close(shed_fd);
+                        rejected_requests.fetch_add(1, std::memory_order_relaxed);
+                    }
+                    ctx->reserve_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+                    if (shed_fd >= 0) continue;
+                }
+                // 其他错误（如内存不足）或没能重新预留 fd：由周期任务稍后重试
+                ctx->accept_stalled = true;
+                return;
+            }
+
+            if (max_connections > 0 && active_connections.load(std::memory_order_relaxed) >= max_connections) {
+                // 连接数已满：尽力回一个 503 后关闭，不为它分配任何状态
+                static const char rejection[] =
+                    "HTTP/1.1 503 Service Unavailable\r\nRetry-After: 1\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+                ssize_t n = send(client_fd, rejection, sizeof(rejection) - 1, MSG_NOSIGNAL);
+                (void)n;
+                close(client_fd);
+                rejected_requests.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+
+            int opt = 1;
+            setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+
+            auto conn = std::make_shared<Connection>();
+            conn->fd = client_fd;
+            conn->parser.set_max_body_size(payload_max_length);
+            conn->last_active = std::chrono::steady_clock::now();
+            Connection* raw = conn.get();
+            conn->on_event = [this, ctx, raw](uint32_t events) {
+                handle_event(ctx, raw, events);
+            };
+            ctx->connections[client_fd] = conn;
+            active_connections.fetch_add(1, std::memory_order_relaxed);
+            // 边沿触发，EPOLLOUT 一并注册，发送缓冲区从满变为可写时再继续发送
+            if (!ctx->loop.add(client_fd, EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET, &conn->on_event)) {
+                close_connection(ctx, raw);
+            }
+        }
+    }
+
+    void handle_event(IoContext* ctx, Connection* conn, uint32_t events) {
+        if (conn->closed) return;
+        if (events & EPOLLERR) {
+            close_connection(ctx, conn);
+            return;
+        }
+        if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) {
+            read_available(ctx, conn);
+            if (conn->closed) return;
+        }
+        if (events & EPOLLOUT) {
+            flush(ctx, conn);
+            // 上一个响应发完后继续处理已缓冲的流水线请求
+            process_input(ctx, conn);
+            resume_input(ctx, conn);
+            close_if_finished(ctx, conn);
+        }
+    }
+
+    // 边沿触发：必须一直读到 EAGAIN。暂停接收期间不读，恢复时由 resume 重新调用
+    void read_available(IoContext* ctx, Connection* conn) {
+        if (conn->paused || conn->closed) return;
+        char buffer[16384];
+        conn->input_full = false;
+        while (true) {
+            // 请求处理期间客户端可能继续发送，缓冲超过一个完整请求的上限就不再读，
+            // 剩余数据留在内核中由TCP流控挡住，待请求完成后 resume_input 继续
+            if (conn->in.size() - conn->in_offset >= max_buffered_input()) {
+                conn->input_full = true;
+                break;
+            }
+            ssize_t n = recv(conn->fd, buffer, sizeof(buffer), 0);
+            if (n > 0) {
+                conn->in.append(buffer, n);
+                continue;
+            }
+            if (n == 0) {
+                conn->peer_closed = true;
+                break;
+            }
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            close_connection(ctx, conn);
+            return;
+        }
+
+        conn->last_active = std::chrono::steady_clock::now();
+        process_input(ctx, conn);
+        resume_input(ctx, conn);
+        close_if_finished(ctx, conn);
+    }
+
+    size_t max_buffered_input() const {
+        return RequestParser::DEFAULT_MAX_HEADER_SIZE + payload_max_length;
+    }
+
+    // 因缓冲已满而停止读取的连接，在缓冲被消费后重新读取。
+    // 边沿触发不会再通知已在内核中的数据，因此必须主动读；放到本轮事件之后避免递归
+    void resume_input(IoContext* ctx, Connection* conn) {
+        if (!conn->input_full || conn->closed) return;
+        if (conn->in.size() - conn->in_offset >= max_buffered_input()) return;
+        conn->input_full = false;
+        std::shared_ptr<Connection> keep = ctx->connections[conn->fd];
+        ctx->loop.defer([this, ctx, keep]() {
+            read_available(ctx, keep.get());
+        });
+    }
+
+    // 从输入缓冲区中解析下一个完整请求并交给工作线程。
+    // 同一连接同时只处理一个请求，上一个响应发完之前不处理下一个，保证流水线请求的响应顺序
+    void process_input(IoContext* ctx, Connection* conn) {
+        if (conn->closed) return;
+        if (conn->reader) {
+            feed_upload(ctx, conn);
+            return;
+        }
+        if (conn->busy || conn->close_after_write || sending(conn)) return;
+
+        const char* data = conn->in.data() + conn->in_offset;
+        size_t size = conn->in.size() - conn->in_offset;
+        size_t consumed = 0;
+        const StreamHandler* stream = nullptr;
+        auto result = RequestParser::Result::Complete;
+        if (!stream_routes.empty()) {
+            result = conn->parser.parse_head_only(data, size, conn->pending, consumed);
+            if (result == RequestParser::Result::Complete && conn->pending.method == "POST") {
+                auto it = stream_routes.find(conn->pending.path);
+                if (it != stream_routes.end()) {
+                    stream = &it->second;
+                    conn->pending.route = it->first;
+                }
+            }
+        }
+        if (stream == nullptr && result == RequestParser::Result::Complete) {
+            result = conn->parser.parse(data, size, conn->pending, consumed);
+        }
+        if (result == RequestParser::Result::Incomplete) {
+            // 把未处理的数据移到缓冲区开头
+            if (conn->in_offset > 0) {
+                conn->in.erase(0, conn->in_offset);
+                conn->in_offset = 0;
+            }
+            return;
+        }
+        if (result != RequestParser::Result::Complete) {
+            Response res;
+            res.status = result == RequestParser::Result::PayloadTooLarge ? 413 : 400;
+            res.set_header("Connection", "close");
+            conn->close_after_write = true;
+            queue_response(conn, res);
+            flush(ctx, conn);
+            return;
+        }
+
+        size_t upload_length = 0;
+        if (stream != nullptr) {
+            upload_length = conn->parser.body_length();
+            conn->parser.reset();
+        }
+        conn->in_offset += consumed;
+        if (conn->in_offset == conn->in.size()) {
+            conn->in.clear();
+            conn->in_offset = 0;
+        }
+
+        Request req = std::move(conn->pending);
+        conn->pending = Request();
+        bool keep_alive = conn->parser.keep_alive();
+        conn->close_after_write = !keep_alive;
+        conn->busy = true;
+
+        std::shared_ptr<Connection> keep = ctx->connections[conn->fd];
+        auto exchange = std::make_shared<Exchange>();
+        exchange->req = std::move(req);
+        set_deadline(exchange->req);
+        auto finish = make_finish(ctx, keep, exchange, keep_alive);
+        if (stream != nullptr) {
+            start_upload(ctx, keep, exchange, *stream, upload_length, std::move(finish));
+            return;
+        }
+        const AsyncHandler* handler = router.match(exchange->req);
+        if (shard_per_core && handler && router.nonblocking(handler)) {
+            process_request(exchange, handler, std::move(finish));
+            return;
+        }
+        std::function<void()> task = [this, exchange, handler, finish]() {
+            process_request(exchange, handler, finish);
+        };
+        if (!pool->try_enqueue(task, max_queued_requests)) {
+            // 工作线程跟不上：立即拒绝，不让排队时间无限增长
+            rejected_requests.fetch_add(1, std::memory_order_relaxed);
+            exchange->start = std::chrono::steady_clock::now();
+            exchange->res.status = 503;
+            exchange->res.body = "Service Unavailable";
+            exchange->res.set_header("Retry-After", "1");
+            if (logger) {
+                logger(exchange->req, exchange->res, std::chrono::nanoseconds(0));
+            }
+            finish();
+        }
+    }
+
+    // 请求头中的时间预算（毫秒）换算成截止时刻，从收到请求时算起
+    void set_deadline(Request& req) const {
+        if (timeout_header.empty()) return;
+        auto it = req.headers.find(timeout_header);
+        if (it == req.headers.end()) return;
+        int64_t budget_ms = 0;
+        const char* end = it->second.data() + it->second.size();
+        auto parsed = std::from_chars(it->second.data(), end, budget_ms);
+        if (parsed.ec != std::errc() || parsed.ptr != end) return;
+        req.deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(std::max<int64_t>(budget_ms, 0));
+    }
+
+    // 响应就绪后调用：回到连接所在的IO线程发送响应，再继续处理后面的请求
+    std::function<void()> make_finish(IoContext* ctx, std::shared_ptr<Connection> keep,
+                                      std::shared_ptr<Exchange> exchange, bool keep_alive) {
+        return [this, ctx, keep, exchange, keep_alive]() {
+            Response& res = exchange->res;
+            if (!keep_alive) {
+                res.set_header("Connection", "close");
+            } else if (exchange->req.version == "HTTP/1.0") {
+                res.set_header("Connection", "keep-alive");
+            }
+            post_to(ctx, [this, ctx, keep, exchange]() {
+                if (keep->closed) return;
+                keep->busy = false;
+                queue_response(keep.get(), exchange->res);
+                flush(ctx, keep.get());
+                // 继续处理已缓冲的流水线请求
+                process_input(ctx, keep.get());
+                resume_input(ctx, keep.get());
+                close_if_finished(ctx, keep.get());
+            });
+        };
+    }
+
+    // 在 ctx 的IO线程上执行 task
+    void post_to(IoContext* ctx, std::function<void()> task) {
+        if (shard_per_core) {
+            run_on(ctx->index, std::move(task));
+        } else {
+            ctx->loop.post(std::move(task));
+        }
+    }
+
+    // 流式请求：处理函数在IO线程中创建 reader，之后收到的正文依次交给它，全部收到后由它填写响应
+    void start_upload(IoContext* ctx, std::shared_ptr<Connection> keep, std::shared_ptr<Exchange> exchange,
+                      const StreamHandler& handler, size_t length, std::function<void()> finish) {
+        Connection* conn = keep.get();
+        exchange->start = std::chrono::steady_clock::now();
+        Request& req = exchange->req;
+        Response& res = exchange->res;
+        if (pre_routing_handler) {
+            pre_routing_handler(req, res);
+        }
+        Done done = [this, exchange, finish = std::move(finish)]() {
+            if (logger) {
+                logger(exchange->req, exchange->res, std::chrono::steady_clock::now() - exchange->start);
+            }
+            finish();
+        };
+
+        std::weak_ptr<Connection> weak = keep;
+        auto resume = [this, ctx, weak]() {
+            post_to(ctx, [this, ctx, weak]() {
+                auto conn = weak.lock();
+                if (!conn || conn->closed || !conn->paused) return;
+                conn->paused = false;
+                feed_upload(ctx, conn.get());
+                read_available(ctx, conn.get());
+            });
+        };
+        std::shared_ptr<BodyReader> reader = handler(req, res, std::move(resume));
+        if (!reader) {
+            // 正文没有读取，不能再复用连接
+            conn->close_after_write = true;
+            done();
+            return;
+        }
+        auto expect = req.headers.find("Expect");
+        if (expect != req.headers.end() && detail::iequals(expect->second.data(), expect->second.size(), "100-continue")) {
+            conn->out.append("HTTP/1.1 100 Continue\r\n\r\n");
+            flush(ctx, conn);
+            if (conn->closed) return;
+        }
+        conn->upload = exchange;
+        conn->upload_remaining = length;
+        conn->reader = std::move(reader);
+        conn->upload_done = std::move(done);
+        feed_upload(ctx, conn);
+    }
+
+    // 把已缓冲的正文交给 reader，直到收完或 reader 要求暂停
+    void feed_upload(IoContext* ctx, Connection* conn) {
+        while (!conn->paused && conn->upload_remaining > 0 && conn->in_offset < conn->in.size()) {
+            size_t length = std::min(conn->upload_remaining, conn->in.size() - conn->in_offset);
+            std::string_view chunk(conn->in.data() + conn->in_offset, length);
+            conn->in_offset += length;
+            conn->upload_remaining -= length;
+            if (!conn->reader->write(chunk)) {
+                conn->paused = true;
+            }
+        }
+        if (conn->in_offset == conn->in.size()) {
+            conn->in.clear();
+            conn->in_offset = 0;
+        }
+        if (conn->upload_remaining > 0) {
+            if (conn->peer_closed && conn->in_offset == conn->in.size()) {
+                // 正文没发完对端就关闭了
+                close_connection(ctx, conn);
+            }
+            return;
+        }
+        auto reader = std::move(conn->reader);
+        auto exchange = std::move(conn->upload);
+        Done done = std::move(conn->upload_done);
+        conn->reader.reset();
+        conn->upload.reset();
+        conn->upload_done = nullptr;
+        conn->paused = false;
+        reader->finish(exchange->res, std::move(done));
     }
-};
 
-class Server {
-public:
-    enum class HandlerResponse {
-        Handled,
-        Unhandled
-    };
+    // 取出其他IO线程投递的任务
+    void drain_inbox(IoContext* ctx) {
+        ctx->notified.store(false, std::memory_order_seq_cst);
+        std::function<void()> task;
+        for (auto& queue : ctx->inbox) {
+            while (queue->try_pop(task)) {
+                task();
+            }
+        }
+    }
 
-    using Handler = std::function<void(const Request&, Response&)>;
-    using PreRoutingHandler = std::function<HandlerResponse(const Request&, Response&)>;
+    // 头部写入连接的复用缓冲区，正文直接移入连接。同一连接同时只有一个响应在发送（见 busy），
+    // 缓冲区中只可能还剩没发完的 100 Continue
+    void queue_response(Connection* conn, Response& res) {
+        if (conn->out_offset == conn->out.size()) {
+            conn->out.clear();
+            conn->out_offset = 0;
+        }
+        write_head(res, default_headers, conn->out);
+        if (res.content_provider) {
+            conn->provider = std::move(res.content_provider);
+            conn->body.clear();
+        } else {
+            conn->body = std::move(res.body);
+        }
+        conn->body_offset = 0;
+    }
 
-private:
-    std::vector<std::pair<std::string, std::pair<std::string, Handler>>> handlers;
-    PreRoutingHandler pre_routing_handler;
+    // 响应是否还有没发完的数据
+    static bool sending(const Connection* conn) {
+        return conn->out_offset < conn->out.size() || conn->body_offset < conn->body.size() || conn->provider;
+    }
 
-    std::string parse_request_line(const std::string& line, Request& req) {
-        std::istringstream iss(line);
-        std::string version;
-        iss >> req.method >> req.path >> version;
-        return req.path;
+    // 从流式正文中取下一块：块长度行放在头部缓冲区，数据和结尾的 CRLF 放在正文缓冲区
+    void next_chunk(Connection* conn) {
+        conn->out.clear();
+        conn->out_offset = 0;
+        conn->body.clear();
+        conn->body_offset = 0;
+        bool more = conn->provider(conn->body);
+        if (!conn->body.empty()) {
+            char number[24];
+            auto end = std::to_chars(number, number + sizeof(number), conn->body.size(), 16).ptr;
+            conn->out.append(number, end).append("\r\n");
+            conn->body.append("\r\n");
+        }
+        if (!more) {
+            conn->body.append("0\r\n\r\n");
+            conn->provider = nullptr;
+        }
+        conn->last_active = std::chrono::steady_clock::now();
     }
 
-    void parse_headers(const std::string& headers_str, Request& req) {
-        std::istringstream iss(headers_str);
-        std::string line;
-        while (std::getline(iss, line) && !line.empty() && line != "\r") {
-            size_t pos = line.find(':');
-            if (pos != std::string::npos) {
-                std::string key = line.substr(0, pos);
-                std::string value = line.substr(pos + 1);
-                // 去除前后空格
-                while (!key.empty() && isspace(key.back())) key.pop_back();
-                while (!value.empty() && isspace(value.front())) value.erase(0, 1);
-                while (!value.empty() && isspace(value.back())) value.pop_back();
-                req.headers[key] = value;
+    // 头部和正文用一次 sendmsg 发出；短写时记录偏移，从未发送的部分继续。
+    // 流式正文在发送缓冲区清空后再取下一块，客户端读得慢时不会在内存中堆积；
+    // 每次最多连续取 CHUNKS_PER_FLUSH 块，之后让出事件循环，避免一个大响应占住其他连接
+    void flush(IoContext* ctx, Connection* conn) {
+        size_t chunks = 0;
+        while (true) {
+            if (conn->out_offset == conn->out.size() && conn->body_offset == conn->body.size()) {
+                if (!conn->provider) break;
+                if (++chunks > CHUNKS_PER_FLUSH) {
+                    std::shared_ptr<Connection> keep = ctx->connections[conn->fd];
+                    ctx->loop.post([this, ctx, keep]() {
+                        if (keep->closed) return;
+                        flush(ctx, keep.get());
+                        process_input(ctx, keep.get());
+                        resume_input(ctx, keep.get());
+                        close_if_finished(ctx, keep.get());
+                    });
+                    return;
+                }
+                next_chunk(conn);
+                continue;
+            }
+            iovec iov[2];
+            int count = 0;
+            if (conn->out_offset < conn->out.size()) {
+                iov[count].iov_base = &conn->out[conn->out_offset];
+                iov[count].iov_len = conn->out.size() - conn->out_offset;
+                count++;
+            }
+            if (conn->body_offset < conn->body.size()) {
+                iov[count].iov_base = &conn->body[conn->body_offset];
+                iov[count].iov_len = conn->body.size() - conn->body_offset;
+                count++;
+            }
+            msghdr msg{};
+            msg.msg_iov = iov;
+            msg.msg_iovlen = count;
+            ssize_t n = sendmsg(conn->fd, &msg, MSG_NOSIGNAL);
+            if (n > 0) {
+                size_t sent = static_cast<size_t>(n);
+                size_t head = std::min(sent, conn->out.size() - conn->out_offset);
+                conn->out_offset += head;
+                conn->body_offset += sent - head;
+                continue;
             }
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;  // 等待 EPOLLOUT
+            close_connection(ctx, conn);
+            return;
+        }
+        conn->out.clear();
+        conn->out_offset = 0;
+        conn->body.clear();
+        conn->body.shrink_to_fit();
+        conn->body_offset = 0;
+        conn->last_active = std::chrono::steady_clock::now();
+
+        if (conn->close_after_write && !conn->busy) {
+            close_connection(ctx, conn);
         }
     }
 
-    std::string create_response(const Response& res) {
-        std::ostringstream oss;
-        oss << "HTTP/1.1 " << res.status << " ";
-        
-        switch (res.status) {
-            case 200: oss << "OK"; break;
-            case 404: oss << "Not Found"; break;
-            case 400: oss << "Bad Request"; break;
-            case 500: oss << "Internal Server Error"; break;
-            default: oss << "Unknown"; break;
+    // 对端已关闭写方向且没有待处理的请求和数据时关闭连接
+    void close_if_finished(IoContext* ctx, Connection* conn) {
+        if (!conn->closed && conn->peer_closed && !conn->busy && !sending(conn)) {
+            close_connection(ctx, conn);
         }
-        oss << "\r\n";
+    }
 
-        for (const auto& header : res.headers) {
-            oss << header.first << ": " << header.second << "\r\n";
+    // 关闭长时间没有活动的空闲连接（包括请求迟迟发不完整的连接）
+    void close_idle_connections(IoContext* ctx) {
+        auto deadline = std::chrono::steady_clock::now() - std::chrono::seconds(keep_alive_timeout_sec);
+        std::vector<Connection*> idle;
+        for (auto& item : ctx->connections) {
+            Connection* conn = item.second.get();
+            // 暂停接收的上传在等待处理函数，不算空闲
+            if ((!conn->busy || (conn->reader && !conn->paused)) && conn->last_active < deadline) {
+                idle.push_back(conn);
+            }
+        }
+        for (auto* conn : idle) {
+            close_connection(ctx, conn);
+        }
+    }
+
+    void close_connection(IoContext* ctx, Connection* conn) {
+        if (conn->closed) return;
+        conn->closed = true;
+        active_connections.fetch_sub(1, std::memory_order_relaxed);
+        ctx->loop.remove(conn->fd);
+        close(conn->fd);
+        // 断开与处理函数之间的引用（reader 持有的 resume 只持有弱引用）
+        conn->reader.reset();
+        conn->upload.reset();
+        conn->upload_done = nullptr;
+        conn->provider = nullptr;
+        auto it = ctx->connections.find(conn->fd);
+        if (it != ctx->connections.end()) {
+            ctx->loop.release_later(it->second);
+            ctx->connections.erase(it);
         }
-        
-        oss << "Content-Length: " << res.body.length() << "\r\n";
-        oss << "\r\n";
-        oss << res.body;
-        
-        return oss.str();
     }
 
 public:
@@ -105,140 +1363,355 @@ public:
         pre_routing_handler = handler;
     }
 
+    // 每个响应都带的固定头部（如CORS），在这里渲染一次，发送时原样追加，
+    // 不再逐个请求写入 res.headers。处理函数不应再设置同名头部
+    void set_default_headers(const Headers& headers) {
+        default_headers = render_headers(headers);
+    }
+
+    void set_logger(Logger handler) {
+        logger = std::move(handler);
+    }
+
+    // 当前打开的客户端连接数
+    size_t connection_count() const {
+        return active_connections.load(std::memory_order_relaxed);
+    }
+
+    // 因过载（连接数或排队请求数达到上限）或时间预算用完而拒绝的请求数
+    uint64_t rejected_count() const {
+        return rejected_requests.load(std::memory_order_relaxed);
+    }
+
+    // 同步处理函数返回时响应即已就绪
+    static AsyncHandler sync(Handler handler) {
+        return [handler = std::move(handler)](const Request& req, Response& res, Done done) {
+            handler(req, res);
+            done();
+        };
+    }
+
+    static std::string render_headers(const Headers& headers) {
+        std::string out;
+        for (const auto& header : headers) {
+            out.append(header.first).append(": ").append(header.second).append("\r\n");
+        }
+        return out;
+    }
+
+    static const char* status_text(int status) {
+        switch (status) {
+            case 200: return "OK";
+            case 404: return "Not Found";
+            case 400: return "Bad Request";
+            case 413: return "Payload Too Large";
+            case 500: return "Internal Server Error";
+            case 503: return "Service Unavailable";
+            case 504: return "Gateway Timeout";
+            default: return "Unknown";
+        }
+    }
+
+    // 把状态行和头部追加到 out（不含正文），default_headers 为 render_headers 的结果
+    static void write_head(const Response& res, std::string_view default_headers, std::string& out) {
+        char number[24];
+        out.append("HTTP/1.1 ");
+        out.append(number, std::to_chars(number, number + sizeof(number), res.status).ptr);
+        out.push_back(' ');
+        out.append(status_text(res.status));
+        out.append("\r\n");
+        out.append(default_headers);
+        for (const auto& header : res.headers) {
+            out.append(header.first).append(": ").append(header.second).append("\r\n");
+        }
+        if (res.content_provider) {
+            out.append("Transfer-Encoding: chunked\r\n\r\n");
+            return;
+        }
+        out.append("Content-Length: ");
+        out.append(number, std::to_chars(number, number + sizeof(number), res.body.size()).ptr);
+        out.append("\r\n\r\n");
+    }
+
+    // 序列化完整响应（状态行 + 头部 + 正文）
+    static std::string create_response(const Response& res, std::string_view default_headers = {}) {
+        std::string out;
+        out.reserve(128 + default_headers.size() + res.body.size());
+        write_head(res, default_headers, out);
+        out.append(res.body);
+        return out;
+    }
+
+    // 工作线程数（执行handler的线程）
+    void set_thread_pool_size(size_t count) {
+        thread_pool_size = count > 0 ? count : 1;
+    }
+
+    // IO线程数（每个线程一个epoll事件循环，负责accept和读写）
+    void set_io_thread_count(size_t count) {
+        io_thread_count = count > 0 ? count : 1;
+    }
+
+    // 每核模式：每个IO线程绑定一个CPU，各自用 SO_REUSEPORT 监听同一端口，由内核分配连接；
+    // 异步路由直接在接收请求的IO线程上执行，IO线程之间经无锁队列投递任务（见 run_on）
+    void set_shard_per_core(bool enabled) {
+        shard_per_core = enabled;
+    }
+
+    size_t core_count() const {
+        return io_thread_count;
+    }
+
+    // 当前线程是本服务器的IO线程时返回其编号，否则返回 -1
+    int current_core() const {
+        const CoreTag& tag = core_tag();
+        return tag.server == this ? static_cast<int>(tag.core) : -1;
+    }
+
+    // 在第 core 个IO线程上执行 task（只能在 listen 运行期间调用）。从本服务器的IO线程投递时
+    // 经该线程对的无锁队列，投给自己时在本轮事件处理完后执行；其他线程投递或队列已满时经事件循环的任务队列
+    void run_on(size_t core, std::function<void()> task) {
+        IoContext* target = contexts[core].get();
+        const CoreTag& tag = core_tag();
+        if (tag.server == this) {
+            if (tag.core == core) {
+                target->loop.defer(std::move(task));
+                return;
+            }
+            if (target->inbox[tag.core]->try_push(std::move(task))) {
+                if (!target->notified.exchange(true, std::memory_order_seq_cst)) {
+                    target->loop.wake();
+                }
+                return;
+            }
+        }
+        target->loop.post(std::move(task));
+    }
+
+    void set_listen_backlog(int backlog) {
+        listen_backlog = backlog > 0 ? backlog : SOMAXCONN;
+    }
+
+    // 长连接空闲超时（秒）
+    void set_keep_alive_timeout(int sec) {
+        keep_alive_timeout_sec = sec > 0 ? sec : 1;
+    }
+
+    // 请求体最大长度，超过时返回 413
+    void set_payload_max_length(size_t length) {
+        payload_max_length = length;
+    }
+
+    // 等待工作线程的请求数上限，达到后新请求立即返回 503（0 表示不限制）
+    void set_max_queued_requests(size_t count) {
+        max_queued_requests = count;
+    }
+
+    // 同时打开的连接数上限，达到后新连接收到 503 后被关闭（0 表示不限制）
+    void set_max_connections(size_t count) {
+        max_connections = count;
+    }
+
+    // 客户端在该请求头中给出剩余的时间预算（毫秒），见 Request::deadline。
+    // 开始处理时预算已经用完的请求直接返回 504
+    void set_timeout_header(const std::string& name) {
+        timeout_header = name;
+    }
+
     void Get(const std::string& pattern, Handler handler) {
-        handlers.push_back({"GET", {pattern, handler}});
+        router.add("GET", pattern, sync(std::move(handler)));
     }
 
     void Post(const std::string& pattern, Handler handler) {
-        handlers.push_back({"POST", {pattern, handler}});
+        router.add("POST", pattern, sync(std::move(handler)));
     }
 
     void Delete(const std::string& pattern, Handler handler) {
-        handlers.push_back({"DELETE", {pattern, handler}});
+        router.add("DELETE", pattern, sync(std::move(handler)));
     }
 
     void Options(const std::string& pattern, Handler handler) {
-        handlers.push_back({"OPTIONS", {pattern, handler}});
+        router.add("OPTIONS", pattern, sync(std::move(handler)));
     }
 
-    bool listen(const std::string& host, int port) {
-        int server_fd = socket(AF_INET, SOCK_STREAM, 0);
-        if (server_fd < 0) {
-            std::cerr << "Socket creation failed" << std::endl;
-            return false;
-        }
+    // 异步路由：处理函数发起请求后即可返回，不占用工作线程等待
+    void GetAsync(const std::string& pattern, AsyncHandler handler) {
+        router.add("GET", pattern, std::move(handler), true);
+    }
 
-        int opt = 1;
-        setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    void PostAsync(const std::string& pattern, AsyncHandler handler) {
+        router.add("POST", pattern, std::move(handler), true);
+    }
+
+    void DeleteAsync(const std::string& pattern, AsyncHandler handler) {
+        router.add("DELETE", pattern, std::move(handler), true);
+    }
 
+    // 流式上传路由：正文边收边交给处理函数返回的 BodyReader，不受请求体最大长度限制，
+    // 也不在内存中缓冲整个正文。path 只做精确匹配，优先于普通路由
+    void PostStream(const std::string& path, StreamHandler handler) {
+        stream_routes[path] = std::move(handler);
+    }
+
+    bool listen(const std::string& host, int port) {
         struct sockaddr_in address;
+        memset(&address, 0, sizeof(address));
         address.sin_family = AF_INET;
-        address.sin_addr.s_addr = INADDR_ANY;
+        if (inet_pton(AF_INET, host.c_str(), &address.sin_addr) <= 0) {
+            address.sin_addr.s_addr = INADDR_ANY;
+        }
         address.sin_port = htons(port);
 
-        if (bind(server_fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
-            std::cerr << "Bind failed on port " << port << std::endl;
-            close(server_fd);
-            return false;
+        // 每核模式下每个IO线程一个监听socket，否则所有IO线程共享一个
+        std::vector<int> listen_fds;
+        for (size_t i = 0; i < (shard_per_core ? io_thread_count : 1); ++i) {
+            int fd = open_listener(address, port);
+            if (fd < 0) {
+                for (int opened : listen_fds) close(opened);
+                return false;
+            }
+            listen_fds.push_back(fd);
         }
+        server_fd = listen_fds[0];
 
-        if (::listen(server_fd, 10) < 0) {
-            std::cerr << "Listen failed" << std::endl;
-            close(server_fd);
-            return false;
+        pool.reset(new detail::ThreadPool(thread_pool_size));
+        contexts.clear();
+        for (size_t i = 0; i < io_thread_count; ++i) {
+            auto ctx = std::unique_ptr<IoContext>(new IoContext());
+            IoContext* raw = ctx.get();
+            ctx->index = i;
+            ctx->listen_fd = listen_fds[shard_per_core ? i : 0];
+            ctx->on_accept = [this, raw](uint32_t) { accept_connections(raw); };
+            ctx->loop.set_periodic(1000, [this, raw]() {
+                close_idle_connections(raw);
+                if (raw->accept_stalled) accept_connections(raw);
+            });
+            if (shard_per_core) {
+                for (size_t j = 0; j < io_thread_count; ++j) {
+                    ctx->inbox.emplace_back(new detail::SpscQueue<std::function<void()>>(INBOX_CAPACITY));
+                }
+                ctx->loop.set_drain([this, raw]() { drain_inbox(raw); });
+            }
+            // 多个IO线程共享监听socket时用 EPOLLEXCLUSIVE 避免惊群，不支持时退化为普通注册
+            if (!ctx->loop.add(ctx->listen_fd, EPOLLIN | EPOLLET | EPOLLEXCLUSIVE, &ctx->on_accept) &&
+                !ctx->loop.add(ctx->listen_fd, EPOLLIN | EPOLLET, &ctx->on_accept)) {
+                std::cerr << "epoll registration failed" << std::endl;
+                for (int fd : listen_fds) close(fd);
+                contexts.clear();
+                return false;
+            }
+            contexts.push_back(std::move(ctx));
         }
 
         std::cout << "Server listening on " << host << ":" << port << std::endl;
 
-        while (true) {
-            struct sockaddr_in client_addr;
-            socklen_t client_len = sizeof(client_addr);
-            int client_fd = accept(server_fd, (struct sockaddr*)&client_addr, &client_len);
-            
-            if (client_fd < 0) {
-                continue;
-            }
+        std::vector<std::thread> io_threads;
+        for (size_t i = 1; i < contexts.size(); ++i) {
+            io_threads.emplace_back([this, i]() { run_io_thread(i); });
+        }
+        run_io_thread(0);
 
-            std::thread([this, client_fd]() {
-                char buffer[4096] = {0};
-                ssize_t bytes_read = recv(client_fd, buffer, sizeof(buffer) - 1, 0);
-                
-                if (bytes_read > 0) {
-                    std::string request_str(buffer, bytes_read);
-                    
-                    Request req;
-                    Response res;
-                    
-                    // 解析请求
-                    size_t first_line_end = request_str.find("\r\n");
-                    if (first_line_end != std::string::npos) {
-                        parse_request_line(request_str.substr(0, first_line_end), req);
-                        
-                        size_t headers_end = request_str.find("\r\n\r\n");
-                        if (headers_end != std::string::npos) {
-                            parse_headers(request_str.substr(first_line_end + 2, headers_end - first_line_end - 2), req);
-                            req.body = request_str.substr(headers_end + 4);
-                        }
-                    }
+        for (size_t i = 1; i < contexts.size(); ++i) {
+            contexts[i]->loop.stop();
+        }
+        for (auto& t : io_threads) {
+            t.join();
+        }
+        pool->shutdown();
+        for (auto& ctx : contexts) {
+            for (auto& item : ctx->connections) {
+                close(item.first);
+            }
+            ctx->connections.clear();
+        }
+        active_connections = 0;
+        for (int fd : listen_fds) close(fd);
+        server_fd = -1;
+        return true;
+    }
 
-                    // 预处理
-                    if (pre_routing_handler) {
-                        pre_routing_handler(req, res);
-                    }
+private:
+    int open_listener(const sockaddr_in& address, int port) {
+        int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            std::cerr << "Socket creation failed" << std::endl;
+            return -1;
+        }
+        int opt = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+        if (shard_per_core) {
+            setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt));
+        }
+        if (bind(fd, (const struct sockaddr*)&address, sizeof(address)) < 0) {
+            std::cerr << "Bind failed on port " << port << std::endl;
+            close(fd);
+            return -1;
+        }
+        if (::listen(fd, listen_backlog) < 0) {
+            std::cerr << "Listen failed" << std::endl;
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
 
-                    // 路由处理
-                    bool handled = false;
-                    for (const auto& handler_info : handlers) {
-                        if (handler_info.first == req.method) {
-                            const std::string& pattern = handler_info.second.first;
-                            
-                            // 检查是否是精确匹配（不包含正则表达式特殊字符）
-                            if (pattern.find_first_of("()[]{}*+?^$|\\") == std::string::npos) {
-                                // 精确字符串匹配
-                                if (req.path == pattern) {
-                                    handler_info.second.second(req, res);
-                                    handled = true;
-                                    break;
-                                }
-                            } else {
-                                // 正则表达式匹配
-                                std::regex pattern_regex(pattern);
-                                std::smatch matches;
-                                if (std::regex_match(req.path, matches, pattern_regex)) {
-                                    for (size_t i = 1; i < matches.size(); ++i) {
-                                        req.matches.push_back(matches[i].str());
-                                    }
-                                    handler_info.second.second(req, res);
-                                    handled = true;
-                                    break;
-                                }
-                            }
-                        }
-                    }
+    // 每核模式下先把线程绑定到第 index 个CPU（超过CPU数时轮转）
+    void run_io_thread(size_t index) {
+        if (shard_per_core) {
+            unsigned cpus = std::max(1u, std::thread::hardware_concurrency());
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(index % cpus, &set);
+            pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        }
+        core_tag() = CoreTag{this, index};
+        contexts[index]->loop.run();
+        core_tag() = CoreTag();
+    }
 
-                    if (!handled) {
-                        res.status = 404;
-                        res.body = "Not Found";
-                    }
+public:
 
-                    std::string response_str = create_response(res);
-                    send(client_fd, response_str.c_str(), response_str.length(), 0);
-                }
-                
-                close(client_fd);
-            }).detach();
+    // 线程安全：让 listen 返回
+    void stop() {
+        if (!contexts.empty()) {
+            contexts[0]->loop.stop();
         }
-
-        close(server_fd);
-        return true;
     }
 };
 
+// HTTP客户端：线程安全，按目标地址维护一组长连接，可以被多个线程共享
 class Client {
+public:
+    struct Result {
+        int status;
+        std::string body;
+        operator bool() const { return status > 0; }
+    };
+
 private:
+    // 空闲连接
+    struct IdleSocket {
+        int fd;
+        std::chrono::steady_clock::time_point since;
+    };
+
     std::string host;
-    int port;
-    int timeout_sec;
+    int port = 80;
+    int connect_timeout_ms = 30000;
+    int read_timeout_ms = 30000;
+    int idle_timeout_sec = 30;    // 需小于服务端的长连接超时
+    size_t max_idle_sockets = 32;
+    bool keep_alive = true;
+
+    std::mutex pool_mutex;
+    std::vector<IdleSocket> idle_sockets;
+
+    // 解析后的地址缓存，避免每次请求都做DNS查询
+    std::mutex addr_mutex;
+    bool addr_valid = false;
+    struct sockaddr_in cached_addr;
+    std::chrono::steady_clock::time_point addr_expire;
+    static constexpr int ADDR_TTL_SEC = 60;
 
 public:
     Client(const std::string& url) {
@@ -254,110 +1727,330 @@ public:
                 port = 80;
             }
         }
-        timeout_sec = 30;
     }
 
-    void set_connection_timeout(int sec, int /* usec */) {
-        timeout_sec = sec;
+    ~Client() {
+        for (auto& s : idle_sockets) {
+            close(s.fd);
+        }
     }
 
-    struct Result {
-        int status;
-        std::string body;
-        operator bool() const { return status > 0; }
-    };
+    Client(const Client&) = delete;
+    Client& operator=(const Client&) = delete;
+
+    void set_connection_timeout(int sec, int usec) {
+        connect_timeout_ms = sec * 1000 + usec / 1000;
+    }
+
+    void set_read_timeout(int sec, int usec) {
+        read_timeout_ms = sec * 1000 + usec / 1000;
+    }
+
+    void set_keep_alive(bool on) {
+        keep_alive = on;
+    }
+
+    void set_max_idle_connections(size_t count) {
+        max_idle_sockets = count;
+    }
 
     std::shared_ptr<Result> Get(const std::string& path) {
-        return make_request("GET", path, "", "");
+        return make_request("GET", path, Headers(), "", "");
+    }
+
+    // timeout_ms > 0 时本次请求的连接和读写超时不超过它（如调用方剩余的时间预算）
+    std::shared_ptr<Result> Get(const std::string& path, const Headers& headers, int timeout_ms = 0) {
+        return make_request("GET", path, headers, "", "", timeout_ms);
     }
 
     std::shared_ptr<Result> Post(const std::string& path, const std::string& body, const std::string& content_type) {
-        return make_request("POST", path, body, content_type);
+        return make_request("POST", path, Headers(), body, content_type);
+    }
+
+    std::shared_ptr<Result> Post(const std::string& path, const Headers& headers, const std::string& body,
+                                 const std::string& content_type, int timeout_ms = 0) {
+        return make_request("POST", path, headers, body, content_type, timeout_ms);
     }
 
     std::shared_ptr<Result> Delete(const std::string& path) {
-        return make_request("DELETE", path, "", "");
+        return make_request("DELETE", path, Headers(), "", "");
+    }
+
+    std::shared_ptr<Result> Delete(const std::string& path, const Headers& headers, int timeout_ms = 0) {
+        return make_request("DELETE", path, headers, "", "", timeout_ms);
     }
 
 private:
-    std::shared_ptr<Result> make_request(const std::string& method, const std::string& path, 
-                                        const std::string& body, const std::string& content_type) {
-        auto result = std::make_shared<Result>();
-        
-        int sock = socket(AF_INET, SOCK_STREAM, 0);
-        if (sock < 0) {
-            result->status = 0;
-            return result;
+    bool resolve(struct sockaddr_in& addr) {
+        {
+            std::lock_guard<std::mutex> lock(addr_mutex);
+            if (addr_valid && std::chrono::steady_clock::now() < addr_expire) {
+                addr = cached_addr;
+                return true;
+            }
         }
 
-        struct sockaddr_in server_addr;
-        server_addr.sin_family = AF_INET;
-        server_addr.sin_port = htons(port);
-        
-        // 尝试直接解析IP地址
-        if (inet_pton(AF_INET, host.c_str(), &server_addr.sin_addr) <= 0) {
-            // 如果不是IP地址，尝试解析主机名
-            struct hostent* he = gethostbyname(host.c_str());
-            if (he == nullptr) {
-                close(sock);
-                result->status = 0;
-                return result;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        // 尝试直接解析IP地址，否则用线程安全的 getaddrinfo 解析主机名
+        if (inet_pton(AF_INET, host.c_str(), &addr.sin_addr) <= 0) {
+            struct addrinfo hints;
+            memset(&hints, 0, sizeof(hints));
+            hints.ai_family = AF_INET;
+            hints.ai_socktype = SOCK_STREAM;
+            struct addrinfo* info = nullptr;
+            if (getaddrinfo(host.c_str(), nullptr, &hints, &info) != 0 || info == nullptr) {
+                return false;
             }
-            memcpy(&server_addr.sin_addr, he->h_addr_list[0], he->h_length);
+            addr.sin_addr = reinterpret_cast<struct sockaddr_in*>(info->ai_addr)->sin_addr;
+            freeaddrinfo(info);
         }
 
-        if (connect(sock, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
-            close(sock);
-            result->status = 0;
-            return result;
+        std::lock_guard<std::mutex> lock(addr_mutex);
+        cached_addr = addr;
+        addr_valid = true;
+        addr_expire = std::chrono::steady_clock::now() + std::chrono::seconds(ADDR_TTL_SEC);
+        return true;
+    }
+
+    // 目标不可达：丢弃地址缓存和所有空闲连接（对端可能已重启或迁移）
+    void mark_unhealthy() {
+        {
+            std::lock_guard<std::mutex> lock(addr_mutex);
+            addr_valid = false;
+        }
+        std::vector<IdleSocket> stale;
+        {
+            std::lock_guard<std::mutex> lock(pool_mutex);
+            stale.swap(idle_sockets);
         }
+        for (auto& s : stale) {
+            close(s.fd);
+        }
+    }
 
-        std::ostringstream request;
-        request << method << " " << path << " HTTP/1.1\r\n";
-        request << "Host: " << host << ":" << port << "\r\n";
-        if (!content_type.empty()) {
-            request << "Content-Type: " << content_type << "\r\n";
+    // 非阻塞connect + poll，实现真正的连接超时
+    int open_socket(int timeout_ms) {
+        struct sockaddr_in addr;
+        if (!resolve(addr)) {
+            return -1;
         }
-        if (!body.empty()) {
-            request << "Content-Length: " << body.length() << "\r\n";
+
+        int sock = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (sock < 0) {
+            return -1;
         }
-        request << "Connection: close\r\n";
-        request << "\r\n";
-        if (!body.empty()) {
-            request << body;
+
+        if (connect(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+            if (errno != EINPROGRESS) {
+                close(sock);
+                mark_unhealthy();
+                return -1;
+            }
+            struct pollfd pfd;
+            pfd.fd = sock;
+            pfd.events = POLLOUT;
+            int error = 0;
+            socklen_t len = sizeof(error);
+            if (poll(&pfd, 1, std::min(connect_timeout_ms, timeout_ms)) <= 0 ||
+                getsockopt(sock, SOL_SOCKET, SO_ERROR, &error, &len) < 0 || error != 0) {
+                close(sock);
+                mark_unhealthy();
+                return -1;
+            }
         }
 
-        std::string request_str = request.str();
-        if (send(sock, request_str.c_str(), request_str.length(), 0) < 0) {
-            close(sock);
-            result->status = 0;
-            return result;
+        // 恢复阻塞模式，读写超时由 SO_RCVTIMEO/SO_SNDTIMEO 控制
+        int flags = fcntl(sock, F_GETFL, 0);
+        fcntl(sock, F_SETFL, flags & ~O_NONBLOCK);
+        set_io_timeout(sock, read_timeout_ms);
+        int opt = 1;
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+        return sock;
+    }
+
+    static void set_io_timeout(int sock, int timeout_ms) {
+        struct timeval tv;
+        tv.tv_sec = timeout_ms / 1000;
+        tv.tv_usec = (timeout_ms % 1000) * 1000;
+        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    }
+
+    // 从连接池取一个仍然可用的空闲连接，失效的直接关闭
+    int acquire_idle_socket() {
+        auto now = std::chrono::steady_clock::now();
+        while (true) {
+            IdleSocket s;
+            {
+                std::lock_guard<std::mutex> lock(pool_mutex);
+                if (idle_sockets.empty()) return -1;
+                s = idle_sockets.back();
+                idle_sockets.pop_back();
+            }
+            // 空闲太久的连接可能已被服务端关闭；对端已关闭的连接 peek 会读到 EOF
+            char probe;
+            if (now - s.since < std::chrono::seconds(idle_timeout_sec) &&
+                recv(s.fd, &probe, 1, MSG_PEEK | MSG_DONTWAIT) < 0 &&
+                (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                return s.fd;
+            }
+            close(s.fd);
+        }
+    }
+
+    void release_socket(int sock) {
+        {
+            std::lock_guard<std::mutex> lock(pool_mutex);
+            if (idle_sockets.size() < max_idle_sockets) {
+                idle_sockets.push_back({sock, std::chrono::steady_clock::now()});
+                return;
+            }
+        }
+        close(sock);
+    }
+
+    static bool send_all(int sock, const std::string& data) {
+        size_t sent = 0;
+        while (sent < data.size()) {
+            ssize_t n = send(sock, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            sent += n;
         }
+        return true;
+    }
 
-        char buffer[4096];
+    // 读取一个完整响应；返回值表示连接能否继续复用。
+    // retryable 表示还没收到任何数据连接就被对端关闭（复用的连接已失效，可以安全重试）
+    bool read_response(int sock, Result& result, bool& retryable) {
         std::string response;
-        ssize_t bytes_received;
-        while ((bytes_received = recv(sock, buffer, sizeof(buffer), 0)) > 0) {
-            response.append(buffer, bytes_received);
+        char buffer[16384];
+        size_t header_size = 0;
+        size_t content_length = 0;
+        bool has_length = false;
+        bool reusable = keep_alive;
+        bool received = false;
+        retryable = false;
+
+        while (true) {
+            if (header_size > 0 && has_length && response.size() >= header_size + content_length) {
+                break;
+            }
+            ssize_t n = recv(sock, buffer, sizeof(buffer), 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                // 没有 Content-Length 时以连接关闭作为响应结束
+                if (n == 0 && header_size > 0 && !has_length) {
+                    reusable = false;
+                    break;
+                }
+                retryable = !received && (n == 0 || errno == ECONNRESET);
+                result.status = 0;
+                return false;
+            }
+            received = true;
+            response.append(buffer, n);
+
+            if (header_size == 0) {
+                size_t pos = response.find("\r\n\r\n");
+                if (pos == std::string::npos) continue;
+                header_size = pos + 4;
+
+                size_t status_pos = response.find(' ');
+                if (status_pos == std::string::npos || status_pos > pos) {
+                    result.status = 0;
+                    return false;
+                }
+                result.status = atoi(response.c_str() + status_pos + 1);
+
+                size_t line = response.find("\r\n");
+                while (line < pos) {
+                    size_t next = response.find("\r\n", line + 2);
+                    size_t colon = response.find(':', line + 2);
+                    if (colon < next) {
+                        const char* name = response.data() + line + 2;
+                        size_t name_len = colon - line - 2;
+                        size_t value_pos = std::min(response.find_first_not_of(' ', colon + 1), next);
+                        if (detail::iequals(name, name_len, "Content-Length")) {
+                            content_length = strtoul(response.c_str() + value_pos, nullptr, 10);
+                            has_length = true;
+                        } else if (detail::iequals(name, name_len, "Connection") &&
+                                   response.compare(value_pos, 5, "close") == 0) {
+                            reusable = false;
+                        }
+                    }
+                    line = next;
+                }
+            }
         }
 
-        close(sock);
+        result.body = response.substr(header_size, has_length ? content_length : std::string::npos);
+        return reusable && has_length;
+    }
 
-        if (!response.empty()) {
-            size_t status_pos = response.find(' ');
-            if (status_pos != std::string::npos) {
-                size_t status_end = response.find(' ', status_pos + 1);
-                if (status_end != std::string::npos) {
-                    result->status = std::stoi(response.substr(status_pos + 1, status_end - status_pos - 1));
+    std::shared_ptr<Result> make_request(const std::string& method, const std::string& path, const Headers& headers,
+                                        const std::string& body, const std::string& content_type, int timeout_ms = 0) {
+        auto result = std::make_shared<Result>();
+        // 连接池中的连接保持默认的读写超时，本次请求更短时临时调整，放回前恢复
+        int timeout = timeout_ms > 0 ? std::min(timeout_ms, read_timeout_ms) : read_timeout_ms;
+
+        std::string request;
+        request.reserve(128 + path.size() + body.size());
+        request.append(method).append(" ").append(path).append(" HTTP/1.1\r\n");
+        request.append("Host: ").append(host).append(":").append(std::to_string(port)).append("\r\n");
+        for (const auto& header : headers) {
+            request.append(header.first).append(": ").append(header.second).append("\r\n");
+        }
+        if (!content_type.empty()) {
+            request.append("Content-Type: ").append(content_type).append("\r\n");
+        }
+        if (!body.empty()) {
+            request.append("Content-Length: ").append(std::to_string(body.length())).append("\r\n");
+        }
+        if (!keep_alive) {
+            request.append("Connection: close\r\n");
+        }
+        request.append("\r\n");
+        request.append(body);
+
+        // 复用的连接可能在空闲期间被服务端关闭，若还没收到任何响应数据则换新连接重试一次
+        for (int attempt = 0; attempt < 2; ++attempt) {
+            bool reused = false;
+            int sock = keep_alive ? acquire_idle_socket() : -1;
+            if (sock >= 0) {
+                reused = true;
+            } else {
+                sock = open_socket(timeout);
+                if (sock < 0) {
+                    result->status = 0;
+                    return result;
+                }
+            }
+            if (timeout != read_timeout_ms) set_io_timeout(sock, timeout);
+
+            bool retryable = true;
+            if (send_all(sock, request)) {
+                if (read_response(sock, *result, retryable)) {
+                    if (timeout != read_timeout_ms) set_io_timeout(sock, read_timeout_ms);
+                    release_socket(sock);
+                } else {
+                    close(sock);
+                }
+                if (result->status > 0) {
+                    return result;
                 }
+            } else {
+                close(sock);
             }
 
-            size_t body_pos = response.find("\r\n\r\n");
-            if (body_pos != std::string::npos) {
-                result->body = response.substr(body_pos + 4);
+            if (!reused || !retryable) {
+                break;
             }
         }
 
+        result->status = 0;
         return result;
     }
 };
@@ -0,0 +1,210 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include <cstdio>
+
+// 低开销指标：计数器和直方图按线程分条（stripe）累加，热路径上只有 relaxed 原子加，
+// 不同线程写不同的缓存行；抓取时再把各分条汇总
+namespace metrics {
+
+constexpr size_t STRIPES = 8;
+
+// 当前线程使用的分条，线程第一次记录指标时分配
+inline size_t stripe() {
+    static std::atomic<size_t> next{0};
+    thread_local size_t index = next.fetch_add(1, std::memory_order_relaxed) % STRIPES;
+    return index;
+}
+
+class Counter {
+public:
+    void add(uint64_t n = 1) {
+        slots[stripe()].value.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    uint64_t value() const {
+        uint64_t total = 0;
+        for (const auto& slot : slots) {
+            total += slot.value.load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+
+private:
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> value{0};
+    };
+    Slot slots[STRIPES];
+};
+
+// HDR风格的对数线性直方图：每个2的幂区间再均分为 SUB_BUCKETS 个桶，相对误差不超过 1/SUB_BUCKETS。
+// 记录的数值单位由调用方决定（微秒、纳秒等）
+class Histogram {
+public:
+    static constexpr size_t SUB_BUCKETS = 4;
+    static constexpr size_t OCTAVES = 48;
+    static constexpr size_t BUCKETS = SUB_BUCKETS + (OCTAVES - 2) * SUB_BUCKETS;
+
+    struct Snapshot {
+        std::vector<uint64_t> buckets;
+        uint64_t count = 0;
+        uint64_t sum = 0;
+
+        // 分位数（0~1），返回所在桶的上界
+        uint64_t percentile(double q) const {
+            if (count == 0) return 0;
+            uint64_t rank = static_cast<uint64_t>(q * static_cast<double>(count) + 0.5);
+            if (rank == 0) rank = 1;
+            uint64_t seen = 0;
+            for (size_t i = 0; i < buckets.size(); ++i) {
+                seen += buckets[i];
+                if (seen >= rank) return upperBound(i);
+            }
+            return upperBound(buckets.size() - 1);
+        }
+
+        double mean() const {
+            return count == 0 ? 0.0 : static_cast<double>(sum) / static_cast<double>(count);
+        }
+    };
+
+    Histogram() : stripes(new Stripe[STRIPES]) {}
+
+    void record(uint64_t value) {
+        Stripe& s = stripes[stripe()];
+        s.buckets[bucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+        s.count.fetch_add(1, std::memory_order_relaxed);
+        s.sum.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    Snapshot snapshot() const {
+        Snapshot snap;
+        snap.buckets.assign(BUCKETS, 0);
+        for (size_t i = 0; i < STRIPES; ++i) {
+            const Stripe& s = stripes[i];
+            for (size_t b = 0; b < BUCKETS; ++b) {
+                snap.buckets[b] += s.buckets[b].load(std::memory_order_relaxed);
+            }
+            snap.count += s.count.load(std::memory_order_relaxed);
+            snap.sum += s.sum.load(std::memory_order_relaxed);
+        }
+        return snap;
+    }
+
+    static size_t bucketIndex(uint64_t value) {
+        if (value < SUB_BUCKETS) return static_cast<size_t>(value);
+        size_t octave = 63 - static_cast<size_t>(__builtin_clzll(value));  // value 所在的2的幂区间，>= 2
+        if (octave >= OCTAVES) return BUCKETS - 1;
+        size_t sub = static_cast<size_t>(value >> (octave - 2)) & (SUB_BUCKETS - 1);
+        return SUB_BUCKETS + (octave - 2) * SUB_BUCKETS + sub;
+    }
+
+    // 桶内的最大值
+    static uint64_t upperBound(size_t index) {
+        if (index < SUB_BUCKETS) return index;
+        size_t octave = (index - SUB_BUCKETS) / SUB_BUCKETS + 2;
+        uint64_t sub = (index - SUB_BUCKETS) % SUB_BUCKETS;
+        return ((SUB_BUCKETS + sub + 1) << (octave - 2)) - 1;
+    }
+
+private:
+    struct alignas(64) Stripe {
+        std::atomic<uint64_t> buckets[BUCKETS] = {};
+        std::atomic<uint64_t> count{0};
+        std::atomic<uint64_t> sum{0};
+    };
+    std::unique_ptr<Stripe[]> stripes;
+};
+
+// Prometheus 文本格式（0.0.4）输出
+class Writer {
+public:
+    using Labels = std::vector<std::pair<std::string, std::string>>;
+
+    // 每个指标族输出一次 HELP/TYPE
+    void family(const std::string& name, const std::string& help, const char* type) {
+        out.append("# HELP ").append(name).append(" ").append(help).append("\n");
+        out.append("# TYPE ").append(name).append(" ").append(type).append("\n");
+    }
+
+    void sample(const std::string& name, const Labels& labels, double value) {
+        out.append(name);
+        appendLabels(labels, nullptr);
+        out.append(" ").append(format(value)).append("\n");
+    }
+
+    // 直方图按2的幂输出累计桶，le 为桶上界乘以 scale（如微秒换算为秒时 scale=1e-6）。
+    // 记录时数值已截断为整数单位，所以桶上界取 upperBound + 1
+    void histogram(const std::string& name, const Labels& labels, const Histogram::Snapshot& snap, double scale) {
+        uint64_t cumulative = 0;
+        size_t last = 0;
+        for (size_t i = 0; i < snap.buckets.size(); ++i) {
+            if (snap.buckets[i] != 0) last = i;
+        }
+        for (size_t i = 0; i < snap.buckets.size(); ++i) {
+            cumulative += snap.buckets[i];
+            // 只在每个2的幂区间的末尾输出一个桶，直到最后一个非空桶所在的区间
+            if ((i + 1) % Histogram::SUB_BUCKETS != 0) continue;
+            std::string le = format(static_cast<double>(Histogram::upperBound(i) + 1) * scale);
+            out.append(name).append("_bucket");
+            appendLabels(labels, &le);
+            out.append(" ").append(std::to_string(cumulative)).append("\n");
+            if (i >= last && i >= Histogram::SUB_BUCKETS * 8) break;
+        }
+        std::string inf = "+Inf";
+        out.append(name).append("_bucket");
+        appendLabels(labels, &inf);
+        out.append(" ").append(std::to_string(snap.count)).append("\n");
+        sample(name + "_sum", labels, static_cast<double>(snap.sum) * scale);
+        sample(name + "_count", labels, static_cast<double>(snap.count));
+    }
+
+    const std::string& str() const {
+        return out;
+    }
+
+private:
+    std::string out;
+
+    static std::string format(double value) {
+        char buffer[32];
+        snprintf(buffer, sizeof(buffer), "%.9g", value);
+        return buffer;
+    }
+
+    static void escape(std::string& out, const std::string& value) {
+        for (char c : value) {
+            if (c == '\\') out.append("\\\\");
+            else if (c == '"') out.append("\\\"");
+            else if (c == '\n') out.append("\\n");
+            else out.push_back(c);
+        }
+    }
+
+    void appendLabels(const Labels& labels, const std::string* le) {
+        if (labels.empty() && le == nullptr) return;
+        out.push_back('{');
+        bool first = true;
+        for (const auto& label : labels) {
+            if (!first) out.push_back(',');
+            first = false;
+            out.append(label.first).append("=\"");
+            escape(out, label.second);
+            out.push_back('"');
+        }
+        if (le != nullptr) {
+            if (!first) out.push_back(',');
+            out.append("le=\"").append(*le).append("\"");
+        }
+        out.push_back('}');
+    }
+};
+
+} // namespace metrics
+
+#endif // METRICS_H
@@ -0,0 +1,322 @@
+// 热点函数的微基准：一致性哈希查找、本地存储读写（多线程竞争）、HTTP请求解析和响应序列化。
+// 迭代次数自动增长到每项至少运行 --min-time 秒；--json=文件 输出机器可读的结果，
+// --baseline=文件 与之前的结果对比，变慢超过 --threshold 的项标记为回归
+#include "cache_node.h"
+#include <random>
+#include <thread>
+#include <fstream>
+#include <iomanip>
+#include <sys/utsname.h>
+
+namespace {
+
+// 阻止编译器把被测结果优化掉
+template <typename T>
+inline void doNotOptimize(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+struct BenchResult {
+    string name;
+    json params;
+    int threads = 1;
+    uint64_t iterations = 0;   // 每个线程的迭代次数
+    double seconds = 0;
+    double ns_per_op = 0;      // 单个线程上每次操作的平均耗时
+    double ops_per_sec = 0;    // 所有线程合计的吞吐量
+};
+
+struct Runner {
+    double min_time = 0.2;
+    string filter;
+    vector<BenchResult> results;
+
+    // body(thread_index, iterations) 在每个线程上执行 iterations 次被测操作。
+    // 所有线程就绪后同时开始，以最慢线程结束的时刻计时
+    void run(const string& name, const json& params, int threads, const function<void(int, uint64_t)>& body) {
+        string full_name = name;
+        for (auto it = params.begin(); it != params.end(); ++it) {
+            full_name += "/" + it.key() + ":" + (it->is_string() ? it->get<string>() : it->dump());
+        }
+        full_name += "/threads:" + to_string(threads);
+        if (!filter.empty() && full_name.find(filter) == string::npos) {
+            return;
+        }
+
+        uint64_t iterations = 1;
+        double seconds = 0;
+        while (true) {
+            seconds = timeOnce(threads, iterations, body);
+            if (seconds >= min_time || iterations >= (1ULL << 40)) break;
+            // 按上次耗时估计达到 min_time 需要的次数，最多放大10倍
+            double scale = seconds > 0 ? min_time * 1.4 / seconds : 10.0;
+            iterations = static_cast<uint64_t>(iterations * max(2.0, min(10.0, scale)));
+        }
+
+        BenchResult result;
+        result.name = full_name;
+        result.params = params;
+        result.threads = threads;
+        result.iterations = iterations;
+        result.seconds = seconds;
+        result.ns_per_op = seconds * 1e9 / iterations;
+        result.ops_per_sec = iterations * threads / seconds;
+        cout << left << setw(64) << full_name << right
+             << setw(12) << fixed << setprecision(1) << result.ns_per_op << " ns/op"
+             << setw(16) << setprecision(0) << result.ops_per_sec << " ops/s"
+             << setw(14) << iterations << endl;
+        results.push_back(move(result));
+    }
+
+    static double timeOnce(int threads, uint64_t iterations, const function<void(int, uint64_t)>& body) {
+        if (threads == 1) {
+            auto start = chrono::steady_clock::now();
+            body(0, iterations);
+            return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        }
+        atomic<int> ready{0};
+        atomic<bool> go{false};
+        vector<thread> workers;
+        for (int t = 0; t < threads; ++t) {
+            workers.emplace_back([&, t]() {
+                ready.fetch_add(1);
+                while (!go.load(memory_order_acquire)) this_thread::yield();
+                body(t, iterations);
+            });
+        }
+        while (ready.load() < threads) this_thread::yield();
+        auto start = chrono::steady_clock::now();
+        go.store(true, memory_order_release);
+        for (auto& worker : workers) worker.join();
+        return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
+};
+
+vector<string> makeKeys(size_t count) {
+    vector<string> keys;
+    keys.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        keys.push_back("key:" + to_string(i * 2654435761ULL % 1000000007ULL));
+    }
+    return keys;
+}
+
+void benchRing(Runner& runner) {
+    vector<string> keys = makeKeys(1 << 16);
+    for (auto mode : {ConsistentHash::Mode::Ring, ConsistentHash::Mode::Rendezvous}) {
+        for (int node_count : {3, 16, 64}) {
+            ConsistentHash ring(mode);
+            for (int i = 0; i < node_count; ++i) {
+                ring.addNode("http://cache-server-" + to_string(i + 1) + ":" + to_string(9527 + i));
+            }
+            json params = {{"mode", mode == ConsistentHash::Mode::Ring ? "ring" : "rendezvous"}, {"nodes", node_count}};
+            runner.run("ring/getNode", params, 1, [&](int, uint64_t iterations) {
+                size_t mask = keys.size() - 1;
+                for (uint64_t i = 0; i < iterations; ++i) {
+                    doNotOptimize(ring.getNode(keys[i & mask]));
+                }
+            });
+        }
+    }
+}
+
+// 所有线程访问同一个节点的存储，key在 key_count 个中均匀选择
+void benchStore(Runner& runner) {
+    for (size_t key_count : {size_t(1000), size_t(100000)}) {
+        vector<string> keys = makeKeys(key_count);
+        for (size_t value_size : {size_t(64), size_t(1024), size_t(16384)}) {
+            CacheNode node("bench", 0, {"http://127.0.0.1:0"});
+            string value = "\"" + string(value_size - 2, 'x') + "\"";
+            for (const auto& key : keys) {
+                node.setLocal(key, value);
+            }
+            for (int threads : {1, 4, 16}) {
+                json params = {{"keys", key_count}, {"value", value_size}};
+                runner.run("store/getLocal", params, threads, [&](int t, uint64_t iterations) {
+                    string out;
+                    size_t index = static_cast<size_t>(t) * 7919;
+                    for (uint64_t i = 0; i < iterations; ++i) {
+                        doNotOptimize(node.getLocal(keys[(index + i) % key_count], out));
+                    }
+                });
+                runner.run("store/setLocal", params, threads, [&](int t, uint64_t iterations) {
+                    size_t index = static_cast<size_t>(t) * 7919;
+                    for (uint64_t i = 0; i < iterations; ++i) {
+                        doNotOptimize(node.setLocal(keys[(index + i) % key_count], value));
+                    }
+                });
+            }
+        }
+    }
+}
+
+void benchHttp(Runner& runner) {
+    for (size_t body_size : {size_t(0), size_t(1024), size_t(65536)}) {
+        string request;
+        if (body_size == 0) {
+            request = "GET /some-key HTTP/1.1\r\nHost: cache-server-1:9527\r\nUser-Agent: curl/7.68.0\r\n"
+                      "Accept: */*\r\n\r\n";
+        } else {
+            request = "POST / HTTP/1.1\r\nHost: cache-server-1:9527\r\nUser-Agent: curl/7.68.0\r\nAccept: */*\r\n"
+                      "Content-Type: application/json\r\nContent-Length: " + to_string(body_size) + "\r\n\r\n" +
+                      string(body_size, 'x');
+        }
+        runner.run("http/parseRequest", {{"body", body_size}}, 1, [&](int, uint64_t iterations) {
+            httplib::RequestParser parser;
+            for (uint64_t i = 0; i < iterations; ++i) {
+                httplib::Request req;
+                size_t consumed = 0;
+                doNotOptimize(parser.parse(request.data(), request.size(), req, consumed));
+                doNotOptimize(req.path);
+            }
+        });
+    }
+
+    string cors = httplib::Server::render_headers({
+        {"Access-Control-Allow-Origin", "*"},
+        {"Access-Control-Allow-Methods", "GET, POST, DELETE, OPTIONS"},
+        {"Access-Control-Allow-Headers", "Content-Type"},
+    });
+    for (size_t body_size : {size_t(16), size_t(1024), size_t(65536)}) {
+        httplib::Response res;
+        res.set_header("Content-Type", "application/json; charset=utf-8");
+        res.body = string(body_size, 'x');
+        runner.run("http/createResponse", {{"body", body_size}}, 1, [&](int, uint64_t iterations) {
+            for (uint64_t i = 0; i < iterations; ++i) {
+                doNotOptimize(httplib::Server::create_response(res, cors));
+            }
+        });
+    }
+
+    // 服务端实际的发送路径：头部写入复用的缓冲区，正文不参与复制
+    httplib::Response res;
+    res.set_header("Content-Type", "application/json; charset=utf-8");
+    runner.run("http/writeHead", {}, 1, [&](int, uint64_t iterations) {
+        string head;
+        for (uint64_t i = 0; i < iterations; ++i) {
+            head.clear();
+            httplib::Server::write_head(res, cors, head);
+            doNotOptimize(head);
+        }
+    });
+}
+
+// 与基线结果（之前 --json 输出的文件）按名称对比，返回变慢超过 threshold 的项数
+int compareBaseline(const vector<BenchResult>& results, const string& path, double threshold) {
+    ifstream in(path);
+    json baseline;
+    try {
+        baseline = json::parse(in);
+    } catch (const exception& e) {
+        cerr << "无法读取基线 " << path << ": " << e.what() << endl;
+        return -1;
+    }
+    map<string, double> previous;
+    for (const auto& item : baseline.value("benchmarks", json::array())) {
+        previous[item.at("name").get<string>()] = item.at("ns_per_op").get<double>();
+    }
+
+    int regressions = 0;
+    cout << endl << "compared with " << path << ":" << endl;
+    for (const auto& result : results) {
+        auto it = previous.find(result.name);
+        if (it == previous.end() || it->second <= 0) continue;
+        double change = (result.ns_per_op - it->second) / it->second;
+        bool regressed = change > threshold;
+        regressions += regressed ? 1 : 0;
+        cout << left << setw(64) << result.name << right << setw(12) << setprecision(1) << it->second << " -> "
+             << setw(10) << result.ns_per_op << " ns/op " << showpos << setw(8) << change * 100 << noshowpos << "%"
+             << (regressed ? "  REGRESSION" : "") << endl;
+    }
+    return regressions;
+}
+
+json context() {
+    json ctx;
+    auto now = chrono::system_clock::to_time_t(chrono::system_clock::now());
+    char date[32];
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+    ctx["date"] = date;
+    ctx["num_cpus"] = thread::hardware_concurrency();
+    struct utsname name;
+    if (uname(&name) == 0) {
+        ctx["host"] = name.nodename;
+        ctx["kernel"] = string(name.sysname) + " " + name.release;
+    }
+#ifdef __VERSION__
+    ctx["compiler"] = __VERSION__;
+#endif
+    return ctx;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Runner runner;
+    string json_path;
+    string baseline_path;
+    double threshold = 0.1;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        size_t eq = arg.find('=');
+        string name = eq == string::npos ? arg : arg.substr(0, eq);
+        string value = eq == string::npos ? "" : arg.substr(eq + 1);
+        try {
+            if (name == "--min-time") {
+                runner.min_time = stod(value);
+            } else if (name == "--filter") {
+                runner.filter = value;
+            } else if (name == "--json") {
+                json_path = value;
+            } else if (name == "--baseline") {
+                baseline_path = value;
+            } else if (name == "--threshold") {
+                threshold = stod(value);
+            } else {
+                throw invalid_argument(arg);
+            }
+        } catch (const exception& e) {
+            cerr << "无效参数: " << arg << endl;
+            cerr << "用法: " << argv[0] << " [--filter=名称子串] [--min-time=秒] [--json=文件] [--baseline=文件] [--threshold=0.1]" << endl;
+            return 1;
+        }
+    }
+
+    cout << left << setw(64) << "benchmark" << right << setw(18) << "time" << setw(22) << "throughput"
+         << setw(14) << "iterations" << endl;
+    benchRing(runner);
+    benchStore(runner);
+    benchHttp(runner);
+
+    if (!json_path.empty()) {
+        json output;
+        output["context"] = context();
+        output["benchmarks"] = json::array();
+        for (const auto& result : runner.results) {
+            output["benchmarks"].push_back({
+                {"name", result.name},
+                {"params", result.params},
+                {"threads", result.threads},
+                {"iterations", result.iterations},
+                {"real_time_s", result.seconds},
+                {"ns_per_op", result.ns_per_op},
+                {"ops_per_sec", result.ops_per_sec},
+            });
+        }
+        ofstream out(json_path);
+        out << output.dump(2) << endl;
+        if (!out) {
+            cerr << "写入 " << json_path << " 失败" << endl;
+            return 1;
+        }
+    }
+
+    // 有任何一项比基线慢 threshold 以上时返回非零，便于在脚本中检查
+    if (!baseline_path.empty()) {
+        int regressions = compareBaseline(runner.results, baseline_path, threshold);
+        if (regressions != 0) {
+            return 2;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,584 @@
+#ifndef PERSISTENCE_H
+#define PERSISTENCE_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "cache_store.h"
+
+// 本地存储的持久化：追加写日志（WAL）+ 定期快照。
+//
+// 目录中的文件：
+//   wal.<N>.log       日志段，记录格式 [u32 记录长度][u32 CRC32][u8 类型][i64 过期时间][u32 key长度][key][值]
+//   snapshot.<N>.dat  快照，包含 wal.<N> 之前的所有写入，格式 [8字节魔数][u64 条目数]
+//                     后接若干 [u32 key长度][u32 值长度][i64 过期时间][key][值]
+// 过期时间为系统时钟的毫秒数（0 表示永不过期），重启后按剩余时间恢复。
+// 快照和日志都按顺序解析，恢复时直接 mmap 文件，不经过逐条 read。
+//
+// 作为存储的写入日志（StoreJournal），在存储的分段写锁内追加记录，同一个key的日志顺序与写入顺序一致。
+// 写入只追加到内存缓冲区，后台线程把一段时间内的写入合并成一次 write + fdatasync（组提交）。
+// 追加从不等待落盘；开启 sync_writes 时，写入方用 whenDurable 在此前的写入都落盘后再回复，
+// 不阻塞调用线程（事件循环线程上也可以使用）。
+// write 或 fdatasync 失败后不再认为任何写入已落盘（失败的 fdatasync 之后再成功也不能保证之前的数据还在），
+// 之后的 whenDurable 都以失败结束，直到重启后从快照和日志重新恢复。
+// 快照时先切换到新的日志段再遍历存储，快照写完后删除旧的日志段和快照
+class Persistence : public StoreJournal {
+public:
+    struct Options {
+        std::string dir;
+        int fsync_interval_ms = 10;          // 组提交间隔
+        bool sync_writes = false;            // 写入是否等待落盘
+        int snapshot_interval_sec = 300;     // 定期快照间隔
+        size_t snapshot_wal_bytes = 64 * 1024 * 1024;  // 日志超过该大小时提前快照
+    };
+
+    struct Stats {
+        uint64_t wal_bytes = 0;
+        uint64_t snapshots = 0;
+        uint64_t last_snapshot_keys = 0;
+        uint64_t recovered_keys = 0;
+    };
+
+    Persistence(const Options& options, ShardedStore& store) : options(options), store(store) {}
+
+    ~Persistence() {
+        stop();
+    }
+
+    Persistence(const Persistence&) = delete;
+    Persistence& operator=(const Persistence&) = delete;
+
+    // 从最新的快照和之后的日志段恢复数据，然后打开新的日志段。返回恢复的key数
+    size_t recover() {
+        mkdir(options.dir.c_str(), 0755);
+        uint64_t snapshot_seq = 0;
+        bool has_snapshot = false;
+        std::vector<uint64_t> wal_segments;
+        for (const auto& name : listDir()) {
+            uint64_t seq;
+            if (parseName(name, "snapshot.", ".dat", seq)) {
+                if (!has_snapshot || seq > snapshot_seq) {
+                    snapshot_seq = seq;
+                    has_snapshot = true;
+                }
+            } else if (parseName(name, "wal.", ".log", seq)) {
+                wal_segments.push_back(seq);
+            }
+        }
+        std::sort(wal_segments.begin(), wal_segments.end());
+
+        if (has_snapshot) {
+            loadSnapshot(path("snapshot.", snapshot_seq, ".dat"));
+        }
+        uint64_t last_seq = snapshot_seq;
+        for (uint64_t seq : wal_segments) {
+            if (has_snapshot && seq < snapshot_seq) continue;
+            replayWal(path("wal.", seq, ".log"));
+            last_seq = std::max(last_seq, seq);
+        }
+        stats_recovered = store.size();
+
+        // 新的日志段接在已有文件之后，避免覆盖尚未快照的日志
+        wal_seq = wal_segments.empty() && !has_snapshot ? 0 : last_seq + 1;
+        openWal();
+        store.setJournal(this);
+        return stats_recovered;
+    }
+
+    // 启动组提交线程和快照线程
+    void start() {
+        running = true;
+        flusher = std::thread([this]() { flushLoop(); });
+        snapshotter = std::thread([this]() { snapshotLoop(); });
+    }
+
+    // 刷出所有缓冲的写入并停止后台线程
+    void stop() {
+        store.setJournal(nullptr);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            running = false;
+        }
+        flush_cv.notify_all();
+        snapshot_cv.notify_all();
+        if (flusher.joinable()) flusher.join();
+        if (snapshotter.joinable()) snapshotter.join();
+        // 日志文件打不开时也要执行剩余的等待回调
+        flushBuffer();
+        if (wal_fd >= 0) {
+            close(wal_fd);
+            wal_fd = -1;
+        }
+    }
+
+    void logSet(const std::string& key, std::string_view value, int64_t ttl_ms) override {
+        int64_t expire_at = ttl_ms > 0 ? wallMs() + ttl_ms : 0;
+        append(RECORD_SET, key, value, expire_at);
+    }
+
+    void logDelete(const std::string& key) override {
+        append(RECORD_DELETE, key, std::string_view(), 0);
+    }
+
+    // 到目前为止追加的所有记录都落盘后执行 done(true)：已经落盘（或未开启 sync_writes、已停止）时
+    // 直接在当前线程执行，否则由组提交线程在 fdatasync 之后执行，done 应尽快返回。
+    // 日志写入失败过时执行 done(false)，写入方应向客户端报告失败
+    void whenDurable(std::function<void(bool ok)> done) {
+        bool ok;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (options.sync_writes && running && !failed && durable < appended) {
+                waiters.emplace_back(appended, std::move(done));
+                flush_cv.notify_one();
+                return;
+            }
+            ok = !failed;
+        }
+        done(ok);
+    }
+
+    // 日志写入失败过，之后的写入都不再持久化
+    bool healthy() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return !failed;
+    }
+
+    Stats stats() const {
+        Stats s;
+        s.wal_bytes = wal_bytes.load(std::memory_order_relaxed);
+        s.snapshots = snapshots.load(std::memory_order_relaxed);
+        s.last_snapshot_keys = last_snapshot_keys.load(std::memory_order_relaxed);
+        s.recovered_keys = stats_recovered;
+        return s;
+    }
+
+private:
+    static constexpr uint8_t RECORD_SET = 1;
+    static constexpr uint8_t RECORD_DELETE = 2;
+    static constexpr size_t RECORD_HEADER = 4 + 4;          // 记录长度 + CRC
+    static constexpr size_t RECORD_FIXED = 1 + 8 + 4;       // 类型 + 过期时间 + key长度
+    static constexpr size_t FLUSH_BYTES = 1024 * 1024;      // 缓冲超过该大小时立即刷出
+    static constexpr char SNAPSHOT_MAGIC[8] = {'S', 'D', 'C', 'S', 'S', 'N', 'P', '1'};
+
+    Options options;
+    ShardedStore& store;
+
+    // mutex 保护缓冲区和序号；io_mutex 保护日志文件，持有顺序为 io_mutex -> mutex
+    std::mutex mutex;
+    std::mutex io_mutex;
+    std::condition_variable flush_cv;
+    std::condition_variable snapshot_cv;
+    std::string buffer;
+    uint64_t appended = 0;
+    uint64_t durable = 0;
+    bool running = false;
+    bool failed = false;  // write 或 fdatasync 失败过，durable 不再前进
+    // 等待落盘的回调，按序号递增排列
+    std::deque<std::pair<uint64_t, std::function<void(bool)>>> waiters;
+
+    int wal_fd = -1;
+    uint64_t wal_seq = 0;
+    std::atomic<uint64_t> wal_bytes{0};
+    std::atomic<uint64_t> snapshots{0};
+    std::atomic<uint64_t> last_snapshot_keys{0};
+    uint64_t stats_recovered = 0;
+    std::thread flusher;
+    std::thread snapshotter;
+
+    static int64_t wallMs() {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    static uint32_t crc32(const char* data, size_t size) {
+        static const std::vector<uint32_t> table = []() {
+            std::vector<uint32_t> t(256);
+            for (uint32_t i = 0; i < 256; ++i) {
+                uint32_t c = i;
+                for (int k = 0; k < 8; ++k) {
+                    c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                }
+                t[i] = c;
+            }
+            return t;
+        }();
+        uint32_t crc = 0xFFFFFFFFu;
+        for (size_t i = 0; i < size; ++i) {
+            crc = table[(crc ^ static_cast<unsigned char>(data[i])) & 0xFF] ^ (crc >> 8);
+        }
+        return crc ^ 0xFFFFFFFFu;
+    }
+
+    static void putU32(std::string& out, uint32_t v) {
+        out.append(reinterpret_cast<const char*>(&v), 4);
+    }
+
+    static void putI64(std::string& out, int64_t v) {
+        out.append(reinterpret_cast<const char*>(&v), 8);
+    }
+
+    template <typename T>
+    static T load(const char* p) {
+        T v;
+        memcpy(&v, p, sizeof(T));
+        return v;
+    }
+
+    std::string path(const char* prefix, uint64_t seq, const char* suffix) const {
+        return options.dir + "/" + prefix + std::to_string(seq) + suffix;
+    }
+
+    std::vector<std::string> listDir() const {
+        std::vector<std::string> names;
+        DIR* dir = opendir(options.dir.c_str());
+        if (dir == nullptr) return names;
+        while (struct dirent* entry = readdir(dir)) {
+            names.emplace_back(entry->d_name);
+        }
+        closedir(dir);
+        return names;
+    }
+
+    static bool parseName(const std::string& name, const std::string& prefix, const std::string& suffix, uint64_t& seq) {
+        if (name.size() <= prefix.size() + suffix.size() || name.compare(0, prefix.size(), prefix) != 0 ||
+            name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0) {
+            return false;
+        }
+        std::string digits = name.substr(prefix.size(), name.size() - prefix.size() - suffix.size());
+        if (digits.find_first_not_of("0123456789") != std::string::npos) return false;
+        seq = std::stoull(digits);
+        return true;
+    }
+
+    void syncDir() const {
+        int fd = open(options.dir.c_str(), O_RDONLY | O_DIRECTORY);
+        if (fd >= 0) {
+            fsync(fd);
+            close(fd);
+        }
+    }
+
+    void openWal() {
+        std::string file = path("wal.", wal_seq, ".log");
+        wal_fd = open(file.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (wal_fd < 0) {
+            std::cerr << "无法打开日志文件 " << file << ": " << strerror(errno) << std::endl;
+        }
+        syncDir();
+    }
+
+    void append(uint8_t type, const std::string& key, std::string_view value, int64_t expire_at) {
+        std::string payload;
+        payload.reserve(RECORD_FIXED + key.size() + value.size());
+        payload.push_back(static_cast<char>(type));
+        putI64(payload, expire_at);
+        putU32(payload, static_cast<uint32_t>(key.size()));
+        payload.append(key);
+        payload.append(value.data(), value.size());
+        uint32_t crc = crc32(payload.data(), payload.size());
+
+        // 调用方持有存储的分段锁，这里只做内存追加，不等待落盘
+        std::lock_guard<std::mutex> lock(mutex);
+        putU32(buffer, static_cast<uint32_t>(payload.size()));
+        putU32(buffer, crc);
+        buffer.append(payload);
+        ++appended;
+        if (buffer.size() >= FLUSH_BYTES) {
+            flush_cv.notify_one();
+        }
+    }
+
+    // 把缓冲区写入当前日志段并 fdatasync，然后执行已经落盘的等待回调
+    void flushBuffer() {
+        {
+            std::lock_guard<std::mutex> io_lock(io_mutex);
+            std::string pending;
+            uint64_t target;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                pending.swap(buffer);
+                target = appended;
+            }
+            bool ok = pending.empty() || syncWal(pending);
+            std::lock_guard<std::mutex> lock(mutex);
+            commit(target, ok);
+        }
+        runWaiters();
+    }
+
+    // 调用方需持有 io_mutex：写入并 fdatasync，有数据要写而日志文件没能打开也算失败
+    bool syncWal(const std::string& data) {
+        if (wal_fd < 0) return data.empty();
+        if (!writeWal(data)) return false;
+        while (fdatasync(wal_fd) < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "日志落盘失败: " << strerror(errno) << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // 调用方需持有 mutex：写到 target 为止的记录成功落盘时推进 durable，失败后不再推进
+    void commit(uint64_t target, bool ok) {
+        if (!ok && !failed) {
+            failed = true;
+            std::cerr << "日志写入失败，之后的写入不再持久化" << std::endl;
+        }
+        if (!failed) {
+            durable = std::max(durable, target);
+        }
+    }
+
+    // 在不持有任何锁时执行已经落盘的等待回调（回调中可能再次写入）；
+    // 日志写入失败或停止时还没落盘的回调以失败结束
+    void runWaiters() {
+        std::vector<std::pair<std::function<void(bool)>, bool>> ready;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            while (!waiters.empty() && (waiters.front().first <= durable || failed || !running)) {
+                ready.emplace_back(std::move(waiters.front().second), waiters.front().first <= durable);
+                waiters.pop_front();
+            }
+        }
+        for (auto& item : ready) {
+            item.first(item.second);
+        }
+    }
+
+    // 调用方需持有 io_mutex；没有全部写入时返回 false
+    bool writeWal(const std::string& data) {
+        size_t written = 0;
+        bool ok = true;
+        while (written < data.size()) {
+            ssize_t n = write(wal_fd, data.data() + written, data.size() - written);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                std::cerr << "写入日志失败: " << strerror(errno) << std::endl;
+                ok = false;
+                break;
+            }
+            written += n;
+        }
+        wal_bytes.fetch_add(written, std::memory_order_relaxed);
+        return ok;
+    }
+
+    void flushLoop() {
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                flush_cv.wait_for(lock, std::chrono::milliseconds(options.fsync_interval_ms),
+                                  [&]() { return !running || buffer.size() >= FLUSH_BYTES || !waiters.empty(); });
+                if (!running) return;
+            }
+            flushBuffer();
+        }
+    }
+
+    void snapshotLoop() {
+        auto last = std::chrono::steady_clock::now();
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                snapshot_cv.wait_for(lock, std::chrono::seconds(1), [&]() { return !running; });
+                if (!running) return;
+            }
+            bool due = std::chrono::steady_clock::now() - last >= std::chrono::seconds(options.snapshot_interval_sec);
+            if (due || wal_bytes.load(std::memory_order_relaxed) >= options.snapshot_wal_bytes) {
+                snapshot();
+                last = std::chrono::steady_clock::now();
+            }
+        }
+    }
+
+    // 切换到新的日志段，之后的写入都在新段中；返回新段的序号
+    uint64_t rotate() {
+        uint64_t seq;
+        {
+            std::lock_guard<std::mutex> io_lock(io_mutex);
+            std::string pending;
+            uint64_t target;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                pending.swap(buffer);
+                target = appended;
+            }
+            bool ok = syncWal(pending);
+            if (wal_fd >= 0) {
+                close(wal_fd);
+            }
+            wal_seq++;
+            wal_bytes.store(0, std::memory_order_relaxed);
+            openWal();
+            seq = wal_seq;
+            std::lock_guard<std::mutex> lock(mutex);
+            commit(target, ok);
+        }
+        runWaiters();
+        return seq;
+    }
+
+    // 写一个覆盖新日志段之前所有写入的快照，成功后删除更早的日志段和快照
+    bool snapshot() {
+        uint64_t seq = rotate();
+        std::string tmp = path("snapshot.", seq, ".tmp");
+        FILE* file = fopen(tmp.c_str(), "wb");
+        if (file == nullptr) {
+            std::cerr << "无法创建快照 " << tmp << ": " << strerror(errno) << std::endl;
+            return false;
+        }
+        std::vector<char> io_buffer(1 << 20);
+        setvbuf(file, io_buffer.data(), _IOFBF, io_buffer.size());
+
+        uint64_t count = 0;
+        fwrite(SNAPSHOT_MAGIC, 1, sizeof(SNAPSHOT_MAGIC), file);
+        fwrite(&count, sizeof(count), 1, file);  // 写完后回填
+        int64_t now = wallMs();
+        std::string value;
+        std::string header;
+        for (size_t shard = 0; shard < store.shardCount(); ++shard) {
+            for (const auto& key : store.keys(shard)) {
+                int64_t ttl_ms;
+                if (!store.get(key, value, ttl_ms)) continue;
+                header.clear();
+                putU32(header, static_cast<uint32_t>(key.size()));
+                putU32(header, static_cast<uint32_t>(value.size()));
+                putI64(header, ttl_ms > 0 ? now + ttl_ms : 0);
+                fwrite(header.data(), 1, header.size(), file);
+                fwrite(key.data(), 1, key.size(), file);
+                fwrite(value.data(), 1, value.size(), file);
+                count++;
+            }
+        }
+        fseek(file, sizeof(SNAPSHOT_MAGIC), SEEK_SET);
+        fwrite(&count, sizeof(count), 1, file);
+        bool ok = fflush(file) == 0 && fsync(fileno(file)) == 0;
+        fclose(file);
+        if (!ok || rename(tmp.c_str(), path("snapshot.", seq, ".dat").c_str()) != 0) {
+            std::cerr << "写入快照失败: " << strerror(errno) << std::endl;
+            unlink(tmp.c_str());
+            return false;
+        }
+        syncDir();
+
+        // 快照已包含 wal.<seq> 之前的全部写入
+        for (const auto& name : listDir()) {
+            uint64_t old;
+            if ((parseName(name, "wal.", ".log", old) || parseName(name, "snapshot.", ".dat", old)) && old < seq) {
+                unlink((options.dir + "/" + name).c_str());
+            }
+        }
+        snapshots.fetch_add(1, std::memory_order_relaxed);
+        last_snapshot_keys.store(count, std::memory_order_relaxed);
+        return true;
+    }
+
+    // 只读映射整个文件，文件为空或不存在时返回 nullptr
+    static const char* mapFile(const std::string& file, size_t& size) {
+        int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return nullptr;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) {
+            close(fd);
+            return nullptr;
+        }
+        size = static_cast<size_t>(st.st_size);
+        void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED) return nullptr;
+        madvise(data, size, MADV_SEQUENTIAL);
+        return static_cast<const char*>(data);
+    }
+
+    // 过期时间换算成剩余毫秒数，已过期返回 -1
+    static int64_t remainingTtl(int64_t expire_at, int64_t now) {
+        if (expire_at == 0) return 0;
+        return expire_at > now ? expire_at - now : -1;
+    }
+
+    size_t loadSnapshot(const std::string& file) {
+        size_t size = 0;
+        const char* data = mapFile(file, size);
+        if (data == nullptr) return 0;
+        size_t loaded = 0;
+        int64_t now = wallMs();
+        if (size >= 16 && memcmp(data, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) == 0) {
+            uint64_t count = load<uint64_t>(data + 8);
+            size_t offset = 16;
+            std::string key;
+            for (uint64_t i = 0; i < count && offset + 16 <= size; ++i) {
+                uint32_t key_size = load<uint32_t>(data + offset);
+                uint32_t value_size = load<uint32_t>(data + offset + 4);
+                int64_t expire_at = load<int64_t>(data + offset + 8);
+                offset += 16;
+                if (offset + key_size + value_size > size) break;
+                int64_t ttl_ms = remainingTtl(expire_at, now);
+                if (ttl_ms >= 0) {
+                    key.assign(data + offset, key_size);
+                    store.set(key, std::string_view(data + offset + key_size, value_size), ttl_ms);
+                    loaded++;
+                }
+                offset += key_size + value_size;
+            }
+        } else {
+            std::cerr << "快照格式无效: " << file << std::endl;
+        }
+        munmap(const_cast<char*>(data), size);
+        return loaded;
+    }
+
+    // 重放一个日志段，遇到不完整或校验失败的记录（崩溃时写了一半）就停止
+    void replayWal(const std::string& file) {
+        size_t size = 0;
+        const char* data = mapFile(file, size);
+        if (data == nullptr) return;
+        int64_t now = wallMs();
+        size_t offset = 0;
+        std::string key;
+        while (offset + RECORD_HEADER <= size) {
+            uint32_t length = load<uint32_t>(data + offset);
+            uint32_t crc = load<uint32_t>(data + offset + 4);
+            const char* payload = data + offset + RECORD_HEADER;
+            if (length < RECORD_FIXED || offset + RECORD_HEADER + length > size || crc32(payload, length) != crc) {
+                break;
+            }
+            uint8_t type = static_cast<uint8_t>(payload[0]);
+            int64_t expire_at = load<int64_t>(payload + 1);
+            uint32_t key_size = load<uint32_t>(payload + 9);
+            if (RECORD_FIXED + key_size > length) break;
+            key.assign(payload + RECORD_FIXED, key_size);
+            if (type == RECORD_SET) {
+                int64_t ttl_ms = remainingTtl(expire_at, now);
+                if (ttl_ms >= 0) {
+                    store.set(key, std::string_view(payload + RECORD_FIXED + key_size, length - RECORD_FIXED - key_size), ttl_ms);
+                } else {
+                    store.erase(key);
+                }
+            } else if (type == RECORD_DELETE) {
+                store.erase(key);
+            }
+            offset += RECORD_HEADER + length;
+        }
+        munmap(const_cast<char*>(data), size);
+    }
+};
+
+#endif // PERSISTENCE_H
@@ -0,0 +1,387 @@
+#ifndef RESP_SERVER_H
+#define RESP_SERVER_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <charconv>
+#include <cstdint>
+#include <strings.h>
+#include "httplib.h"
+
+// Redis 协议（RESP2）前端：解析客户端命令，回复由处理函数编码。
+// 支持多条命令批量发送（流水线）；同一连接上的命令按顺序执行、按顺序回复
+namespace resp {
+
+constexpr size_t MAX_BULK_SIZE = 64 * 1024 * 1024;
+constexpr size_t MAX_ARGS = 1024 * 1024;
+constexpr size_t MAX_INLINE_SIZE = 64 * 1024;
+// 每个连接缓冲的未处理输入上限：一个最大的批量参数加上命令头部的余量
+constexpr size_t MAX_BUFFERED_INPUT = MAX_BULK_SIZE + 1024 * 1024;
+
+inline void put_number(std::string& out, char type, int64_t value) {
+    char number[24];
+    out.push_back(type);
+    out.append(number, std::to_chars(number, number + sizeof(number), value).ptr);
+    out.append("\r\n");
+}
+
+inline void put_simple(std::string& out, std::string_view text) {
+    out.push_back('+');
+    out.append(text.data(), text.size());
+    out.append("\r\n");
+}
+
+// message 不带 "ERR " 前缀时自动加上
+inline void put_error(std::string& out, std::string_view message) {
+    out.push_back('-');
+    if (message.compare(0, 4, "ERR ") != 0) out.append("ERR ");
+    out.append(message.data(), message.size());
+    out.append("\r\n");
+}
+
+inline void put_integer(std::string& out, int64_t value) {
+    put_number(out, ':', value);
+}
+
+inline void put_bulk(std::string& out, std::string_view value) {
+    put_number(out, '$', static_cast<int64_t>(value.size()));
+    out.append(value.data(), value.size());
+    out.append("\r\n");
+}
+
+inline void put_null(std::string& out) {
+    out.append("$-1\r\n");
+}
+
+inline void put_array(std::string& out, size_t count) {
+    put_number(out, '*', static_cast<int64_t>(count));
+}
+
+// 解析 data 开头的一条命令：多条批量字符串组成的数组，或者以空白分隔的内联命令（telnet 等）。
+// 数据不完整时不复制任何参数
+class Parser {
+public:
+    enum class Result {
+        Incomplete,
+        Complete,
+        Error
+    };
+
+    static Result parse(const char* data, size_t size, std::vector<std::string>& args, size_t& consumed) {
+        args.clear();
+        consumed = 0;
+        if (size == 0) return Result::Incomplete;
+        if (data[0] != '*') {
+            return parse_inline(data, size, args, consumed);
+        }
+
+        size_t pos = 0;
+        int64_t count;
+        Result result = read_number(data, size, pos, '*', count);
+        if (result != Result::Complete) return result;
+        if (count > static_cast<int64_t>(MAX_ARGS)) return Result::Error;
+
+        // 先确认整条命令都已到达，再复制参数
+        size_t start = pos;
+        for (int64_t i = 0; i < count; ++i) {
+            int64_t length;
+            result = read_number(data, size, pos, '$', length);
+            if (result != Result::Complete) return result;
+            if (length < 0 || length > static_cast<int64_t>(MAX_BULK_SIZE)) return Result::Error;
+            if (size - pos < static_cast<size_t>(length) + 2) return Result::Incomplete;
+            if (data[pos + length] != '\r' || data[pos + length + 1] != '\n') return Result::Error;
+            pos += length + 2;
+        }
+
+        args.reserve(count > 0 ? count : 0);
+        pos = start;
+        for (int64_t i = 0; i < count; ++i) {
+            int64_t length;
+            read_number(data, size, pos, '$', length);
+            args.emplace_back(data + pos, length);
+            pos += length + 2;
+        }
+        consumed = pos;
+        return Result::Complete;
+    }
+
+private:
+    // 读取 "<type><整数>\r\n"
+    static Result read_number(const char* data, size_t size, size_t& pos, char type, int64_t& value) {
+        const char* begin = data + pos;
+        const char* end = static_cast<const char*>(memchr(begin, '\n', size - pos));
+        if (end == nullptr) {
+            return size - pos > MAX_INLINE_SIZE ? Result::Error : Result::Incomplete;
+        }
+        if (*begin != type || end - begin < 3 || end[-1] != '\r') return Result::Error;
+        auto parsed = std::from_chars(begin + 1, end - 1, value);
+        if (parsed.ec != std::errc() || parsed.ptr != end - 1) return Result::Error;
+        pos = end + 1 - data;
+        return Result::Complete;
+    }
+
+    static Result parse_inline(const char* data, size_t size, std::vector<std::string>& args, size_t& consumed) {
+        const char* end = static_cast<const char*>(memchr(data, '\n', size));
+        if (end == nullptr) {
+            return size > MAX_INLINE_SIZE ? Result::Error : Result::Incomplete;
+        }
+        const char* line_end = end > data && end[-1] == '\r' ? end - 1 : end;
+        const char* p = data;
+        while (p < line_end) {
+            while (p < line_end && (*p == ' ' || *p == '\t')) ++p;
+            const char* word = p;
+            while (p < line_end && *p != ' ' && *p != '\t') ++p;
+            if (p > word) args.emplace_back(word, p - word);
+        }
+        consumed = end + 1 - data;
+        return Result::Complete;
+    }
+};
+
+// 单个事件循环线程负责所有连接的读写和命令分发。处理函数在事件循环线程中调用，
+// 可以直接回复，也可以在其他线程中稍后回复；回复之前同一连接的后续命令不会执行
+class Server {
+public:
+    // 参数为编码好的回复，必须恰好调用一次
+    using Reply = std::function<void(std::string reply)>;
+    using Handler = std::function<void(std::vector<std::string>& args, Reply reply)>;
+
+    explicit Server(Handler handler) : handler(std::move(handler)) {}
+
+    bool listen(const std::string& host, int port) {
+        server_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (server_fd < 0) {
+            std::cerr << "RESP socket creation failed" << std::endl;
+            return false;
+        }
+        int opt = 1;
+        setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+        struct sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        if (inet_pton(AF_INET, host.c_str(), &address.sin_addr) <= 0) {
+            address.sin_addr.s_addr = INADDR_ANY;
+        }
+        address.sin_port = htons(port);
+        if (bind(server_fd, (struct sockaddr*)&address, sizeof(address)) < 0 || ::listen(server_fd, SOMAXCONN) < 0) {
+            std::cerr << "RESP bind failed on port " << port << std::endl;
+            close(server_fd);
+            return false;
+        }
+
+        loop_thread = std::this_thread::get_id();
+        on_accept = [this](uint32_t) { accept_connections(); };
+        loop.add(server_fd, EPOLLIN | EPOLLET, &on_accept);
+        loop.run();
+
+        for (auto& item : connections) {
+            close(item.first);
+        }
+        connections.clear();
+        close(server_fd);
+        return true;
+    }
+
+    void stop() {
+        loop.stop();
+    }
+
+private:
+    struct Connection {
+        int fd = -1;
+        std::string in;
+        size_t in_offset = 0;
+        std::string out;
+        size_t out_offset = 0;
+        bool busy = false;               // 有命令在等待回复
+        bool input_full = false;         // 缓冲已达上限，暂停读取，剩余数据由TCP流控挡在内核中
+        bool close_after_write = false;  // 协议错误或 QUIT：回复发完后关闭
+        bool peer_closed = false;
+        bool closed = false;
+        httplib::detail::EventLoop::EventHandler on_event;
+    };
+
+    Handler handler;
+    httplib::detail::EventLoop loop;
+    httplib::detail::EventLoop::EventHandler on_accept;
+    std::unordered_map<int, std::shared_ptr<Connection>> connections;
+    std::thread::id loop_thread;
+    int server_fd = -1;
+
+    void accept_connections() {
+        while (true) {
+            int fd = accept4(server_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) {
+                if (errno == EINTR) continue;
+                return;
+            }
+            int opt = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+            auto conn = std::make_shared<Connection>();
+            conn->fd = fd;
+            Connection* raw = conn.get();
+            conn->on_event = [this, raw](uint32_t events) { handle_event(raw, events); };
+            connections[fd] = conn;
+            if (!loop.add(fd, EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET, &conn->on_event)) {
+                close_connection(raw);
+            }
+        }
+    }
+
+    void handle_event(Connection* conn, uint32_t events) {
+        if (conn->closed) return;
+        if (events & EPOLLERR) {
+            close_connection(conn);
+            return;
+        }
+        if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) {
+            read_input(conn);
+            if (conn->closed) return;
+        }
+        flush(conn);
+    }
+
+    // 边沿触发：读到 EAGAIN 或缓冲达到上限为止
+    void read_input(Connection* conn) {
+        char buffer[16384];
+        conn->input_full = false;
+        while (true) {
+            if (conn->in.size() - conn->in_offset >= MAX_BUFFERED_INPUT) {
+                conn->input_full = true;
+                break;
+            }
+            ssize_t n = recv(conn->fd, buffer, sizeof(buffer), 0);
+            if (n > 0) {
+                conn->in.append(buffer, n);
+                continue;
+            }
+            if (n == 0) {
+                conn->peer_closed = true;
+                break;
+            }
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            close_connection(conn);
+            return;
+        }
+        process_input(conn);
+        resume_input(conn);
+    }
+
+    // 因缓冲已满停止读取的连接，在命令被处理掉一部分后继续读。
+    // 已在内核中的数据不会再触发边沿事件，放到本轮事件之后主动读取
+    void resume_input(Connection* conn) {
+        if (!conn->input_full || conn->closed) return;
+        if (conn->in.size() - conn->in_offset >= MAX_BUFFERED_INPUT) return;
+        conn->input_full = false;
+        std::shared_ptr<Connection> keep = connections[conn->fd];
+        loop.defer([this, keep]() {
+            if (keep->closed) return;
+            read_input(keep.get());
+            if (!keep->closed) flush(keep.get());
+        });
+    }
+
+    // 依次执行缓冲区中的完整命令；直接回复的命令连续执行，回复一起发送
+    void process_input(Connection* conn) {
+        std::vector<std::string> args;
+        while (!conn->closed && !conn->busy && !conn->close_after_write) {
+            size_t consumed = 0;
+            auto result = Parser::parse(conn->in.data() + conn->in_offset, conn->in.size() - conn->in_offset,
+                                        args, consumed);
+            if (result == Parser::Result::Incomplete) {
+                if (conn->input_full && conn->in.size() - conn->in_offset >= MAX_BUFFERED_INPUT) {
+                    // 单条命令超过缓冲上限，无法再读完
+                    put_error(conn->out, "Protocol error: command too large");
+                    conn->close_after_write = true;
+                    return;
+                }
+                if (conn->in_offset > 0) {
+                    conn->in.erase(0, conn->in_offset);
+                    conn->in_offset = 0;
+                }
+                return;
+            }
+            if (result == Parser::Result::Error) {
+                put_error(conn->out, "Protocol error");
+                conn->close_after_write = true;
+                return;
+            }
+            conn->in_offset += consumed;
+            if (conn->in_offset == conn->in.size()) {
+                conn->in.clear();
+                conn->in_offset = 0;
+            }
+            if (args.empty()) continue;
+
+            if (args[0].size() == 4 && strncasecmp(args[0].c_str(), "QUIT", 4) == 0) {
+                put_simple(conn->out, "OK");
+                conn->close_after_write = true;
+                return;
+            }
+            conn->busy = true;
+            std::shared_ptr<Connection> keep = connections[conn->fd];
+            handler(args, [this, keep](std::string reply) {
+                if (std::this_thread::get_id() == loop_thread) {
+                    // 在 process_input 中直接回复，由外层循环继续处理
+                    complete(keep.get(), reply);
+                    return;
+                }
+                loop.post([this, keep, reply = std::move(reply)]() {
+                    if (keep->closed) return;
+                    complete(keep.get(), reply);
+                    process_input(keep.get());
+                    resume_input(keep.get());
+                    flush(keep.get());
+                });
+            });
+        }
+    }
+
+    void complete(Connection* conn, const std::string& reply) {
+        conn->busy = false;
+        conn->out.append(reply);
+    }
+
+    void flush(Connection* conn) {
+        while (conn->out_offset < conn->out.size()) {
+            ssize_t n = send(conn->fd, conn->out.data() + conn->out_offset,
+                             conn->out.size() - conn->out_offset, MSG_NOSIGNAL);
+            if (n > 0) {
+                conn->out_offset += n;
+                continue;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+            close_connection(conn);
+            return;
+        }
+        conn->out.clear();
+        conn->out_offset = 0;
+        if (conn->close_after_write || (conn->peer_closed && !conn->busy)) {
+            close_connection(conn);
+        }
+    }
+
+    void close_connection(Connection* conn) {
+        if (conn->closed) return;
+        conn->closed = true;
+        loop.remove(conn->fd);
+        close(conn->fd);
+        auto it = connections.find(conn->fd);
+        if (it != connections.end()) {
+            loop.release_later(it->second);
+            connections.erase(it);
+        }
+    }
+};
+
+} // namespace resp
+
+#endif // RESP_SERVER_H
@@ -0,0 +1,183 @@
+#!/bin/bash
+
+# 扩容迁移测试：在本机启动两个节点并写入数据，再让第三个节点加入集群。
+# 迁移进行期间并发改写和删除一部分key，迁移完成后从每个节点读取所有key，
+# 改写的key必须是新值，删除的key必须不存在，其余key保持原值。
+# 用法: ./test_migration.sh [cache_server 可执行文件]，需先 make
+
+SERVER=${1:-./cache_server}
+
+[[ -x $SERVER ]] || {
+	echo "Error: $SERVER not found, run make first."
+	exit 1
+}
+
+which jq >/dev/null 2>&1 || {
+	echo "Error: please install jq first."
+	exit 3
+}
+
+PORT_BASE=21526
+HOST_BASE=127.0.0.1
+KEY_COUNT=1500
+UPDATED_KEYS=500    # key-0 ~ key-499 在迁移期间改写
+DELETED_END=750     # key-500 ~ key-749 在迁移期间删除
+MIGRATION_RATE=100
+WORK_DIR=$(mktemp -d)
+
+PASS_PROMPT="\e[1;32mPASS\e[0m"
+FAIL_PROMPT="\e[1;31mFAIL\e[0m"
+
+function node_url() {
+	echo http://$HOST_BASE:$(($PORT_BASE + $1))
+}
+
+function cleanup() {
+	local pids=$(jobs -p)
+	[[ -n $pids ]] && kill $pids 2>/dev/null
+	rm -rf "$WORK_DIR"
+}
+trap cleanup EXIT
+
+function start_node() {
+	local idx=$1
+	shift
+	$SERVER $(($PORT_BASE + $idx)) --self=$(node_url $idx) --migration-rate=$MIGRATION_RATE "$@" \
+		>"$WORK_DIR/node$idx.log" 2>&1 &
+}
+
+function wait_healthy() {
+	local idx=$1
+	local i=0
+	while [[ $i -lt 50 ]]; do
+		curl -s -o /dev/null $(node_url $idx)/health && return 0
+		sleep 0.1
+		((i++))
+	done
+	echo "Error: node $idx did not start"
+	cat "$WORK_DIR/node$idx.log"
+	return 1
+}
+
+# 第 $1 ~ $2-1 个key迁移完成后应有的内容（删除的key不出现）
+function expected_batch() {
+	jq -cn --argjson from $1 --argjson to $2 --argjson updated $UPDATED_KEYS --argjson deleted $DELETED_END '
+		[range($from; $to) | select(. < $updated or . >= $deleted)]
+		| map({("key-\(.)"): (if . < $updated then "new \(.)" else "old \(.)" end)}) | add // {}'
+}
+
+function test_prepare() {
+	start_node 1 --nodes=$(node_url 1),$(node_url 2)
+	start_node 2 --nodes=$(node_url 1),$(node_url 2)
+	wait_healthy 1 && wait_healthy 2 || return 1
+
+	local i=0
+	while [[ $i -lt $KEY_COUNT ]]; do
+		local batch=$(jq -n --argjson from $i '[range($from; $from + 100)] | map({("key-\(.)"): "old \(.)"}) | add')
+		local status_code=$(curl -s -o /dev/null -w "%{http_code}" -XPOST -H "Content-type: application/json" \
+			-d "$batch" $(node_url 1))
+		if [[ $status_code -ne 200 ]]; then
+			echo "Error: expect status code 200 but got $status_code"
+			return 1
+		fi
+		((i += 100))
+	done
+}
+
+# 第三个节点加入后立即开始改写和删除，写入随机发往三个节点
+function test_join_with_writes() {
+	start_node 3 --nodes=$(node_url 3) --join=$(node_url 1)
+	wait_healthy 3 || return 1
+	if grep -q "数据迁移完成" "$WORK_DIR/node1.log" "$WORK_DIR/node2.log"; then
+		echo "Warning: migration finished before the writes started"
+	fi
+
+	(
+		for ((i = 0; i < UPDATED_KEYS; i++)); do
+			local status_code=$(curl -s -o /dev/null -w "%{http_code}" -XPOST -H "Content-type: application/json" \
+				-d "{\"key-$i\": \"new $i\"}" $(node_url $(shuf -i 1-3 -n 1)))
+			[[ $status_code -ne 200 ]] && echo "set key-$i: $status_code"
+		done
+	) >"$WORK_DIR/writer.err" &
+	local writer=$!
+	(
+		for ((i = UPDATED_KEYS; i < DELETED_END; i++)); do
+			local status_code=$(curl -s -o /dev/null -w "%{http_code}" -XDELETE $(node_url $(shuf -i 1-3 -n 1))/key-$i)
+			[[ $status_code -ne 200 ]] && echo "delete key-$i: $status_code"
+		done
+	) >"$WORK_DIR/deleter.err" &
+	local deleter=$!
+	wait $writer $deleter
+
+	if [[ -s $WORK_DIR/writer.err || -s $WORK_DIR/deleter.err ]]; then
+		echo "Error: writes failed during migration"
+		head -5 "$WORK_DIR/writer.err" "$WORK_DIR/deleter.err"
+		return 1
+	fi
+}
+
+function test_migration_done() {
+	local i=0
+	while [[ $i -lt 60 ]]; do
+		grep -q "数据迁移完成" "$WORK_DIR/node1.log" && grep -q "数据迁移完成" "$WORK_DIR/node2.log" && break
+		sleep 1
+		((i++))
+	done
+	if [[ $i -ge 60 ]]; then
+		echo "Error: migration did not finish in 60s"
+		return 1
+	fi
+
+	local idx
+	local version
+	for idx in 1 2 3; do
+		version=$(curl -s $(node_url $idx)/cluster/nodes | jq -r '"\(.version) \(.nodes | length)"')
+		if [[ "$version" != "2 3" ]]; then
+			echo -e "Error:\tnode $idx has membership \"$version\", expect \"2 3\""
+			return 1
+		fi
+	done
+}
+
+# 每个节点都要返回同样的结果：key不在本节点时会转发到所属节点（迁移期间还会回退到旧的所属节点）
+function test_get_after_migration() {
+	local idx
+	local i
+	for idx in 1 2 3; do
+		for ((i = 0; i < KEY_COUNT; i += 100)); do
+			local keys=$(seq -s, -f "key-%g" $i $(($i + 99)))
+			local response=$(curl -s -w "\n%{http_code}" "$(node_url $idx)/_mget?keys=$keys")
+			local result=$(echo "$response" | sed '$d')
+			local status_code=$(echo "$response" | tail -n 1)
+			local expect=$(expected_batch $i $(($i + 100)))
+			if [[ $status_code -ne 200 ]]; then
+				echo "Error: node $idx expect status code 200 but got $status_code"
+				return 1
+			fi
+			# 列出前几个不一致的key: [key, 期望值, 实际值]，null 表示不存在
+			local diff=$(jq -cn --argjson got "$result" --argjson expect "$expect" '
+				[($got + $expect) | keys[] | select($got[.] != $expect[.]) | [., $expect[.], $got[.]]] | .[:5]')
+			if [[ "$diff" != "[]" ]]; then
+				echo -e "Error:\tnode $idx returned unexpected values"
+				echo -e "\t[key, expect, got]: $diff"
+				return 1
+			fi
+		done
+	done
+}
+
+function run_test() {
+	local test_function=$1
+
+	if $test_function; then
+		echo -e "$test_function ...... ${PASS_PROMPT}"
+		return 0
+	else
+		echo -e "$test_function ...... ${FAIL_PROMPT}"
+		return 1
+	fi
+}
+
+for test_function in test_prepare test_join_with_writes test_migration_done test_get_after_migration; do
+	run_test $test_function || exit 1
+done
@@ -0,0 +1,583 @@
+// 单元测试：一致性哈希的放置、HTTP请求的流水线解析、RESP命令的分帧、WAL和快照的恢复，
+// 以及迁移写入（setIfAbsent）与并发写入、删除的交错。
+// make test 编译并运行全部测试；./unit_tests 名称子串 只运行名称包含该子串的测试。
+// 任一检查失败时以非零状态退出
+#include "cache_node.h"
+#include <thread>
+#include <ftw.h>
+
+namespace {
+
+int check_failures = 0;
+
+#define CHECK(cond)                                                                       \
+    do {                                                                                  \
+        if (!(cond)) {                                                                    \
+            cerr << "  " << __FILE__ << ":" << __LINE__ << ": 检查失败: " #cond << endl;  \
+            check_failures++;                                                             \
+        }                                                                                 \
+    } while (0)
+
+#define CHECK_EQ(a, b)                                                                                  \
+    do {                                                                                                \
+        auto check_a = (a);                                                                             \
+        auto check_b = (b);                                                                             \
+        if (!(check_a == check_b)) {                                                                    \
+            cerr << "  " << __FILE__ << ":" << __LINE__ << ": 检查失败: " #a " == " #b " (" << check_a  \
+                 << " != " << check_b << ")" << endl;                                                   \
+            check_failures++;                                                                           \
+        }                                                                                               \
+    } while (0)
+
+vector<string> makeKeys(size_t count) {
+    vector<string> keys;
+    keys.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        keys.push_back("key-" + to_string(i));
+    }
+    return keys;
+}
+
+ConsistentHash makeRing(ConsistentHash::Mode mode, const vector<string>& nodes) {
+    ConsistentHash ring(mode);
+    for (const auto& node : nodes) {
+        ring.addNode(node);
+    }
+    return ring;
+}
+
+const vector<string> NODES = {"http://cache-server-1:9527", "http://cache-server-2:9528", "http://cache-server-3:9529"};
+const ConsistentHash::Mode MODES[] = {ConsistentHash::Mode::Ring, ConsistentHash::Mode::Rendezvous};
+
+// ---------------- 一致性哈希 ----------------
+
+// 所有节点按各自的成员列表独立建环，同一个key必须落在同一个节点上，与加入顺序无关
+void testRingDeterministic() {
+    vector<string> reversed(NODES.rbegin(), NODES.rend());
+    for (auto mode : MODES) {
+        ConsistentHash a = makeRing(mode, NODES);
+        ConsistentHash b = makeRing(mode, NODES);
+        ConsistentHash c = makeRing(mode, reversed);
+        size_t mismatches = 0;
+        for (const auto& key : makeKeys(10000)) {
+            const string& owner = a.getNode(key);
+            if (owner != b.getNode(key) || owner != c.getNode(key)) mismatches++;
+        }
+        CHECK_EQ(mismatches, size_t(0));
+    }
+}
+
+// 每个节点分到的key大致均匀
+void testRingBalance() {
+    for (auto mode : MODES) {
+        ConsistentHash ring = makeRing(mode, NODES);
+        unordered_map<string, size_t> counts;
+        auto keys = makeKeys(30000);
+        for (const auto& key : keys) {
+            counts[ring.getNode(key)]++;
+        }
+        CHECK_EQ(counts.size(), NODES.size());
+        for (const auto& node : NODES) {
+            double share = static_cast<double>(counts[node]) / keys.size();
+            CHECK(share > 0.2 && share < 0.47);
+        }
+    }
+}
+
+// 加入一个节点只会把约 1/N 的key移到新节点，其余key不动；移除它后恢复原来的放置
+void testRingMinimalMovement() {
+    vector<string> grown = NODES;
+    grown.push_back("http://cache-server-4:9530");
+    for (auto mode : MODES) {
+        ConsistentHash before = makeRing(mode, NODES);
+        ConsistentHash after = makeRing(mode, grown);
+        auto keys = makeKeys(20000);
+        size_t moved = 0;
+        size_t moved_elsewhere = 0;
+        for (const auto& key : keys) {
+            const string& old_owner = before.getNode(key);
+            const string& new_owner = after.getNode(key);
+            if (old_owner != new_owner) {
+                moved++;
+                if (new_owner != grown.back()) moved_elsewhere++;
+            }
+        }
+        double fraction = static_cast<double>(moved) / keys.size();
+        CHECK_EQ(moved_elsewhere, size_t(0));
+        CHECK(fraction > 0.15 && fraction < 0.35);
+
+        ConsistentHash shrunk = makeRing(mode, NODES);
+        size_t restored = 0;
+        for (const auto& key : keys) {
+            if (shrunk.getNode(key) == before.getNode(key)) restored++;
+        }
+        CHECK_EQ(restored, keys.size());
+    }
+}
+
+// 副本落在不同节点上，第一个副本就是主节点；副本数超过节点数时截断
+void testRingReplicas() {
+    for (auto mode : MODES) {
+        ConsistentHash ring = makeRing(mode, NODES);
+        size_t bad = 0;
+        for (const auto& key : makeKeys(5000)) {
+            vector<int> replicas = ring.getNodeIndexes(key, 2);
+            unordered_set<int> distinct(replicas.begin(), replicas.end());
+            if (replicas.size() != 2 || distinct.size() != 2 || replicas[0] != ring.getNodeIndex(key)) bad++;
+            if (ring.getNodeIndexes(key, 10).size() != NODES.size()) bad++;
+        }
+        CHECK_EQ(bad, size_t(0));
+        CHECK(makeRing(mode, {}).getNodeIndexes("key", 2).empty());
+        CHECK_EQ(makeRing(mode, {}).getNodeIndex("key"), -1);
+    }
+}
+
+// ---------------- HTTP请求解析 ----------------
+
+// 同一缓冲区里的多个请求逐个解析，consumed 指向下一个请求的开头
+void testHttpPipelined() {
+    string data =
+        "GET /a HTTP/1.1\r\nHost: x\r\n\r\n"
+        "POST / HTTP/1.1\r\nContent-Type: application/json\r\nContent-Length: 11\r\n\r\n{\"b\":\"v\r\n\"}"
+        "DELETE /c?ttl=5 HTTP/1.1\r\nConnection: close\r\n\r\n";
+    httplib::RequestParser parser;
+    vector<httplib::Request> requests;
+    size_t offset = 0;
+    while (offset < data.size()) {
+        httplib::Request req;
+        size_t consumed = 0;
+        auto result = parser.parse(data.data() + offset, data.size() - offset, req, consumed);
+        CHECK(result == httplib::RequestParser::Result::Complete);
+        if (result != httplib::RequestParser::Result::Complete) return;
+        CHECK(consumed > 0);
+        offset += consumed;
+        requests.push_back(req);
+    }
+    CHECK_EQ(requests.size(), size_t(3));
+    if (requests.size() != 3) return;
+    CHECK_EQ(requests[0].method, string("GET"));
+    CHECK_EQ(requests[0].path, string("/a"));
+    CHECK(requests[0].body.empty());
+    CHECK_EQ(requests[1].method, string("POST"));
+    CHECK_EQ(requests[1].body, string("{\"b\":\"v\r\n\"}"));
+    CHECK_EQ(requests[2].method, string("DELETE"));
+    CHECK_EQ(requests[2].path, string("/c"));
+    CHECK_EQ(requests[2].get_param_value("ttl"), string("5"));
+    CHECK(!parser.keep_alive());
+}
+
+// 请求逐字节到达：收全之前都是 Incomplete，收全后的结果与一次到达相同，
+// 之后的流水线请求不受影响
+void testHttpByteByByte() {
+    string first = "POST /k HTTP/1.1\r\nContent-Length: 5\r\n\r\nhello";
+    string second = "GET /k HTTP/1.1\r\n\r\n";
+    string data = first + second;
+    httplib::RequestParser parser;
+    httplib::Request req;
+    size_t consumed = 0;
+    size_t incomplete = 0;
+    for (size_t size = 1; size < first.size(); size++) {
+        if (parser.parse(data.data(), size, req, consumed) == httplib::RequestParser::Result::Incomplete) {
+            incomplete++;
+        }
+    }
+    CHECK_EQ(incomplete, first.size() - 1);
+    CHECK(parser.parse(data.data(), first.size(), req, consumed) == httplib::RequestParser::Result::Complete);
+    CHECK_EQ(consumed, first.size());
+    CHECK_EQ(req.body, string("hello"));
+
+    httplib::Request next;
+    CHECK(parser.parse(data.data() + consumed, data.size() - consumed, next, consumed) ==
+          httplib::RequestParser::Result::Complete);
+    CHECK_EQ(next.method, string("GET"));
+    CHECK_EQ(consumed, second.size());
+}
+
+// 正文超过上限返回 PayloadTooLarge，头部超过上限或请求行不合法返回 BadRequest
+void testHttpLimits() {
+    httplib::RequestParser parser(1024, 16);
+    httplib::Request req;
+    size_t consumed = 0;
+    string large = "POST / HTTP/1.1\r\nContent-Length: 17\r\n\r\n";
+    CHECK(parser.parse(large.data(), large.size(), req, consumed) == httplib::RequestParser::Result::PayloadTooLarge);
+
+    string header(2048, 'a');
+    CHECK(parser.parse(header.data(), header.size(), req, consumed) == httplib::RequestParser::Result::BadRequest);
+    parser.reset();
+
+    string garbage = "NOT-HTTP\r\n\r\n";
+    httplib::Request bad;
+    CHECK(parser.parse(garbage.data(), garbage.size(), bad, consumed) == httplib::RequestParser::Result::BadRequest);
+
+    string ok = "POST / HTTP/1.1\r\nContent-Length: 16\r\n\r\n0123456789abcdef";
+    httplib::Request good;
+    CHECK(parser.parse(ok.data(), ok.size(), good, consumed) == httplib::RequestParser::Result::Complete);
+    CHECK_EQ(good.body.size(), size_t(16));
+}
+
+// ---------------- RESP分帧 ----------------
+
+resp::Parser::Result parseResp(const string& data, vector<string>& args, size_t& consumed) {
+    return resp::Parser::parse(data.data(), data.size(), args, consumed);
+}
+
+// 多条命令连在一起到达时逐条切分，批量字符串可以包含 \r\n
+void testRespPipelined() {
+    string data = "*3\r\n$3\r\nSET\r\n$1\r\nk\r\n$4\r\na\r\nb\r\n*2\r\n$3\r\nGET\r\n$1\r\nk\r\nPING\r\n*0\r\n";
+    vector<vector<string>> commands;
+    size_t offset = 0;
+    while (offset < data.size()) {
+        vector<string> args;
+        size_t consumed = 0;
+        auto result = parseResp(data.substr(offset), args, consumed);
+        CHECK(result == resp::Parser::Result::Complete);
+        if (result != resp::Parser::Result::Complete) return;
+        offset += consumed;
+        commands.push_back(args);
+    }
+    CHECK_EQ(commands.size(), size_t(4));
+    if (commands.size() != 4) return;
+    CHECK(commands[0] == vector<string>({"SET", "k", "a\r\nb"}));
+    CHECK(commands[1] == vector<string>({"GET", "k"}));
+    CHECK(commands[2] == vector<string>({"PING"}));
+    CHECK(commands[3].empty());
+}
+
+// 命令的任何一个前缀都是 Incomplete，且不产生参数
+void testRespPartial() {
+    string command = "*2\r\n$3\r\nGET\r\n$10\r\n0123456789\r\n";
+    size_t incomplete = 0;
+    size_t leaked = 0;
+    for (size_t size = 0; size < command.size(); size++) {
+        vector<string> args;
+        size_t consumed = 0;
+        if (resp::Parser::parse(command.data(), size, args, consumed) == resp::Parser::Result::Incomplete) incomplete++;
+        if (!args.empty() || consumed != 0) leaked++;
+    }
+    CHECK_EQ(incomplete, command.size());
+    CHECK_EQ(leaked, size_t(0));
+
+    vector<string> args;
+    size_t consumed = 0;
+    CHECK(parseResp(command, args, consumed) == resp::Parser::Result::Complete);
+    CHECK_EQ(consumed, command.size());
+    CHECK(args == vector<string>({"GET", "0123456789"}));
+}
+
+// 内联命令以空白分隔，\r\n 和 \n 结尾都可以
+void testRespInline() {
+    vector<string> args;
+    size_t consumed = 0;
+    CHECK(parseResp("SET  k\tv\r\nGET k\r\n", args, consumed) == resp::Parser::Result::Complete);
+    CHECK(args == vector<string>({"SET", "k", "v"}));
+    CHECK_EQ(consumed, size_t(10));
+    CHECK(parseResp("PING\n", args, consumed) == resp::Parser::Result::Complete);
+    CHECK(args == vector<string>({"PING"}));
+    CHECK(parseResp("PING", args, consumed) == resp::Parser::Result::Incomplete);
+}
+
+// 格式错误和超出上限的长度直接报错，而不是一直等待更多数据
+void testRespErrors() {
+    const vector<string> invalid = {
+        "*1\r\n:3\r\nGET\r\n",         // 参数不是批量字符串
+        "*1\r\n$3\r\nGETX\r\n",        // 长度与内容不符
+        "*1\r\n$-1\r\n",               // 负长度
+        "*x\r\n",                      // 数组长度不是整数
+        "*1\n$3\r\nGET\r\n",           // 缺少 \r
+        "*" + to_string(resp::MAX_ARGS + 1) + "\r\n",
+        "*1\r\n$" + to_string(resp::MAX_BULK_SIZE + 1) + "\r\n",
+        "*1\r\n$" + string(resp::MAX_INLINE_SIZE + 1, '1'),
+        string(resp::MAX_INLINE_SIZE + 1, 'a'),
+    };
+    for (const auto& data : invalid) {
+        vector<string> args;
+        size_t consumed = 0;
+        CHECK(parseResp(data, args, consumed) == resp::Parser::Result::Error);
+    }
+}
+
+// ---------------- 持久化 ----------------
+
+// 每个测试使用独立的临时目录，结束时删除
+struct TempDir {
+    string path;
+
+    TempDir() {
+        char name[] = "/tmp/sdcs-test-XXXXXX";
+        path = mkdtemp(name) ? name : "";
+    }
+
+    ~TempDir() {
+        if (path.empty()) return;
+        nftw(path.c_str(), [](const char* file, const struct stat*, int, struct FTW*) { return remove(file); },
+             16, FTW_DEPTH | FTW_PHYS);
+    }
+
+    vector<string> files(const string& prefix) const {
+        vector<string> result;
+        if (DIR* dir = opendir(path.c_str())) {
+            while (dirent* entry = readdir(dir)) {
+                string name = entry->d_name;
+                if (name.compare(0, prefix.size(), prefix) == 0) result.push_back(path + "/" + name);
+            }
+            closedir(dir);
+        }
+        sort(result.begin(), result.end());
+        return result;
+    }
+};
+
+Persistence::Options persistenceOptions(const TempDir& dir) {
+    Persistence::Options options;
+    options.dir = dir.path;
+    options.fsync_interval_ms = 1;
+    return options;
+}
+
+// 在新的存储上从 dir 恢复，返回恢复的key数
+size_t recoverInto(const TempDir& dir, ShardedStore& store) {
+    Persistence persistence(persistenceOptions(dir), store);
+    return persistence.recover();
+}
+
+string valueOf(const ShardedStore& store, const string& key) {
+    string value;
+    return store.get(key, value) ? value : "<missing>";
+}
+
+// 重启后从日志恢复：覆盖写取最后的值，删除的key不复活，过期时间按剩余时间恢复，已过期的不恢复
+void testWalRecovery() {
+    TempDir dir;
+    CHECK(!dir.path.empty());
+    {
+        ShardedStore store;
+        Persistence persistence(persistenceOptions(dir), store);
+        CHECK_EQ(persistence.recover(), size_t(0));
+        persistence.start();
+        for (int i = 0; i < 100; i++) {
+            store.set("key-" + to_string(i), "value-" + to_string(i));
+        }
+        store.set("key-1", "updated");
+        store.set("key-2", string("binary\0value", 12));
+        store.erase("key-3");
+        store.set("ttl-long", "v", 60000);
+        store.set("ttl-short", "v", 20);
+        store.set("key-4", "will be deleted");
+        store.erase("key-4");
+        persistence.stop();
+    }
+    this_thread::sleep_for(chrono::milliseconds(50));
+
+    ShardedStore recovered;
+    CHECK_EQ(recoverInto(dir, recovered), size_t(99));
+    CHECK_EQ(valueOf(recovered, "key-0"), string("value-0"));
+    CHECK_EQ(valueOf(recovered, "key-1"), string("updated"));
+    CHECK_EQ(valueOf(recovered, "key-2"), string("binary\0value", 12));
+    CHECK_EQ(valueOf(recovered, "key-3"), string("<missing>"));
+    CHECK_EQ(valueOf(recovered, "key-4"), string("<missing>"));
+    CHECK_EQ(valueOf(recovered, "key-99"), string("value-99"));
+    CHECK_EQ(valueOf(recovered, "ttl-short"), string("<missing>"));
+    string value;
+    int64_t ttl_ms = 0;
+    CHECK(recovered.get("ttl-long", value, ttl_ms));
+    CHECK(ttl_ms > 50000 && ttl_ms <= 60000);
+}
+
+// 快照之后的写入留在新的日志段里，恢复时先加载快照再重放日志；旧的日志段在快照后删除
+void testSnapshotRecovery() {
+    TempDir dir;
+    {
+        ShardedStore store;
+        Persistence::Options options = persistenceOptions(dir);
+        options.snapshot_wal_bytes = 1;
+        Persistence persistence(options, store);
+        persistence.recover();
+        persistence.start();
+        for (int i = 0; i < 1000; i++) {
+            store.set("key-" + to_string(i), "value-" + to_string(i));
+        }
+        store.set("ttl-long", "v", 60000);
+        // 快照线程每秒检查一次日志大小
+        for (int i = 0; i < 50 && persistence.stats().snapshots == 0; i++) {
+            this_thread::sleep_for(chrono::milliseconds(100));
+        }
+        CHECK(persistence.stats().snapshots >= 1);
+        CHECK_EQ(persistence.stats().last_snapshot_keys, uint64_t(1001));
+        store.set("key-0", "after snapshot");
+        store.erase("key-1");
+        store.set("key-new", "new");
+        persistence.stop();
+    }
+    CHECK_EQ(dir.files("snapshot.").size(), size_t(1));
+
+    ShardedStore recovered;
+    CHECK_EQ(recoverInto(dir, recovered), size_t(1001));
+    CHECK_EQ(valueOf(recovered, "key-0"), string("after snapshot"));
+    CHECK_EQ(valueOf(recovered, "key-1"), string("<missing>"));
+    CHECK_EQ(valueOf(recovered, "key-999"), string("value-999"));
+    CHECK_EQ(valueOf(recovered, "key-new"), string("new"));
+    string value;
+    int64_t ttl_ms = 0;
+    CHECK(recovered.get("ttl-long", value, ttl_ms));
+    CHECK(ttl_ms > 50000 && ttl_ms <= 60000);
+}
+
+// 日志末尾写了一半的记录（进程在 write 中途退出）被丢弃，之前的记录照常恢复，
+// 恢复后的新写入在新的日志段中，再次重启也能恢复
+void testWalTornTail() {
+    TempDir dir;
+    {
+        ShardedStore store;
+        Persistence persistence(persistenceOptions(dir), store);
+        persistence.recover();
+        persistence.start();
+        store.set("a", "1");
+        store.set("b", "2");
+        persistence.stop();
+    }
+    auto wal = dir.files("wal.");
+    CHECK_EQ(wal.size(), size_t(1));
+    if (wal.empty()) return;
+    {
+        int fd = open(wal.back().c_str(), O_WRONLY | O_APPEND);
+        CHECK(fd >= 0);
+        const char torn[] = {0x40, 0x00, 0x00, 0x00, 0x12, 0x34, 0x56, 0x78, 0x01, 0x00};
+        CHECK_EQ(write(fd, torn, sizeof(torn)), static_cast<ssize_t>(sizeof(torn)));
+        close(fd);
+    }
+    {
+        ShardedStore store;
+        Persistence persistence(persistenceOptions(dir), store);
+        CHECK_EQ(persistence.recover(), size_t(2));
+        persistence.start();
+        store.set("c", "3");
+        persistence.stop();
+    }
+    ShardedStore recovered;
+    CHECK_EQ(recoverInto(dir, recovered), size_t(3));
+    CHECK_EQ(valueOf(recovered, "a"), string("1"));
+    CHECK_EQ(valueOf(recovered, "c"), string("3"));
+}
+
+// 开启 sync_writes 时 whenDurable 在写入落盘后以成功回调
+void testSyncWrites() {
+    TempDir dir;
+    ShardedStore store;
+    Persistence::Options options = persistenceOptions(dir);
+    options.sync_writes = true;
+    Persistence persistence(options, store);
+    persistence.recover();
+    persistence.start();
+    store.set("k", "v");
+    promise<bool> durable;
+    persistence.whenDurable([&](bool ok) { durable.set_value(ok); });
+    auto future = durable.get_future();
+    CHECK(future.wait_for(chrono::seconds(5)) == future_status::ready);
+    CHECK(future.get());
+    CHECK(persistence.healthy());
+    persistence.stop();
+}
+
+// ---------------- 迁移写入 ----------------
+
+// 迁移只补上新副本还没有的key：已写入的新值不被旧值覆盖，记录删除期间删除的key不复活
+void testMigrateIfAbsent() {
+    ShardedStore store;
+    store.recordDeletes(true);
+    store.set("written", "new");
+    store.erase("deleted");
+    CHECK(store.setIfAbsent("written", "old"));
+    CHECK(store.setIfAbsent("deleted", "old"));
+    CHECK(store.setIfAbsent("missing", "old"));
+    CHECK_EQ(valueOf(store, "written"), string("new"));
+    CHECK_EQ(valueOf(store, "deleted"), string("<missing>"));
+    CHECK_EQ(valueOf(store, "missing"), string("old"));
+
+    // 迁出（不留墓碑）的key之后可以再迁回来；关闭记录后墓碑清空
+    store.erase("missing", false);
+    CHECK(store.setIfAbsent("missing", "again"));
+    CHECK_EQ(valueOf(store, "missing"), string("again"));
+    store.recordDeletes(false);
+    CHECK(store.setIfAbsent("deleted", "old"));
+    CHECK_EQ(valueOf(store, "deleted"), string("old"));
+}
+
+// 迁移线程写入旧值的同时，客户端并发写入和删除同样的key：每个key的最终状态都必须是客户端最后一次操作的结果
+void testMigrateConcurrentWrites() {
+    const int key_count = 20000;
+    ShardedStore store;
+    store.recordDeletes(true);
+    auto keys = makeKeys(key_count);
+    thread migrator([&]() {
+        for (int round = 0; round < 3; round++) {
+            for (const auto& key : keys) {
+                store.setIfAbsent(key, "migrated-" + key);
+            }
+        }
+    });
+    // 偶数key被改写，能被3整除的奇数key被删除，其余key保持迁移来的值
+    thread writer([&]() {
+        for (int i = 0; i < key_count; i += 2) {
+            store.set(keys[i], "written-" + keys[i]);
+        }
+    });
+    thread deleter([&]() {
+        for (int i = 3; i < key_count; i += 6) {
+            store.erase(keys[i]);
+        }
+    });
+    migrator.join();
+    writer.join();
+    deleter.join();
+
+    size_t mismatches = 0;
+    for (int i = 0; i < key_count; i++) {
+        string expected = i % 2 == 0 ? "written-" + keys[i] : i % 3 == 0 ? "<missing>" : "migrated-" + keys[i];
+        if (valueOf(store, keys[i]) != expected) mismatches++;
+    }
+    CHECK_EQ(mismatches, size_t(0));
+}
+
+struct TestCase {
+    const char* name;
+    void (*run)();
+};
+
+const TestCase TESTS[] = {
+    {"ring_deterministic", testRingDeterministic},
+    {"ring_balance", testRingBalance},
+    {"ring_minimal_movement", testRingMinimalMovement},
+    {"ring_replicas", testRingReplicas},
+    {"http_pipelined", testHttpPipelined},
+    {"http_byte_by_byte", testHttpByteByByte},
+    {"http_limits", testHttpLimits},
+    {"resp_pipelined", testRespPipelined},
+    {"resp_partial", testRespPartial},
+    {"resp_inline", testRespInline},
+    {"resp_errors", testRespErrors},
+    {"wal_recovery", testWalRecovery},
+    {"snapshot_recovery", testSnapshotRecovery},
+    {"wal_torn_tail", testWalTornTail},
+    {"sync_writes", testSyncWrites},
+    {"migrate_if_absent", testMigrateIfAbsent},
+    {"migrate_concurrent_writes", testMigrateConcurrentWrites},
+};
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    string filter = argc > 1 ? argv[1] : "";
+    int failed = 0;
+    int ran = 0;
+    for (const auto& test : TESTS) {
+        if (!filter.empty() && string(test.name).find(filter) == string::npos) continue;
+        int before = check_failures;
+        test.run();
+        ran++;
+        bool ok = check_failures == before;
+        if (!ok) failed++;
+        cout << test.name << " ...... " << (ok ? "\033[1;32mPASS\033[0m" : "\033[1;31mFAIL\033[0m") << endl;
+    }
+    cout << ran - failed << "/" << ran << " 个测试通过" << endl;
+    return failed == 0 && ran > 0 ? 0 : 1;
+}